@@ -0,0 +1,15 @@
+#ifndef DEBUG_EXIT_H
+#define DEBUG_EXIT_H
+
+#include <stdint.h>
+
+#define DEBUG_EXIT_SUCCESS 0
+#define DEBUG_EXIT_FAILURE 1
+
+/**
+ * Stop QEMU through its isa-debug-exit device (iobase 0xf4), which exits
+ * with the status (code << 1) | 1. Without the device, halt the CPU.
+ */
+void debug_exit__exit(uint8_t code) __attribute__((noreturn));
+
+#endif
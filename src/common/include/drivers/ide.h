@@ -0,0 +1,12 @@
+#ifndef IDE_H
+#define IDE_H
+
+/**
+ * Find the IDE controller, identify its disks and register them as the
+ * block devices hda to hdd. Transfers use bus master DMA when the
+ * controller and the disk support it, programmed I/O otherwise.
+ * Must be called after pci__init, from a thread.
+ */
+void ide__init(void);
+
+#endif
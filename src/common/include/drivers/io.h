@@ -2,8 +2,23 @@
 #define IO_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 void outb(uint16_t port, uint8_t value);
 uint8_t inb(uint16_t port);
+void outw(uint16_t port, uint16_t value);
+uint16_t inw(uint16_t port);
+void outl(uint16_t port, uint32_t value);
+uint32_t inl(uint16_t port);
+
+/**
+ * Read count words from port into buffer, with a single rep insw
+ */
+void insw(uint16_t port, void* buffer, size_t count);
+
+/**
+ * Write count words of buffer to port, with a single rep outsw
+ */
+void outsw(uint16_t port, const void* buffer, size_t count);
 
 #endif
@@ -3,4 +3,9 @@
 
 void keyboard__init(void);
 
+/**
+ * Sleep until a character is typed, and return it
+ */
+char keyboard__getchar(void);
+
 #endif
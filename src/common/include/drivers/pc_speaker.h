@@ -2,8 +2,20 @@
 #define PC_SPEAKER_H
 
 #include <stdint.h>
+#include <stddef.h>
+
+#define PC_SPEAKER_MAX_NOTES 32
 
 void pc_speaker__play(uint32_t frequency);
 void pc_speaker__stop(void);
 
+/**
+ * Queue a sequence of tones and return immediately: the notes are switched
+ * by a kernel timer. A frequency of 0 is a silence. Durations are in ms.
+ * The sequence is appended to the one being played, if any.
+ * Needs the timer wheel (timer__init).
+ * @returns the number of notes queued (the queue holds PC_SPEAKER_MAX_NOTES)
+ */
+size_t pc_speaker__play_sequence(const uint32_t* notes, const uint32_t* durations, size_t count);
+
 #endif
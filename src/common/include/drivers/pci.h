@@ -0,0 +1,81 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PCI_DEVICES_MAX 32
+
+// Configuration space registers
+#define PCI_VENDOR_ID 0x00
+#define PCI_COMMAND 0x04
+#define PCI_CLASS 0x08
+#define PCI_HEADER_TYPE 0x0C
+#define PCI_BAR0 0x10
+#define PCI_SUBSYSTEM 0x2C
+#define PCI_INTERRUPT_LINE 0x3C
+
+// Command register bits
+#define PCI_COMMAND_IO 0x1
+#define PCI_COMMAND_MEMORY 0x2
+#define PCI_COMMAND_BUS_MASTER 0x4
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUBCLASS_IDE 0x01
+
+typedef struct {
+    uint8_t bus;
+    uint8_t slot;
+    uint8_t function;
+    uint16_t vendor_id;
+    uint16_t device_id;
+    uint8_t class_code;
+    uint8_t subclass;
+    uint8_t prog_if;
+    uint8_t irq; // interrupt line set up by the firmware, 0xFF if none
+} pci_device_t;
+
+/**
+ * Scan every bus for devices
+ */
+void pci__init(void);
+
+size_t pci__count(void);
+
+pci_device_t* pci__get(size_t index);
+
+/**
+ * @returns the first device of the given class and subclass after
+ * from (NULL to start from the first device), NULL if there is none
+ */
+pci_device_t* pci__find_class(uint8_t class_code, uint8_t subclass, pci_device_t* from);
+
+/**
+ * @returns the first device with the given identifiers after from, NULL if
+ * there is none
+ */
+pci_device_t* pci__find_device(uint16_t vendor_id, uint16_t device_id, pci_device_t* from);
+
+/**
+ * Access the configuration space, offset is rounded down to 4 bytes
+ */
+uint32_t pci__read(pci_device_t* device, uint8_t offset);
+void pci__write(pci_device_t* device, uint8_t offset, uint32_t value);
+
+/**
+ * @returns the base address of an I/O or memory BAR, without its flag bits
+ */
+uint32_t pci__bar(pci_device_t* device, size_t index);
+
+/**
+ * @returns true if the BAR is in the I/O space
+ */
+bool pci__bar_is_io(pci_device_t* device, size_t index);
+
+/**
+ * Set bits of the command register (I/O, memory, bus mastering)
+ */
+void pci__enable(pci_device_t* device, uint16_t command);
+
+#endif
@@ -2,6 +2,9 @@
 #define PIT_H
 
 #include <stdint.h>
+#include <stdbool.h>
+
+#define PIT_INPUT_FREQUENCY 1193182
 
 typedef enum {
     PIT_CH0 = 0,
@@ -9,7 +12,60 @@ typedef enum {
     PIT_CH2 = 2
 } pit__channel_t;
 
+// Tick counter, incremented by the IRQ0 fast path
+extern volatile uint32_t pit__ticks;
+// Tick at which the IRQ0 fast path has to call the timer handlers
+extern volatile uint32_t pit__next_event;
+
 void pit__init(uint32_t frequency);
+
+/**
+ * Ask the IRQ0 handlers to be called at the given tick. Every request is
+ * cleared once the handlers have run.
+ */
+void pit__request_event(uint32_t tick);
 void pit__set_frequency(pit__channel_t channel, uint32_t frequency);
 
+/**
+ * @returns the number of ticks since pit__init
+ */
+uint32_t pit__get_ticks(void);
+
+/**
+ * @returns the frequency of the ticks, in Hz
+ */
+uint32_t pit__get_frequency(void);
+
+/**
+ * Busy wait for count cycles of the PIT input clock (1193182 Hz), counted
+ * by channel 2. No interrupt is involved, which makes it suitable for
+ * calibrating other clocks. Once the TSC is calibrated, prefer
+ * clock__delay_us.
+ */
+void pit__ch2_wait(uint16_t count);
+
+/**
+ * Serialize the users of channel 2 and of the PC speaker port, with the
+ * interrupts disabled (pit__ch2_wait takes it)
+ * @returns the flags to give to pit__ch2_unlock
+ */
+uint32_t pit__ch2_lock(void);
+
+void pit__ch2_unlock(uint32_t flags);
+
+/**
+ * Stop the periodic tick until the next requested event (see
+ * pit__request_event): channel 0 is programmed in one-shot mode to raise
+ * a single IRQ0 at that time. Must be called with interrupts disabled.
+ * @returns false if the next tick is needed anyway (nothing programmed)
+ */
+bool pit__tickless_enter(void);
+
+/**
+ * Go back to the periodic tick after a wake up from a tickless period,
+ * accounting for the ticks elapsed meanwhile. Must be called with
+ * interrupts disabled.
+ */
+void pit__tickless_exit(void);
+
 #endif
@@ -0,0 +1,26 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * Set up the first serial port (COM1) at 115200 bauds, 8N1, polled
+ * @returns false if there is no working port, the output is then dropped
+ */
+bool serial__init(void);
+
+/**
+ * Send a character, "\n" is sent as "\r\n"
+ */
+void serial__putchar(char c);
+
+void serial__write(const char* data, size_t size);
+
+/**
+ * Send a string. Strings sent by different CPUs are not interleaved.
+ */
+void serial__writestring(const char* data);
+
+#endif
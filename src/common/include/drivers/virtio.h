@@ -0,0 +1,154 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/pci.h"
+#include "kernel/spinlock.h"
+#include "kernel/waitqueue.h"
+
+#define VIRTIO_VENDOR_ID 0x1AF4
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE 0x1
+#define VIRTIO_STATUS_DRIVER 0x2
+#define VIRTIO_STATUS_DRIVER_OK 0x4
+#define VIRTIO_STATUS_FAILED 0x80
+
+// ISR status bits, cleared by reading the register
+#define VIRTIO_ISR_QUEUE 0x1
+#define VIRTIO_ISR_CONFIG 0x2
+
+#define VIRTQ_DESC_F_NEXT 0x1
+#define VIRTQ_DESC_F_WRITE 0x2 // written by the device
+#define VIRTQ_AVAIL_F_NO_INTERRUPT 0x1
+#define VIRTQ_USED_F_NO_NOTIFY 0x1
+
+typedef struct {
+    uint64_t address;
+    uint32_t length;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) virtq_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    uint16_t ring[];
+} __attribute__((packed)) virtq_avail_t;
+
+typedef struct {
+    uint32_t id; // head of the descriptor chain
+    uint32_t length; // bytes written by the device
+} __attribute__((packed)) virtq_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t index;
+    virtq_used_elem_t ring[];
+} __attribute__((packed)) virtq_used_t;
+
+/*
+ * A physically contiguous chunk of a request
+ */
+typedef struct {
+    uint32_t address;
+    uint32_t length;
+    bool device_writes;
+} virtq_buffer_t;
+
+typedef struct virtqueue_struct virtqueue_t;
+
+/*
+ * Called for each request the device has used, with the queue locked
+ */
+typedef void (*virtq_complete_t)(virtqueue_t* queue, void* token, uint32_t length);
+
+/*
+ * A device on the legacy PCI transport: registers in the I/O space of BAR0
+ */
+typedef struct {
+    pci_device_t* pci;
+    uint16_t io;
+    uint32_t features; // negotiated
+} virtio_device_t;
+
+/*
+ * Split virtqueue: descriptor table, available ring (driver to device) and
+ * used ring (device to driver), in physically contiguous frames
+ */
+struct virtqueue_struct {
+    virtio_device_t* device;
+    uint16_t index;
+    uint16_t size; // descriptors
+    volatile virtq_desc_t* descriptors;
+    volatile virtq_avail_t* avail;
+    volatile virtq_used_t* used;
+    void** tokens; // token of each chain, by head descriptor
+    uint16_t free_head; // free descriptors are chained by next
+    uint16_t free_count;
+    uint16_t avail_index; // published to the device by virtqueue__kick
+    uint16_t last_used;
+    uint32_t in_flight;
+    spinlock_t lock;
+    waitqueue_t waiters; // woken up when descriptors are freed
+    virtq_complete_t complete;
+};
+
+/**
+ * Reset the device and tell it a driver has been found
+ * @returns 0 if success, -1 if BAR0 is not an I/O BAR
+ */
+int virtio__init(virtio_device_t* device, pci_device_t* pci);
+
+/**
+ * Accept the features of supported that the device offers
+ * @returns the accepted features
+ */
+uint32_t virtio__negotiate(virtio_device_t* device, uint32_t supported);
+
+/**
+ * Allocate and register the queue index of the device
+ * @returns 0 if success, -1 if the device has no such queue
+ */
+int virtio__setup_queue(virtio_device_t* device, virtqueue_t* queue, uint16_t index, virtq_complete_t complete);
+
+/**
+ * Tell the device the driver is ready, or failed
+ */
+void virtio__set_ready(virtio_device_t* device, bool ok);
+
+/**
+ * Read the device specific configuration (8, 16 or 32 bits accesses)
+ */
+uint8_t virtio__config_read8(virtio_device_t* device, uint16_t offset);
+uint32_t virtio__config_read32(virtio_device_t* device, uint16_t offset);
+
+/**
+ * Read and acknowledge the interrupt status
+ */
+uint8_t virtio__isr(virtio_device_t* device);
+
+/**
+ * Chain count buffers in free descriptors and queue the chain in the
+ * available ring, without notifying the device
+ * @returns 0 if success, -1 if there are not enough free descriptors
+ */
+int virtqueue__add(virtqueue_t* queue, const virtq_buffer_t* buffers, size_t count, void* token);
+
+/**
+ * Make the chains added since the last kick visible to the device, and
+ * notify it unless it asked not to be
+ */
+void virtqueue__kick(virtqueue_t* queue);
+
+/**
+ * Complete the chains used by the device, with its interrupts suppressed
+ * while the ring is drained. Safe to call from interrupt handlers.
+ * @returns the number of completed chains
+ */
+size_t virtqueue__drain(virtqueue_t* queue);
+
+#endif
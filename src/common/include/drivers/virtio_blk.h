@@ -0,0 +1,11 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+/**
+ * Find the virtio block devices (legacy PCI transport) and register them
+ * as the block devices vda, vdb... Must be called after pci__init, from
+ * a thread.
+ */
+void virtio_blk__init(void);
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#define BENCH_WARMUP_RUNS 100
+#define BENCH_RUNS 1000
+
+typedef void (*bench_func_t)(void);
+
+/*
+ * A benchmark, timing a single operation per run. setup and cleanup run
+ * before and after each timed run, untimed, and can be NULL.
+ */
+typedef struct {
+    const char* name;
+    bench_func_t setup;
+    bench_func_t run;
+    bench_func_t cleanup;
+} bench_t;
+
+/**
+ * Define a benchmark with a setup and a cleanup function, declared before:
+ *   BENCH_FIXTURE(kmem_free_64, alloc_block, NULL) {
+ *       kmem__free(block);
+ *   }
+ * The benchmarks are gathered by the linker in the .bench section.
+ */
+#define BENCH_FIXTURE(bench_name, setup_func, cleanup_func) \
+    static void bench_##bench_name(void); \
+    static const bench_t bench_entry_##bench_name \
+        __attribute__((section(".bench"), used, aligned(4))) = { \
+        .name = #bench_name, \
+        .setup = setup_func, \
+        .run = bench_##bench_name, \
+        .cleanup = cleanup_func, \
+    }; \
+    static void bench_##bench_name(void)
+
+#define BENCH(bench_name) BENCH_FIXTURE(bench_name, NULL, NULL)
+
+/**
+ * Run the benchmarks whose name starts with prefix (every one if prefix is
+ * NULL), with interrupts disabled during the timed runs. Each result is
+ * sent over the serial port as:
+ *   bench <name> min=<cycles> median=<cycles> p99=<cycles>
+ * The cost of the timing itself is subtracted.
+ * @returns the number of benchmarks run
+ */
+uint32_t bench__run(const char* prefix);
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BLOCK_DEVICES_MAX 8
+#define BLOCK_NAME_MAX 8
+
+typedef struct block_device_struct block_device_t;
+
+/*
+ * Read or write count blocks, starting at block, from or to buffer. The
+ * caller may sleep until the transfer is complete.
+ * @returns 0 if success, -1 if error
+ */
+typedef int (*block_read_t)(block_device_t* device, uint32_t block, uint32_t count, void* buffer);
+typedef int (*block_write_t)(block_device_t* device, uint32_t block, uint32_t count, const void* buffer);
+
+/*
+ * One transfer of a batch given to block__submit
+ */
+typedef struct {
+    uint32_t block;
+    uint32_t count;
+    void* buffer;
+    bool write;
+    int result; // 0 if success, -1 if error, set once the batch is done
+} block_request_t;
+
+/*
+ * Start every request of the batch before waiting for any of them, so that
+ * the device can process them together
+ * @returns 0 if every request succeeded, -1 otherwise
+ */
+typedef int (*block_submit_t)(block_device_t* device, block_request_t* requests, size_t count);
+
+/*
+ * A disk, addressed by blocks of block_size bytes
+ */
+struct block_device_struct {
+    char name[BLOCK_NAME_MAX]; // "hda", "vda"...
+    uint32_t block_size;
+    uint32_t blocks; // capacity
+    block_read_t read;
+    block_write_t write;
+    block_submit_t submit; // NULL if the driver has no batching
+    void* data; // private to the driver
+};
+
+/**
+ * Make device available to block__find. Devices are never removed.
+ * @returns 0 if success, -1 if there are too many devices
+ */
+int block__register(block_device_t* device);
+
+size_t block__count(void);
+
+block_device_t* block__get(size_t index);
+
+/**
+ * @returns the device called name, NULL if there is none
+ */
+block_device_t* block__find(const char* name);
+
+/**
+ * Check the range and call the driver
+ * @returns 0 if success, -1 if error
+ */
+int block__read(block_device_t* device, uint32_t block, uint32_t count, void* buffer);
+int block__write(block_device_t* device, uint32_t block, uint32_t count, const void* buffer);
+
+/**
+ * Process a batch of requests, and sleep until all of them are done.
+ * Without driver support, the requests are done one after the other.
+ * @returns 0 if every request succeeded, -1 otherwise
+ */
+int block__submit(block_device_t* device, block_request_t* requests, size_t count);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Calibrate the TSC against the PIT. Must be called after pit__init.
+ */
+void clock__init(void);
+
+/**
+ * @returns the number of nanoseconds since clock__init. The clock is
+ * monotonic. Its resolution is the TSC one, or the PIT tick one if the TSC
+ * is missing or unstable.
+ */
+uint64_t clock__now_ns(void);
+
+/**
+ * Busy wait for at least us microseconds, on the TSC if it is calibrated
+ * (channel 2 of the PIT is left to the PC speaker), else on the PIT
+ */
+void clock__delay_us(uint32_t us);
+
+/**
+ * Convert a number of TSC cycles to nanoseconds
+ */
+uint64_t clock__cycles_to_ns(uint64_t cycles);
+
+/**
+ * @returns the calibrated TSC frequency, in kHz (0 if the TSC is not used)
+ */
+uint32_t clock__tsc_khz(void);
+
+#endif
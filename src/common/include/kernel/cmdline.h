@@ -0,0 +1,22 @@
+#ifndef CMDLINE_H
+#define CMDLINE_H
+
+#include <stddef.h>
+
+#include "boot/multiboot.h"
+
+#define CMDLINE_SIZE 256
+
+/**
+ * Keep a copy of the kernel command line given by the bootloader: words
+ * separated by spaces, either "option" or "option=value"
+ */
+void cmdline__init(multiboot_info_t* mbi);
+
+/**
+ * Copy the value of option in value (size bytes), "" if it has none
+ * @returns 0, -1 if the option is not on the command line
+ */
+int cmdline__get(const char* option, char* value, size_t size);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include <stdint.h>
+
+#include "kernel/module.h"
+#include "kernel/thread.h"
+
+#define ELF_MAGIC 0x464c457f // "\x7f" "ELF", little endian
+#define ELFCLASS32 1
+#define ELFDATA2LSB 1
+#define ET_EXEC 2
+#define EM_386 3
+
+#define PT_LOAD 1
+
+// Segment flags
+#define PF_X 0x1
+#define PF_W 0x2
+#define PF_R 0x4
+
+typedef struct {
+    uint32_t e_magic;
+    uint8_t e_class;
+    uint8_t e_data;
+    uint8_t e_version_ident;
+    uint8_t e_pad[9];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint32_t e_entry;
+    uint32_t e_phoff;
+    uint32_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} __attribute__((packed)) elf32_header_t;
+
+typedef struct {
+    uint32_t p_type;
+    uint32_t p_offset;
+    uint32_t p_vaddr;
+    uint32_t p_paddr;
+    uint32_t p_filesz;
+    uint32_t p_memsz;
+    uint32_t p_flags;
+    uint32_t p_align;
+} __attribute__((packed)) elf32_program_header_t;
+
+// Top of the stack of user programs
+#define ELF_STACK_TOP 0xC0000000
+#define ELF_STACK_SIZE (64 * 1024)
+
+/**
+ * Start the ELF32 executable of a module in a new user mode thread. No
+ * page is read beforehand: each one is mapped by the page fault handler
+ * on first access. Read-only pages are mapped straight from the frames of
+ * the module.
+ * @returns the thread, NULL if the module is not a valid executable or
+ * overlaps a loaded program
+ */
+thread_t* elf__exec(module_t* module);
+
+#endif
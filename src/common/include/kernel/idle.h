@@ -0,0 +1,19 @@
+#ifndef IDLE_H
+#define IDLE_H
+
+#include <stdbool.h>
+
+/**
+ * Run the pending deferred work, then halt the CPU until the next
+ * interrupt. In tickless mode, the periodic tick is stopped until the
+ * next timer expiry. Switches to the ready threads, if any.
+ * Only called by the idle thread.
+ */
+void idle__enter(void);
+
+/**
+ * Enable or disable the tickless mode (enabled by default)
+ */
+void idle__set_tickless(bool enabled);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef INITRD_H
+#define INITRD_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/module.h"
+#include "kernel/vfs.h"
+
+/*
+ * A file of the initial ramdisk, a ustar archive loaded as a module. The
+ * content is never copied: it stays in the module memory.
+ */
+typedef struct initrd_file {
+    const char* path; // without leading or trailing '/'
+    uint32_t hash;
+    const void* data; // content, in the kernel mapping of the module
+    uint32_t phys; // physical address of the content
+    size_t size;
+    bool directory;
+    struct initrd_file* next; // next file of the hash bucket
+} initrd_file_t;
+
+/**
+ * Index the files of the archive in module
+ * @returns 0 if success, -1 if it is not a ustar archive
+ */
+int initrd__init(module_t* module);
+
+/**
+ * @returns the file at path (relative to the root of the archive, a
+ * leading '/' is ignored), NULL if there is none
+ */
+const initrd_file_t* initrd__lookup(const char* path);
+
+/**
+ * @returns the number of files (and directories) of the archive
+ */
+size_t initrd__count(void);
+
+/**
+ * Iterate on the files, in archive order
+ * @returns the file at index, NULL if index is out of range
+ */
+const initrd_file_t* initrd__get(size_t index);
+
+/**
+ * Read-only filesystem of the files indexed by initrd__init, the mount
+ * source is ignored
+ */
+extern const filesystem_t initrd__filesystem;
+
+#endif
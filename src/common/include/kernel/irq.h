@@ -0,0 +1,17 @@
+#ifndef IRQ_H
+#define IRQ_H
+
+#include <stdbool.h>
+
+/**
+ * Choose the interrupt controller: the local APIC and IO-APIC when
+ * available, the 8259 PICs otherwise
+ */
+void irq__init(void);
+
+/**
+ * @returns true when called from an IRQ handler or a bottom half
+ */
+bool irq__in_interrupt(void);
+
+#endif
@@ -0,0 +1,28 @@
+#ifndef KSYM_H
+#define KSYM_H
+
+#include <stdint.h>
+
+/**
+ * Find the kernel function containing addr, in the symbol table embedded
+ * in the kernel by the second link pass
+ * @returns its name and the offset of addr in it in *offset (can be
+ * NULL), NULL if addr is not in the kernel code
+ */
+const char* ksym__lookup(uint32_t addr, uint32_t* offset);
+
+/**
+ * Follow the saved frame pointers from ebp, as long as they stay between
+ * low and high and are mapped
+ * @returns the number of return addresses stored in callers, at most max
+ */
+uint32_t ksym__walk_frames(uint32_t ebp, uint32_t low, uint32_t high, uint32_t* callers, uint32_t max);
+
+/**
+ * Print eip, then the return addresses found by following the saved frame
+ * pointers from ebp, as "function+offset". The callers are only reliable
+ * if the kernel is built with FRAME_POINTERS=1.
+ */
+void ksym__backtrace(uint32_t eip, uint32_t ebp);
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef MODULE_H
+#define MODULE_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "boot/multiboot.h"
+
+#define MODULES_MAX 16
+#define MODULE_CMDLINE_SIZE 64
+
+/*
+ * A file loaded by the bootloader next to the kernel
+ */
+typedef struct {
+    uint32_t phys_start; // physical address of the first byte
+    size_t size;
+    char cmdline[MODULE_CMDLINE_SIZE];
+    const void* data; // kernel mapping, NULL until module__data is called
+} module_t;
+
+/**
+ * Record the modules given by the bootloader, and reserve their frames in
+ * the PMM. Must be called right after pmm__init, before any frame is
+ * allocated.
+ */
+void module__init(multiboot_info_t* mbi);
+
+size_t module__count(void);
+
+module_t* module__get(size_t index);
+
+/**
+ * Find a module by name: a word of its command line, or the file name of
+ * one of them
+ * @returns the module, NULL if there is none
+ */
+module_t* module__find(const char* name);
+
+/**
+ * Map the content of the module in the kernel address space, read-only
+ * @returns its address
+ */
+const void* module__data(module_t* module);
+
+#endif
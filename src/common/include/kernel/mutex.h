@@ -0,0 +1,40 @@
+#ifndef MUTEX_H
+#define MUTEX_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/thread.h"
+#include "kernel/waitqueue.h"
+
+#define MUTEX_SPIN_LIMIT 1000
+
+/*
+ * Sleeping mutex, for the critical sections of threads which may block.
+ * Must not be used from interrupt handlers (see spinlock.h).
+ */
+typedef struct {
+    volatile uint32_t owner; // owning thread_t, 0 when unlocked
+    bool adaptive;
+    waitqueue_t waiters;
+} mutex_t;
+
+#define MUTEX_INIT {0, false, WAITQUEUE_INIT}
+
+/**
+ * Initialize a mutex. An adaptive mutex spins (up to MUTEX_SPIN_LIMIT
+ * times) instead of sleeping while its owner runs on another CPU, which is
+ * cheaper for short critical sections.
+ */
+void mutex__init(mutex_t* mutex, bool adaptive);
+
+void mutex__lock(mutex_t* mutex);
+
+/**
+ * @returns true if the mutex was unlocked and is now owned by the caller
+ */
+bool mutex__trylock(mutex_t* mutex);
+
+void mutex__unlock(mutex_t* mutex);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/block.h"
+
+// Page flags
+#define PAGE_UPTODATE 0x1 // data read from the device
+#define PAGE_DIRTY 0x2 // modified since it was read or written back
+#define PAGE_BUSY 0x4 // being read or written back
+#define PAGE_ERROR 0x8 // the read failed
+#define PAGE_ACTIVE 0x10 // on the active list
+#define PAGE_REFERENCED 0x20 // accessed since it was last aged
+#define PAGE_READAHEAD 0x40 // reaching it starts the next readahead
+
+/*
+ * A page of a block device in the cache, in a PMM frame mapped in the
+ * page cache window
+ */
+typedef struct page_struct {
+    block_device_t* device; // NULL if the page is free
+    uint32_t index; // offset on the device, in pages
+    void* data;
+    volatile uint32_t flags;
+    uint32_t refs;
+    struct page_struct* hash_next;
+    // Least recently used first, on the active or the inactive list
+    struct page_struct* lru_prev;
+    struct page_struct* lru_next;
+} page_t;
+
+/**
+ * Size the cache after the available memory, and start its thread
+ * (readahead and write-back)
+ */
+void page_cache__init(void);
+
+/**
+ * @returns the page index of the device, read if needed, or NULL if the
+ * read failed. The page must be released with page_cache__put.
+ */
+page_t* page_cache__get(block_device_t* device, uint32_t index);
+
+void page_cache__put(page_t* page);
+
+/**
+ * Mark a page got with page_cache__get as modified: it will be written
+ * back, in a batch with the other dirty pages
+ */
+void page_cache__mark_dirty(page_t* page);
+
+/**
+ * Same as block__read and block__write, through the cache. Writes only
+ * reach the device when the pages are written back.
+ * @returns 0 if success, -1 if error
+ */
+int page_cache__read(block_device_t* device, uint32_t block, uint32_t count, void* buffer);
+int page_cache__write(block_device_t* device, uint32_t block, uint32_t count, const void* buffer);
+
+/**
+ * Write back every dirty page of the device (of every device if NULL)
+ * @returns 0 if success, -1 if a write failed
+ */
+int page_cache__sync(block_device_t* device);
+
+void page_cache__dump_stats(void);
+
+#endif
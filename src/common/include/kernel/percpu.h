@@ -0,0 +1,61 @@
+#ifndef PERCPU_H
+#define PERCPU_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_CPUS 16
+
+/*
+ * Data private to each CPU. The %gs segment of a CPU starts at its own
+ * cpu_t, so it is reached without knowing the CPU index.
+ */
+typedef struct cpu_struct {
+    struct cpu_struct* self; // must stay first, read through %gs:0
+    uint32_t index;
+    uint8_t apic_id;
+    bool online;
+} cpu_t;
+
+/**
+ * @returns the data of the current CPU. The caller must not be migrated
+ * to another CPU while using it (interrupts disabled).
+ */
+static inline cpu_t* percpu__this(void) {
+    cpu_t* cpu;
+    __asm__ __volatile__ ("movl %%gs:0, %0" : "=r" (cpu));
+    return cpu;
+}
+
+/**
+ * @returns the index of the current CPU, 0 for the boot CPU
+ */
+static inline uint32_t percpu__id(void) {
+    return percpu__this()->index;
+}
+
+/**
+ * Initialize the data of every CPU, the boot CPU is marked online.
+ * Called by gdt__init, before the per-CPU segments are built.
+ */
+void percpu__init(void);
+
+cpu_t* percpu__get(uint32_t index);
+
+/**
+ * Record the local APIC id of a CPU, and mark it online
+ */
+void percpu__set_online(uint32_t index, uint8_t apic_id);
+
+/**
+ * @returns the number of CPUs running the kernel
+ */
+uint32_t percpu__online_count(void);
+
+/**
+ * Load the %gs segment of the current CPU, found from its local APIC id.
+ * Called by the interrupt stubs when entering the kernel from user mode.
+ */
+void percpu__reload_gs(void);
+
+#endif
@@ -8,6 +8,35 @@
 
 void pmm__init(multiboot_memory_map_t* mmap, multiboot_uint32_t length);
 uint32_t pmm__alloc_frame(void);
-void pmm__free_frame(size_t);
+void pmm__free_frame(uint32_t frame_addr);
+
+/**
+ * Allocate count physically contiguous frames, for devices which need
+ * more than a page of contiguous memory (DMA rings)
+ * @returns the physical address of the first frame, 0 if there is no such
+ * range
+ */
+uint32_t pmm__alloc_frames(size_t count);
+
+/**
+ * Free the frames allocated by pmm__alloc_frames
+ */
+void pmm__free_frames(uint32_t frame_addr, size_t count);
+
+/**
+ * Mark the frames of the physical range [start, end) as used, so that they
+ * are never allocated (e.g. bootloader modules)
+ */
+void pmm__reserve(uint32_t start, uint32_t end);
+
+/**
+ * @returns the number of free frames
+ */
+size_t pmm__available(void);
+
+/**
+ * @returns the end of the highest available physical memory range
+ */
+uint32_t pmm__memory_end(void);
 
 #endif
@@ -0,0 +1,35 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+
+#define PROFILER_MAX_DEPTH 8 // callers recorded with each sample
+#define PROFILER_RING_SIZE 2048 // samples buffered per CPU
+
+/**
+ * Start sampling the code interrupted by the timer interrupts (IRQ0 on the
+ * boot CPU, the local timer on the others) frequency times per second, at
+ * most the tick frequency. Each sample keeps the interrupted eip and up to
+ * depth callers, found by following the frame pointers of kernel code
+ * (the kernel must be built with FRAME_POINTERS=1 for them to be valid).
+ * @returns 0, -1 if the buffers could not be allocated
+ */
+int profiler__start(uint32_t frequency, uint32_t depth);
+
+void profiler__stop(void);
+
+/**
+ * Send the buffered samples over the serial port and drop them, one line
+ * per sample:
+ *   sample <cpu> <eip> <caller> <caller's caller>...
+ * tools/profile_fold.py turns them into folded stacks for flame graphs.
+ */
+void profiler__dump(void);
+
+/**
+ * Print the count functions the buffered samples fell the most in, without
+ * dropping the samples
+ */
+void profiler__report(uint32_t count);
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef SCHED_H
+#define SCHED_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/thread.h"
+
+#define SCHED_DEFAULT_TIMESLICE_MS 50
+// Priority 0 is the highest
+#define SCHED_PRIORITIES 32
+#define SCHED_PRIORITY_DEFAULT 16
+// Priority levels gained by a thread when it is woken up, lost one by one
+// each time it uses a whole time slice
+#define SCHED_WAKE_BOOST 2
+#define SCHED_IRQ_WAKE_BOOST 4
+
+/**
+ * Turn the boot context into the "main" kernel thread, create the idle
+ * thread and hook the preemption to the PIT interrupt. The highest
+ * priority ready thread runs, threads of the same priority share the CPU
+ * in round robin. Each CPU has its own run queues, an idle CPU steals
+ * threads from the busy ones.
+ * Must be called after timer__init.
+ */
+void sched__init(void);
+
+/**
+ * Run the idle loop on an application processor, as its idle thread
+ * running on the stack from stack_bottom to stack_top
+ */
+void sched__start_ap(uint32_t stack_bottom, uint32_t stack_top) __attribute__((noreturn));
+
+/**
+ * @returns the running thread
+ */
+thread_t* sched__current(void);
+
+/**
+ * Make a thread ready to run and put it at the end of the run queue of its
+ * priority. Safe to call from interrupt handlers.
+ */
+void sched__enqueue(thread_t* thread);
+
+/**
+ * Make a blocked thread ready to run, with a priority boost (larger when
+ * called from an interrupt handler). Safe to call from interrupt handlers.
+ */
+void sched__wake_up(thread_t* thread);
+
+/**
+ * Change the base priority of a thread (0 to SCHED_PRIORITIES - 1)
+ */
+void sched__set_priority(thread_t* thread, uint32_t priority);
+
+/**
+ * Switch to the next ready thread. The current thread is put back in the
+ * run queue if it is still running, otherwise (blocked or dead) it is left
+ * out. The idle thread runs when no thread is ready.
+ * Must be called with interrupts disabled.
+ */
+void sched__schedule(void);
+
+/**
+ * Mark the current thread blocked unless *condition is already true,
+ * under the run queue lock sched__wake_up takes: a waker which sets
+ * *condition then calls sched__wake_up can not be missed
+ * @returns false if *condition is true (the thread is left running)
+ */
+bool sched__prepare_block(const volatile bool* condition);
+
+/**
+ * Sleep until sched__wake_up is called, if the current thread is still
+ * blocked (see waitqueue__prepare). Returns right away if it was woken up
+ * in the meantime.
+ */
+void sched__block(void);
+
+/**
+ * Keep the current thread running after it was marked blocked, whether or
+ * not it was woken up since
+ */
+void sched__cancel_block(void);
+
+/**
+ * Complete the switch to a new thread, called before it first runs
+ */
+void sched__finish_switch(void);
+
+/**
+ * Switch to another thread if the time slice of the current one is over
+ * or a higher priority thread is ready. Called on the way out of IRQs.
+ * The idle thread is left alone: it reschedules itself when hlt returns.
+ */
+void sched__preempt(void);
+
+/**
+ * @returns true if sched__schedule should be called
+ */
+bool sched__need_resched(void);
+
+/**
+ * @returns true if another CPU has ready threads waiting, which an idle
+ * CPU could steal with sched__schedule
+ */
+bool sched__can_steal(void);
+
+/**
+ * Set the time slice given to each thread before it is preempted
+ */
+void sched__set_timeslice(uint32_t ms);
+
+#endif
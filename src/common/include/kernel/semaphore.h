@@ -0,0 +1,37 @@
+#ifndef SEMAPHORE_H
+#define SEMAPHORE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/waitqueue.h"
+
+/*
+ * Counting semaphore. semaphore__up is safe to call from interrupt
+ * handlers, for instance to signal a completed I/O request.
+ */
+typedef struct {
+    volatile uint32_t count;
+    waitqueue_t waiters;
+} semaphore_t;
+
+#define SEMAPHORE_INIT(count) {(count), WAITQUEUE_INIT}
+
+void semaphore__init(semaphore_t* semaphore, uint32_t count);
+
+/**
+ * Take a unit, sleeping until one is available
+ */
+void semaphore__down(semaphore_t* semaphore);
+
+/**
+ * @returns true if a unit was available and has been taken
+ */
+bool semaphore__trydown(semaphore_t* semaphore);
+
+/**
+ * Release a unit, waking up a waiting thread
+ */
+void semaphore__up(semaphore_t* semaphore);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include <stdint.h>
+
+#include "kernel/spinlock.h"
+
+#define SLAB_SIZE 4096
+
+/*
+ * Pool of objects of a single size. Objects are carved from slabs of
+ * SLAB_SIZE bytes allocated with kmem__alloc, and freed objects go to a
+ * free list: allocating and freeing are O(1) and do not fragment the
+ * heap. Slabs are never given back to the heap.
+ */
+typedef struct {
+    const char* name;
+    uint32_t object_size;
+    uint32_t objects_per_slab;
+    void* free_list; // each free object starts with the next one
+    spinlock_t lock;
+    // Statistics
+    uint32_t slabs;
+    uint32_t allocated; // objects in use
+} slab_cache_t;
+
+/**
+ * Initialize a cache of objects of object_size bytes (at most SLAB_SIZE)
+ */
+void slab__init(slab_cache_t* cache, const char* name, uint32_t object_size);
+
+/**
+ * @returns a new object, NULL if the heap is exhausted
+ */
+void* slab__alloc(slab_cache_t* cache);
+
+void slab__free(slab_cache_t* cache, void* object);
+
+#endif
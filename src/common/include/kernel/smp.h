@@ -0,0 +1,18 @@
+#ifndef SMP_H
+#define SMP_H
+
+#include <stdint.h>
+
+/**
+ * Start the application processors listed by the ACPI MADT. Each of them
+ * enables its local APIC and timer, and runs its idle thread.
+ * Must be called after sched__init, with the local APIC enabled.
+ */
+void smp__init(void);
+
+/**
+ * Interrupt the given CPU so that it runs its scheduler
+ */
+void smp__send_reschedule(uint32_t cpu_index);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef SPINLOCK_H
+#define SPINLOCK_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/cpu.h"
+
+/*
+ * Ticket spinlock: CPUs get the lock in the order they asked for it.
+ * A lock also taken by interrupt handlers must be taken with the irqsave
+ * variants, otherwise a handler could spin on a lock held by the code it
+ * interrupted.
+ */
+typedef struct {
+    volatile uint16_t owner; // ticket allowed to enter
+    volatile uint16_t next; // next ticket to hand out
+} spinlock_t;
+
+#define SPINLOCK_INIT {0, 0}
+
+static inline void spinlock__init(spinlock_t* lock) {
+    lock->owner = 0;
+    lock->next = 0;
+}
+
+static inline void spinlock__lock(spinlock_t* lock) {
+    uint16_t ticket = 1;
+    __asm__ __volatile__ ("lock xaddw %0, %1"
+            : "+r" (ticket), "+m" (lock->next) : : "memory");
+    while (lock->owner != ticket) {
+        cpu__pause();
+    }
+}
+
+/**
+ * @returns true if the lock was free and is now taken
+ */
+static inline bool spinlock__trylock(spinlock_t* lock) {
+    uint16_t owner = lock->owner;
+    uint16_t previous;
+    // Only take a ticket if nobody holds or waits for the lock
+    __asm__ __volatile__ ("lock cmpxchgw %2, %1"
+            : "=a" (previous), "+m" (lock->next)
+            : "r" ((uint16_t) (owner + 1)), "0" (owner) : "memory");
+    return previous == owner;
+}
+
+static inline void spinlock__unlock(spinlock_t* lock) {
+    // Stores are not reordered with older loads and stores on x86: only
+    // the compiler has to be kept from moving the critical section
+    __asm__ __volatile__ ("" : : : "memory");
+    lock->owner = (uint16_t) (lock->owner + 1);
+}
+
+/**
+ * Disable interrupts, then take the lock
+ * @returns the flags to give to spinlock__unlock_irqrestore
+ */
+static inline uint32_t spinlock__lock_irqsave(spinlock_t* lock) {
+    uint32_t flags = cpu__irq_save();
+    spinlock__lock(lock);
+    return flags;
+}
+
+static inline void spinlock__unlock_irqrestore(spinlock_t* lock, uint32_t flags) {
+    spinlock__unlock(lock);
+    cpu__irq_restore(flags);
+}
+
+#endif
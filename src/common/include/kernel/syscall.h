@@ -0,0 +1,52 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * System calls. The number is passed in %eax, the arguments in %ebx, %esi
+ * and %edi, and the result is returned in %eax. The other registers are
+ * preserved.
+ *
+ * Two entry points:
+ * - int 0x80, always available
+ * - sysenter, when the CPU has it: %ecx must hold the user stack pointer
+ *   and %edx the address sysexit returns to
+ */
+#define SYS_NULL 0 // do nothing, to measure the entry cost
+#define SYS_EXIT 1 // terminate the calling thread
+#define SYS_WRITE 2 // write(buffer, size) on the console
+#define SYS_YIELD 3
+#define SYS_SLEEP 4 // sleep(ms)
+#define SYSCALLS_NUMBER 5
+
+/**
+ * Call the system call given by number
+ * @returns its result, -1 if number is not a system call
+ */
+int32_t syscall__dispatch(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+/**
+ * Install the int 0x80 gate handler, and the sysenter entry of the boot CPU
+ */
+void syscall__init(void);
+
+/**
+ * Install the sysenter entry of an application processor
+ */
+void syscall__init_ap(void);
+
+/**
+ * @returns true if user mode can enter the kernel with sysenter
+ */
+bool syscall__has_sysenter(void);
+
+/**
+ * Leave the kernel: run the current thread in user mode at entry, on the
+ * given user stack. Its kernel stack is used again by system calls and
+ * interrupts.
+ */
+void syscall__enter_user(uint32_t entry, uint32_t user_stack) __attribute__((noreturn));
+
+#endif
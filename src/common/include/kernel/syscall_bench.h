@@ -0,0 +1,12 @@
+#ifndef SYSCALL_BENCH_H
+#define SYSCALL_BENCH_H
+
+#include <stdint.h>
+
+/**
+ * Measure, from a user mode thread, the round-trip cost of a null system
+ * call through int 0x80 and through sysenter, and print the results
+ */
+void syscall_bench__run(uint32_t iterations);
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef THREAD_H
+#define THREAD_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/timer.h"
+
+#define THREAD_STACK_SIZE 8192
+
+typedef void (*thread_func_t)(void* data);
+
+typedef enum {
+    THREAD_READY,
+    THREAD_RUNNING,
+    THREAD_BLOCKED,
+    THREAD_WAKING, // being moved from blocked to a run queue
+    THREAD_DEAD
+} thread_state_t;
+
+/*
+ * A kernel thread, running in ring 0 on its own kernel stack
+ */
+typedef struct thread_struct {
+    uint32_t esp; // saved stack pointer, must stay first (see switch.S)
+    struct thread_struct* next; // next thread in the run queue
+    uint32_t id;
+    const char* name;
+    thread_state_t state;
+    uint8_t priority; // base priority, 0 is the highest
+    uint8_t boost; // temporary priority boost (see sched.h)
+    uint32_t cpu; // CPU whose run queue has the thread, or which ran it last
+    volatile bool on_cpu; // true until the thread is off its CPU
+    void* stack; // allocated kernel stack, NULL for the boot thread
+    uint32_t stack_bottom; // bounds of the kernel stack the thread runs on
+    uint32_t stack_top;
+    thread_func_t func;
+    void* data;
+    timer_t sleep_timer; // wakes the thread up from thread__sleep
+    volatile bool sleep_expired;
+    volatile bool* exited; // set by thread__exit if not NULL
+} thread_t;
+
+/**
+ * Allocate a kernel thread calling func(data), without starting it
+ * (see sched__enqueue)
+ * @returns the new thread, NULL if it could not be allocated
+ */
+thread_t* thread__alloc(const char* name, thread_func_t func, void* data);
+
+/**
+ * Free a dead thread and its stack
+ */
+void thread__free(thread_t* thread);
+
+/**
+ * Create a kernel thread calling func(data), and make it ready to run.
+ * The thread exits when func returns.
+ * @returns the new thread, NULL if it could not be allocated
+ */
+thread_t* thread__create(const char* name, thread_func_t func, void* data);
+
+/**
+ * Terminate the current thread
+ */
+void thread__exit(void) __attribute__((noreturn));
+
+/**
+ * Give the CPU to the next ready thread, if any
+ */
+void thread__yield(void);
+
+/**
+ * Sleep for at least the given duration, without using the CPU
+ */
+void thread__sleep(uint32_t ms);
+
+/**
+ * Make thread the kernel thread of the running context (the boot CPU on
+ * its bootstrap stack, or an application processor), running on the stack
+ * from stack_bottom to stack_top
+ */
+void thread__init_boot(thread_t* thread, const char* name, uint32_t stack_bottom, uint32_t stack_top);
+
+/**
+ * Make the kernel stack of thread the one the CPU switches to when it
+ * enters the kernel from user mode. Called before switching to thread.
+ */
+void thread__load_kernel_stack(thread_t* thread);
+
+/**
+ * Save the callee-saved registers on the current stack, store the stack
+ * pointer in *old_esp, and resume the context saved at new_esp.
+ * Interrupts must be disabled.
+ */
+void thread__switch(uint32_t* old_esp, uint32_t new_esp);
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*timer_callback_t)(void* data);
+
+/*
+ * A kernel timer. Timers are owned by their caller and must stay valid
+ * while they are pending. Deadlines are expressed in PIT ticks.
+ */
+typedef struct timer_struct {
+    struct timer_struct* next;
+    struct timer_struct** pprev; // previous next pointer, for O(1) removal
+    struct timer_struct** list; // head of the wheel slot the timer is in
+    uint32_t expires; // tick at which the callback is called
+    uint32_t period; // 0 for one-shot timers
+    timer_callback_t callback;
+    void* data;
+    bool pending;
+} timer_t;
+
+/**
+ * Initialize the timer wheel and hook it to the PIT interrupt.
+ * Must be called after pit__init.
+ */
+void timer__init(void);
+
+/**
+ * Initialize a timer, not pending. Must be called before the first
+ * timer__add or timer__add_periodic of a timer not zero-initialized.
+ */
+void timer__init_timer(timer_t* timer);
+
+/**
+ * Call callback(data) from the PIT interrupt once the tick counter reaches
+ * deadline. A pending timer is moved to the new deadline.
+ */
+void timer__add(timer_t* timer, uint32_t deadline, timer_callback_t callback, void* data);
+
+/**
+ * Call callback(data) from the PIT interrupt every period ticks
+ */
+void timer__add_periodic(timer_t* timer, uint32_t period, timer_callback_t callback, void* data);
+
+/**
+ * Stop a timer. Can be called from its own callback.
+ * @return true if the timer was pending
+ */
+bool timer__cancel(timer_t* timer);
+
+/**
+ * @return the current tick
+ */
+uint32_t timer__now(void);
+
+/**
+ * @return the number of ticks in ms milliseconds, rounded up, at most
+ * INT32_MAX (deadlines are compared modulo 2^32)
+ */
+uint32_t timer__ms_to_ticks(uint32_t ms);
+
+#endif
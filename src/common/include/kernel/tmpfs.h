@@ -0,0 +1,12 @@
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include "kernel/vfs.h"
+
+/**
+ * Writable filesystem in memory, empty when mounted. The mount source is
+ * ignored.
+ */
+extern const filesystem_t tmpfs__filesystem;
+
+#endif
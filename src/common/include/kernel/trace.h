@@ -0,0 +1,63 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define TRACE_RING_SIZE 4096 // records kept per CPU, the oldest are overwritten
+
+typedef enum {
+    TRACE_KMEM_ALLOC, // size, address
+    TRACE_KMEM_FREE, // address
+    TRACE_PMM_ALLOC_FRAME, // frame
+    TRACE_HEAP_EXTEND, // requested end, new end
+    TRACE_IRQ_ENTRY, // vector, interrupted eip
+    TRACE_IRQ_EXIT, // vector
+    TRACE_PAGE_FAULT, // address, eip, error code
+    TRACE_EVENTS
+} trace_event_t;
+
+#define TRACE_ALL ((1U << TRACE_EVENTS) - 1)
+
+/*
+ * Fixed-size binary record of a tracepoint
+ */
+typedef struct {
+    uint64_t timestamp; // TSC
+    uint32_t event;
+    uint32_t args[3];
+} trace_record_t;
+
+// Events being recorded, one bit per trace_event_t
+extern volatile uint32_t trace__mask;
+
+/**
+ * Record an event with up to three arguments, if it is enabled. A disabled
+ * tracepoint costs a load and a not-taken branch.
+ */
+#define TRACE(event, arg0, arg1, arg2) \
+    do { \
+        if (__builtin_expect((trace__mask & (1U << (event))) != 0, 0)) { \
+            trace__record((event), (uint32_t) (arg0), (uint32_t) (arg1), (uint32_t) (arg2)); \
+        } \
+    } while (0)
+
+void trace__record(trace_event_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2);
+
+/**
+ * Empty the buffers and record the events of mask (e.g. TRACE_ALL)
+ * @returns 0, -1 if the buffers could not be allocated
+ */
+int trace__start(uint32_t mask);
+
+void trace__stop(void);
+
+/**
+ * Send the records over the serial port, oldest first, one line per record:
+ *   trace <cpu> <timestamp> <event> <arg0> <arg1> <arg2>
+ * The header gives the TSC frequency to turn timestamps into times.
+ * Tracing must be stopped.
+ */
+void trace__dump(void);
+
+#endif
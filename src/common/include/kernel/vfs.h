@@ -0,0 +1,180 @@
+#ifndef VFS_H
+#define VFS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define VFS_NAME_MAX 60 // longest path component
+#define VFS_PATH_MAX 256
+#define VFS_MOUNTS_MAX 8
+#define VFS_FILES_MAX 64 // open files
+#define VFS_INODE_CACHE_SIZE 128 // inodes kept once no longer used
+#define VFS_DENTRY_CACHE_SIZE 256
+
+// vfs__open flags
+#define VFS_O_READ 0x1
+#define VFS_O_WRITE 0x2
+#define VFS_O_CREATE 0x4 // create the file if it does not exist
+
+typedef enum {
+    VNODE_FILE,
+    VNODE_DIRECTORY
+} vnode_type_t;
+
+typedef struct vnode_struct vnode_t;
+typedef struct mount_struct mount_t;
+
+/*
+ * Operations of the vnodes of a filesystem. The write operations are NULL
+ * on read-only filesystems. Called with the VFS lock held.
+ */
+typedef struct {
+    /**
+     * Find the entry name (length bytes, not terminated) of dir
+     * @returns 0 and its inode number in *ino, -1 if there is none
+     */
+    int (*lookup)(vnode_t* dir, const char* name, size_t length, uint32_t* ino);
+
+    /**
+     * @returns the number of bytes read, 0 at the end of the file
+     */
+    int32_t (*read)(vnode_t* vnode, uint32_t offset, void* buffer, uint32_t size);
+
+    /**
+     * Write and update vnode->size
+     * @returns the number of bytes written, -1 on error
+     */
+    int32_t (*write)(vnode_t* vnode, uint32_t offset, const void* buffer, uint32_t size);
+
+    /**
+     * Copy the terminated name of the index-th entry of dir in name
+     * @returns 0, -1 if there is no such entry
+     */
+    int (*readdir)(vnode_t* dir, uint32_t index, char* name, size_t size);
+
+    /**
+     * Create the entry name in dir
+     * @returns 0 and its inode number in *ino, -1 on error
+     */
+    int (*create)(vnode_t* dir, const char* name, size_t length, vnode_type_t type, uint32_t* ino);
+
+    /**
+     * Remove the entry name of dir, which is not in use
+     * @returns 0, -1 on error (e.g. non empty directory)
+     */
+    int (*unlink)(vnode_t* dir, const char* name, size_t length);
+
+    /**
+     * Set the size of the file, dropping its data past size or extending
+     * it with zeros, and update vnode->size
+     * @returns 0, -1 on error
+     */
+    int (*truncate)(vnode_t* vnode, uint32_t size);
+} vnode_ops_t;
+
+typedef struct {
+    const char* name;
+
+    /**
+     * Set root_ino and data of a new mount of the filesystem
+     * @returns 0, -1 on error
+     */
+    int (*mount)(mount_t* mount, void* source);
+
+    /**
+     * Fill type, size, ops and data of vnode from vnode->ino
+     * @returns 0, -1 if the inode does not exist
+     */
+    int (*read_inode)(vnode_t* vnode);
+
+    /**
+     * Release data of a vnode leaving the inode cache, can be NULL
+     */
+    void (*evict_inode)(vnode_t* vnode);
+} filesystem_t;
+
+struct mount_struct {
+    bool used;
+    char path[VFS_PATH_MAX];
+    const filesystem_t* fs;
+    uint32_t root_ino;
+    void* data; // private to the filesystem
+    // Directory the filesystem covers, parent is NULL for the root
+    mount_t* parent;
+    uint32_t covered_ino;
+};
+
+/*
+ * An inode of a mounted filesystem, in the inode cache
+ */
+struct vnode_struct {
+    mount_t* mount;
+    uint32_t ino;
+    vnode_type_t type;
+    uint32_t size;
+    const vnode_ops_t* ops;
+    void* data; // private to the filesystem
+    uint32_t refs; // open files and path walks using it
+    struct vnode_struct* hash_next;
+    // Unused inodes, least recently used first
+    struct vnode_struct* lru_prev;
+    struct vnode_struct* lru_next;
+};
+
+void vfs__init(void);
+
+/**
+ * Mount fs on the directory at path. The first mount must be the root,
+ * "/".
+ * @returns 0, -1 on error
+ */
+int vfs__mount(const char* path, const filesystem_t* fs, void* source);
+
+/**
+ * Open the file or directory at path (absolute)
+ * @returns the file descriptor, -1 on error
+ */
+int vfs__open(const char* path, uint32_t flags);
+
+/**
+ * Read from the offset of fd, and move it
+ * @returns the number of bytes read, 0 at the end of the file, -1 on error
+ */
+int32_t vfs__read(int fd, void* buffer, uint32_t size);
+
+/**
+ * Write at the offset of fd, and move it
+ * @returns the number of bytes written, -1 on error
+ */
+int32_t vfs__write(int fd, const void* buffer, uint32_t size);
+
+int vfs__seek(int fd, uint32_t offset);
+
+/**
+ * Set the size of the file fd, open for writing
+ * @returns 0, -1 on error
+ */
+int vfs__truncate(int fd, uint32_t size);
+
+/**
+ * Copy the name of the index-th entry of the directory fd
+ * @returns 0, -1 if there is no such entry
+ */
+int vfs__readdir(int fd, uint32_t index, char* name, size_t size);
+
+int vfs__close(int fd);
+
+int vfs__mkdir(const char* path);
+
+/**
+ * Remove the file or empty directory at path, if it is not open
+ */
+int vfs__unlink(const char* path);
+
+/**
+ * Print the hit rates of the dentry and inode caches
+ */
+void vfs__dump_stats(void);
+
+#endif
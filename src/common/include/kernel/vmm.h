@@ -1,7 +1,92 @@
 #ifndef VMM_H
 #define VMM_H
 
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define PAGE_SIZE 4096
+
+// Page table entry flags
+#define PAGE_PRESENT 0x1
+#define PAGE_WRITABLE 0x2
+#define PAGE_USER 0x4
+#define PAGE_WRITE_THROUGH 0x8
+#define PAGE_CACHE_DISABLE 0x10
+
+typedef struct vmm_region_struct vmm_region_t;
+
+/**
+ * Map the page containing addr, which is not present, in region
+ * @returns false if the access is invalid
+ */
+typedef bool (*vmm_fault_t)(vmm_region_t* region, uint32_t addr, bool write);
+
+/*
+ * A range of user addresses whose pages are mapped on demand, by the
+ * page fault handler
+ */
+struct vmm_region_struct {
+    uint32_t start; // page aligned
+    uint32_t end; // page aligned, excluded
+    vmm_fault_t fault;
+    void* data;
+    struct vmm_region_struct* next;
+};
+
 void vmm__init(void);
 void* vmm__heap_extend(void*);
 
+/**
+ * Map the page at virt to the physical frame phys
+ */
+void vmm__map_page(void* virt, uint32_t phys, uint32_t flags);
+
+/**
+ * Unmap the page at virt, without freeing its frame
+ * @returns the physical frame it was mapped to, 0 if it was not mapped
+ */
+uint32_t vmm__unmap_page(void* virt);
+
+/**
+ * @returns the physical address virt is mapped to, 0 if it is not mapped
+ */
+uint32_t vmm__get_physical(const void* virt);
+
+/**
+ * The physical memory below the kernel heap base (256 MiB) is mapped at
+ * KERNEL_OFFSET, so that the kernel can reach any frame of it without
+ * mapping it
+ * @returns the address of phys in the direct map, NULL if it is above
+ */
+void* vmm__direct(uint32_t phys);
+
+/**
+ * Check a buffer given by user mode, before the kernel touches it
+ * @returns true if every page of it is a user page, mapped or in a demand
+ * paged region, so that accessing it does not fault in kernel mode
+ */
+bool vmm__is_user_range(uint32_t start, uint32_t size);
+
+/**
+ * Register a demand paged region
+ * @returns 0 if success, -1 if it overlaps another region
+ */
+int vmm__add_region(vmm_region_t* region);
+
+void vmm__remove_region(vmm_region_t* region);
+
+/**
+ * Map size bytes of physical memory starting at phys (ACPI tables, memory
+ * mapped registers...) in the kernel MMIO window.
+ * @returns the virtual address corresponding to phys
+ */
+void* vmm__map_physical(uint32_t phys, size_t size, uint32_t flags);
+
+/**
+ * Map (or unmap) the first 4 MiB of physical memory at the same virtual
+ * addresses, for the application processors starting in real mode
+ */
+void vmm__identity_map_low(bool enable);
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef WAITQUEUE_H
+#define WAITQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/thread.h"
+#include "kernel/spinlock.h"
+
+/*
+ * A thread waiting in a wait queue. Waiters live on the stack of their
+ * thread.
+ */
+typedef struct waiter_struct {
+    struct waiter_struct* next;
+    thread_t* thread;
+    bool queued;
+} waiter_t;
+
+/*
+ * Threads sleeping until an event occurs. The event is usually signaled
+ * by an IRQ bottom half or another thread, which wakes the waiters up.
+ */
+typedef struct {
+    spinlock_t lock;
+    waiter_t* head;
+    waiter_t* tail;
+} waitqueue_t;
+
+#define WAITQUEUE_INIT {SPINLOCK_INIT, NULL, NULL}
+
+/**
+ * Sleep until condition is true. The condition is checked after the
+ * thread is queued, so a wake up between the check and the sleep is not
+ * lost.
+ */
+#define WAITQUEUE_WAIT(wq, condition) \
+    do { \
+        waiter_t __waiter = {NULL, NULL, false}; \
+        for (;;) { \
+            waitqueue__prepare((wq), &__waiter); \
+            if (condition) { \
+                break; \
+            } \
+            sched__block(); \
+        } \
+        waitqueue__finish((wq), &__waiter); \
+    } while (0)
+
+void waitqueue__init(waitqueue_t* wq);
+
+/**
+ * Queue the current thread in wq (if not already) and mark it blocked:
+ * the next sched__block call sleeps until the thread is woken up
+ */
+void waitqueue__prepare(waitqueue_t* wq, waiter_t* waiter);
+
+/**
+ * Remove the current thread from wq, and keep it running
+ */
+void waitqueue__finish(waitqueue_t* wq, waiter_t* waiter);
+
+/**
+ * Wake up the thread waiting for the longest time.
+ * Safe to call from interrupt handlers.
+ * @returns true if a thread was woken up
+ */
+bool waitqueue__wake_one(waitqueue_t* wq);
+
+/**
+ * Wake up every waiting thread. Safe to call from interrupt handlers.
+ * @returns the number of threads woken up
+ */
+size_t waitqueue__wake_all(waitqueue_t* wq);
+
+#endif
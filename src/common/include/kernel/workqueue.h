@@ -0,0 +1,54 @@
+#ifndef WORKQUEUE_H
+#define WORKQUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*work_func_t)(void* data);
+
+/*
+ * A deferred work item. Work items are owned by their caller (usually a
+ * driver) and must stay valid while they are pending.
+ */
+typedef struct work_struct {
+    struct work_struct* next; // next pending work item
+    struct work_struct* all_next; // next known work item (for statistics)
+    const char* name;
+    work_func_t func;
+    void* data;
+    bool pending;
+    uint64_t queued_at; // tsc value when the work item was scheduled
+    // Latency statistics, in cycles
+    uint32_t runs;
+    uint64_t total_wait;
+    uint64_t max_wait;
+} work_t;
+
+/**
+ * Initialize a work item which will call func(data) when run
+ */
+void workqueue__init_work(work_t* work, const char* name, work_func_t func, void* data);
+
+/**
+ * Queue a work item. Safe to call from interrupt handlers.
+ * @return false if the work item was already pending, true otherwise
+ */
+bool workqueue__schedule(work_t* work);
+
+/**
+ * Run every pending work item with interrupts enabled.
+ * Called after the EOI of each IRQ and from the idle loop.
+ */
+void workqueue__run(void);
+
+/**
+ * @return true if some work items are waiting to be run
+ */
+bool workqueue__pending(void);
+
+/**
+ * Print the latency statistics of every known work item
+ */
+void workqueue__dump_stats(void);
+
+#endif
@@ -6,9 +6,11 @@
 #include <stddef.h>
 
 
+#define BITSET_WORDS(size) (((size) + 31) / 32)
+
 typedef struct {
     uint32_t* set;
-    size_t size;
+    size_t size; // number of bits
 } bitset_t;
 
 /**
@@ -41,12 +43,26 @@ int bitset__test(size_t index, bitset_t* bitset);
 int bitset__set_first_clear(bitset_t* bitset);
 
 /**
- * @return a new allocated bitset of given size
+ * Find the first set bit in the given bitset, scanning a word at a time
+ * @return
+ *  the index of the first set bit
+ *  -1 if every bit is clear
+ */
+int bitset__find_first_set(bitset_t* bitset);
+
+/**
+ * Initialize a bitset of given size (in bits) using the given storage
+ * (BITSET_WORDS(size) words). Every bit is cleared.
+ */
+void bitset__init(bitset_t* bitset, uint32_t* set, size_t size);
+
+/**
+ * @return a new allocated bitset of given size (in bits)
  */
 bitset_t* bitset__new(size_t size);
 
 /**
- * @return the size of the given bitset
+ * @return the size of the given bitset, in bits
  */
 size_t bitset__size(bitset_t* bitset);
 
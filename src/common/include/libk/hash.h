@@ -0,0 +1,15 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define FNV_OFFSET_BASIS 2166136261u
+
+/**
+ * 32-bit FNV-1a hash of size bytes. Hashes can be chained by giving the
+ * result as the seed of the next call, starting with FNV_OFFSET_BASIS.
+ */
+uint32_t hash__fnv1a(uint32_t seed, const void* data, size_t size);
+
+#endif
@@ -6,5 +6,6 @@
 size_t strlen(const char* str);
 void* memmove(void* destination, const void* source, size_t num);
 void* memset(void* ptr, int value, size_t num);
+int memcmp(const void* ptr1, const void* ptr2, size_t num);
 
 #endif
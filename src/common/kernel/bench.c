@@ -0,0 +1,119 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/bench.h"
+#include "kernel/cpu.h"
+#include "drivers/serial.h"
+#include "libk/stdio.h"
+#include "libk/string.h"
+
+#define CPUID_EXT_MAX_LEAF 0x80000000
+#define CPUID_EXT_FEATURES 0x80000001
+
+static void empty(void);
+static bool matches(const char* name, const char* prefix);
+static void sort(uint32_t* values, size_t count);
+static uint32_t time_run(const bench_t* bench);
+static void measure(const bench_t* bench);
+
+// Defined by the linker script, around the .bench section
+extern const bench_t __bench_start[];
+extern const bench_t __bench_end[];
+
+static uint32_t samples[BENCH_RUNS];
+static bool has_rdtscp;
+// Minimum cost of the timing, measured on an empty run
+static uint32_t overhead;
+
+static void empty() {
+}
+
+static bool matches(const char* name, const char* prefix) {
+    if (prefix == NULL) {
+        return true;
+    }
+    size_t length = strlen(prefix);
+    return strlen(name) >= length && memcmp(name, prefix, length) == 0;
+}
+
+/**
+ * Shell sort, in place
+ */
+static void sort(uint32_t* values, size_t count) {
+    for (size_t gap = count / 2; gap > 0; gap /= 2) {
+        for (size_t i = gap; i < count; i++) {
+            uint32_t value = values[i];
+            size_t j = i;
+            while (j >= gap && values[j - gap] > value) {
+                values[j] = values[j - gap];
+                j -= gap;
+            }
+            values[j] = value;
+        }
+    }
+}
+
+/**
+ * @returns the cycles taken by a single run of bench, timing overhead
+ * included
+ */
+static uint32_t time_run(const bench_t* bench) {
+    if (bench->setup != NULL) {
+        bench->setup();
+    }
+    uint32_t flags = cpu__irq_save();
+    uint64_t start = cpu__rdtsc_begin();
+    bench->run();
+    uint64_t end = has_rdtscp ? cpu__rdtscp_end() : cpu__rdtsc_begin();
+    cpu__irq_restore(flags);
+    if (bench->cleanup != NULL) {
+        bench->cleanup();
+    }
+    return (uint32_t) (end - start);
+}
+
+static void measure(const bench_t* bench) {
+    for (uint32_t i = 0; i < BENCH_WARMUP_RUNS; i++) {
+        time_run(bench);
+    }
+    for (uint32_t i = 0; i < BENCH_RUNS; i++) {
+        uint32_t cycles = time_run(bench);
+        samples[i] = (cycles > overhead) ? cycles - overhead : 0;
+    }
+    sort(samples, BENCH_RUNS);
+
+    char line[96];
+    snprintf(line, sizeof(line), "bench %s min=%u median=%u p99=%u\n", bench->name,
+            samples[0], samples[BENCH_RUNS / 2], samples[BENCH_RUNS * 99 / 100]);
+    serial__writestring(line);
+}
+
+uint32_t bench__run(const char* prefix) {
+    uint32_t eax, ebx, ecx, edx;
+    cpu__cpuid(CPUID_EXT_MAX_LEAF, &eax, &ebx, &ecx, &edx);
+    has_rdtscp = false;
+    if (eax >= CPUID_EXT_FEATURES) {
+        cpu__cpuid(CPUID_EXT_FEATURES, &eax, &ebx, &ecx, &edx);
+        has_rdtscp = (edx & CPUID_EXT_FEAT_EDX_RDTSCP) != 0;
+    }
+
+    // Calibrate the timing overhead
+    static const bench_t calibration = {"empty", NULL, empty, NULL};
+    overhead = UINT32_MAX;
+    for (uint32_t i = 0; i < BENCH_WARMUP_RUNS + BENCH_RUNS; i++) {
+        uint32_t cycles = time_run(&calibration);
+        if (cycles < overhead) {
+            overhead = cycles;
+        }
+    }
+
+    uint32_t count = 0;
+    for (const bench_t* bench = __bench_start; bench < __bench_end; bench++) {
+        if (matches(bench->name, prefix)) {
+            measure(bench);
+            count++;
+        }
+    }
+    return count;
+}
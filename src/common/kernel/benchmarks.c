@@ -0,0 +1,101 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdarg.h>
+
+#include "kernel/bench.h"
+#include "kernel/kmem.h"
+#include "kernel/pmm.h"
+#include "drivers/vga.h"
+#include "libk/stdio.h"
+#include "libk/string.h"
+
+/*
+ * Benchmarks of the basic kernel services, see bench.h
+ */
+
+#define SMALL_SIZE 64
+#define PAGE_BYTES 4096
+
+static void alloc_small(void);
+static void alloc_page(void);
+static void free_block(void);
+static void free_frame(void);
+static void erase_char(void);
+static void format(char* buffer, size_t size, const char* str, ...);
+
+static void* block;
+static uint32_t frame;
+static char source[PAGE_BYTES];
+static char destination[PAGE_BYTES];
+
+static void alloc_small() {
+    block = kmem__alloc(SMALL_SIZE, 0);
+}
+
+static void alloc_page() {
+    block = kmem__alloc(PAGE_BYTES, 0);
+}
+
+static void free_block() {
+    kmem__free(block);
+}
+
+static void free_frame() {
+    pmm__free_frame(frame);
+}
+
+static void erase_char() {
+    vga__putchar('\b');
+}
+
+static void format(char* buffer, size_t size, const char* str, ...) {
+    va_list ap;
+    va_start(ap, str);
+    vsnprintf(buffer, size, str, ap);
+    va_end(ap);
+}
+
+BENCH_FIXTURE(kmem_alloc_64, NULL, free_block) {
+    block = kmem__alloc(SMALL_SIZE, 0);
+}
+
+BENCH_FIXTURE(kmem_free_64, alloc_small, NULL) {
+    kmem__free(block);
+}
+
+BENCH_FIXTURE(kmem_alloc_4096, NULL, free_block) {
+    block = kmem__alloc(PAGE_BYTES, 0);
+}
+
+BENCH_FIXTURE(kmem_free_4096, alloc_page, NULL) {
+    kmem__free(block);
+}
+
+BENCH_FIXTURE(pmm_alloc_frame, NULL, free_frame) {
+    frame = pmm__alloc_frame();
+}
+
+BENCH(memmove_64) {
+    memmove(destination, source, SMALL_SIZE);
+}
+
+BENCH(memmove_4096) {
+    memmove(destination, source, PAGE_BYTES);
+}
+
+BENCH(memset_64) {
+    memset(destination, 0, SMALL_SIZE);
+}
+
+BENCH(memset_4096) {
+    memset(destination, 0, PAGE_BYTES);
+}
+
+BENCH(vsnprintf) {
+    format(destination, sizeof(destination), "%s: %u, %d, 0x%x", "bench", 4096U, -42, 0xC0100000U);
+}
+
+// The character is erased after each run, to keep the screen unchanged
+BENCH_FIXTURE(vga_putchar, NULL, erase_char) {
+    vga__putchar('x');
+}
@@ -0,0 +1,98 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/block.h"
+#include "kernel/spinlock.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+static block_device_t* devices[BLOCK_DEVICES_MAX];
+static volatile size_t devices_count;
+static spinlock_t devices_lock = SPINLOCK_INIT;
+
+int block__register(block_device_t* device) {
+    uint32_t flags = spinlock__lock_irqsave(&devices_lock);
+    if (devices_count == BLOCK_DEVICES_MAX) {
+        spinlock__unlock_irqrestore(&devices_lock, flags);
+        debug("block: too many devices, %s ignored", device->name);
+        return -1;
+    }
+    devices[devices_count] = device;
+    devices_count++;
+    spinlock__unlock_irqrestore(&devices_lock, flags);
+    debug("block: %s, %u blocks of %u bytes", device->name, device->blocks, device->block_size);
+    return 0;
+}
+
+size_t block__count() {
+    return devices_count;
+}
+
+block_device_t* block__get(size_t index) {
+    return (index < devices_count) ? devices[index] : NULL;
+}
+
+block_device_t* block__find(const char* name) {
+    // Registered devices never change: no lock needed to read them
+    for (size_t i = 0; i < devices_count; i++) {
+        if (strlen(devices[i]->name) == strlen(name)
+                && memcmp(devices[i]->name, name, strlen(name)) == 0) {
+            return devices[i];
+        }
+    }
+    return NULL;
+}
+
+int block__read(block_device_t* device, uint32_t block, uint32_t count, void* buffer) {
+    if (block >= device->blocks || count > device->blocks - block) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return device->read(device, block, count, buffer);
+}
+
+int block__write(block_device_t* device, uint32_t block, uint32_t count, const void* buffer) {
+    if (block >= device->blocks || count > device->blocks - block || device->write == NULL) {
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+    return device->write(device, block, count, buffer);
+}
+
+int block__submit(block_device_t* device, block_request_t* requests, size_t count) {
+    int result = 0;
+    // Out of range requests fail on their own, the others still go
+    // to the driver
+    for (size_t i = 0; i < count; i++) {
+        block_request_t* request = &requests[i];
+        request->result = 0;
+        if (request->block >= device->blocks || request->count > device->blocks - request->block
+                || (request->write && device->write == NULL)) {
+            request->result = -1;
+            result = -1;
+        }
+    }
+    if (device->submit != NULL) {
+        if (device->submit(device, requests, count) != 0) {
+            result = -1;
+        }
+        return result;
+    }
+    for (size_t i = 0; i < count; i++) {
+        block_request_t* request = &requests[i];
+        if (request->result != 0 || request->count == 0) {
+            continue;
+        }
+        request->result = request->write
+            ? device->write(device, request->block, request->count, request->buffer)
+            : device->read(device, request->block, request->count, request->buffer);
+        if (request->result != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,53 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/cmdline.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+#define KERNEL_OFFSET 0xC0000000
+// The first 4 MiB are always mapped at KERNEL_OFFSET
+#define LOW_MEMORY_END 0x400000
+
+static char cmdline[CMDLINE_SIZE];
+
+void cmdline__init(multiboot_info_t* mbi) {
+    if (!(mbi->flags & MULTIBOOT_INFO_CMDLINE) || mbi->cmdline == 0 || mbi->cmdline >= LOW_MEMORY_END) {
+        return;
+    }
+    const char* source = (const char*) (mbi->cmdline + KERNEL_OFFSET);
+    size_t length = strlen(source);
+    if (length >= CMDLINE_SIZE) {
+        length = CMDLINE_SIZE - 1;
+    }
+    memmove(cmdline, source, length);
+    cmdline[length] = '\0';
+    debug("Command line \"%s\"", cmdline);
+}
+
+int cmdline__get(const char* option, char* value, size_t size) {
+    size_t option_length = strlen(option);
+    const char* word = cmdline;
+    while (*word != '\0') {
+        size_t length = 0;
+        while (word[length] != '\0' && word[length] != ' ') {
+            length++;
+        }
+        if (length >= option_length && memcmp(word, option, option_length) == 0
+                && (length == option_length || word[option_length] == '=')) {
+            const char* start = word + option_length + (length > option_length ? 1 : 0);
+            size_t value_length = (size_t) (word + length - start);
+            if (value_length >= size) {
+                value_length = size - 1;
+            }
+            memmove(value, start, value_length);
+            value[value_length] = '\0';
+            return 0;
+        }
+        word += length;
+        while (*word == ' ') {
+            word++;
+        }
+    }
+    return -1;
+}
@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/elf.h"
+#include "kernel/vmm.h"
+#include "kernel/pmm.h"
+#include "kernel/kmem.h"
+#include "kernel/syscall.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+#define PAGE_MASK (~(uint32_t) (PAGE_SIZE - 1))
+
+/*
+ * A demand paged segment of a program (or its stack, which has no file
+ * content)
+ */
+typedef struct {
+    vmm_region_t region;
+    uint32_t vaddr;
+    uint32_t filesz;
+    uint32_t memsz;
+    const char* file; // content, in the kernel mapping of the module
+    uint32_t file_phys; // physical address of the content
+    bool writable;
+} segment_t;
+
+/*
+ * A loaded program. There is a single user address space: programs stay
+ * loaded, and programs whose segments overlap can not be loaded together.
+ */
+typedef struct {
+    uint32_t entry;
+    size_t segments_count; // PT_LOAD segments, then the stack
+    segment_t* segments;
+} program_t;
+
+static bool segment_fault(vmm_region_t* region, uint32_t addr, bool write);
+static bool check_header(const elf32_header_t* header, size_t size);
+static bool init_segment(segment_t* segment, const elf32_program_header_t* phdr,
+        const module_t* module);
+static void program_thread(void* data);
+
+static bool segment_fault(vmm_region_t* region, uint32_t addr, bool write) {
+    segment_t* segment = region->data;
+    if (write && !segment->writable) {
+        return false;
+    }
+    uint32_t page = addr & PAGE_MASK;
+    uint32_t flags = PAGE_USER | (segment->writable ? PAGE_WRITABLE : 0);
+    uint32_t file_end = segment->vaddr + segment->filesz;
+
+    // A read-only page holding only file content (no bss) is the frame of
+    // the module itself, if the file offsets are page aligned like the
+    // addresses
+    if (!segment->writable && segment->filesz > 0
+            && (segment->file_phys - segment->vaddr) % PAGE_SIZE == 0
+            && (page + PAGE_SIZE <= file_end || segment->filesz == segment->memsz)) {
+        vmm__map_page((void*) page, segment->file_phys + (page - segment->vaddr), flags);
+        return true;
+    }
+
+    // Otherwise the page gets its own frame: the file content, then zeros.
+    // It is only writable by the kernel while it is filled.
+    uint32_t frame = pmm__alloc_frame();
+    vmm__map_page((void*) page, frame, PAGE_WRITABLE);
+    memset((void*) page, 0, PAGE_SIZE);
+    uint32_t start = (page > segment->vaddr) ? page : segment->vaddr;
+    uint32_t end = (page + PAGE_SIZE < file_end) ? page + PAGE_SIZE : file_end;
+    if (start < end) {
+        memmove((void*) start, segment->file + (start - segment->vaddr), end - start);
+    }
+    vmm__map_page((void*) page, frame, flags);
+    return true;
+}
+
+static bool check_header(const elf32_header_t* header, size_t size) {
+    if (size < sizeof(elf32_header_t) || header->e_magic != ELF_MAGIC
+            || header->e_class != ELFCLASS32 || header->e_data != ELFDATA2LSB
+            || header->e_type != ET_EXEC || header->e_machine != EM_386) {
+        return false;
+    }
+    if (header->e_phentsize != sizeof(elf32_program_header_t) || header->e_phnum == 0) {
+        return false;
+    }
+    uint32_t table_size = (uint32_t) header->e_phnum * sizeof(elf32_program_header_t);
+    return header->e_phoff <= size && table_size <= size - header->e_phoff;
+}
+
+static bool init_segment(segment_t* segment, const elf32_program_header_t* phdr,
+        const module_t* module) {
+    if (phdr->p_offset > module->size || phdr->p_filesz > module->size - phdr->p_offset
+            || phdr->p_filesz > phdr->p_memsz || phdr->p_vaddr < PAGE_SIZE
+            || phdr->p_vaddr >= ELF_STACK_TOP - ELF_STACK_SIZE
+            || phdr->p_memsz > ELF_STACK_TOP - ELF_STACK_SIZE - phdr->p_vaddr) {
+        return false;
+    }
+    segment->vaddr = phdr->p_vaddr;
+    segment->filesz = phdr->p_filesz;
+    segment->memsz = phdr->p_memsz;
+    segment->file = (const char*) module->data + phdr->p_offset;
+    segment->file_phys = module->phys_start + phdr->p_offset;
+    segment->writable = (phdr->p_flags & PF_W) != 0;
+    segment->region.start = phdr->p_vaddr & PAGE_MASK;
+    segment->region.end = (phdr->p_vaddr + phdr->p_memsz + PAGE_SIZE - 1) & PAGE_MASK;
+    segment->region.fault = segment_fault;
+    segment->region.data = segment;
+    return true;
+}
+
+static void program_thread(void* data) {
+    program_t* program = data;
+    syscall__enter_user(program->entry, ELF_STACK_TOP);
+}
+
+thread_t* elf__exec(module_t* module) {
+    const char* image = module__data(module);
+    const elf32_header_t* header = (const elf32_header_t*) image;
+    if (!check_header(header, module->size)) {
+        debug("elf: \"%s\" is not an i386 executable", module->cmdline);
+        return NULL;
+    }
+    const elf32_program_header_t* phdrs = (const elf32_program_header_t*) (image + header->e_phoff);
+    size_t loads = 0;
+    for (size_t i = 0; i < header->e_phnum; i++) {
+        if (phdrs[i].p_type == PT_LOAD && phdrs[i].p_memsz > 0) {
+            loads++;
+        }
+    }
+
+    program_t* program = kmem__alloc(sizeof(program_t), 0);
+    if (program == NULL) {
+        return NULL;
+    }
+    program->entry = header->e_entry;
+    program->segments_count = 0;
+    program->segments = kmem__alloc(sizeof(segment_t) * (loads + 1), 0);
+    if (program->segments == NULL) {
+        kmem__free(program);
+        return NULL;
+    }
+
+    bool valid = true;
+    for (size_t i = 0; i < header->e_phnum && valid; i++) {
+        if (phdrs[i].p_type != PT_LOAD || phdrs[i].p_memsz == 0) {
+            continue;
+        }
+        valid = init_segment(&program->segments[program->segments_count++], &phdrs[i], module);
+    }
+
+    // The stack: no file content, zero filled on demand
+    if (valid) {
+        segment_t* stack = &program->segments[program->segments_count++];
+        stack->vaddr = ELF_STACK_TOP - ELF_STACK_SIZE;
+        stack->filesz = 0;
+        stack->memsz = ELF_STACK_SIZE;
+        stack->file = NULL;
+        stack->file_phys = 0;
+        stack->writable = true;
+        stack->region.start = stack->vaddr;
+        stack->region.end = ELF_STACK_TOP;
+        stack->region.fault = segment_fault;
+        stack->region.data = stack;
+    }
+
+    size_t added = 0;
+    while (valid && added < program->segments_count) {
+        valid = vmm__add_region(&program->segments[added].region) == 0;
+        if (valid) {
+            added++;
+        }
+    }
+
+    thread_t* thread = valid ? thread__create(module->cmdline, program_thread, program) : NULL;
+    if (thread == NULL) {
+        debug("elf: could not load \"%s\"", module->cmdline);
+        while (added > 0) {
+            vmm__remove_region(&program->segments[--added].region);
+        }
+        kmem__free(program->segments);
+        kmem__free(program);
+        return NULL;
+    }
+    debug("elf: \"%s\" started, entry 0x%x, %u segments", module->cmdline,
+            program->entry, program->segments_count - 1);
+    return thread;
+}
@@ -0,0 +1,46 @@
+#include <stdbool.h>
+
+#include "kernel/idle.h"
+#include "kernel/workqueue.h"
+#include "kernel/cpu.h"
+#include "kernel/sched.h"
+#include "kernel/percpu.h"
+#include "drivers/pit.h"
+
+static bool tickless = true;
+
+void idle__enter() {
+    // Run the work left by interrupt handlers before going to sleep
+    workqueue__run();
+
+    cpu__cli();
+    if (sched__need_resched() || sched__can_steal()) {
+        sched__schedule();
+        cpu__sti();
+        return;
+    }
+    if (workqueue__pending()) {
+        cpu__sti();
+        return;
+    }
+    // The PIT only interrupts the boot CPU, the others keep their local
+    // timer running
+    bool oneshot = tickless && percpu__id() == 0 && pit__tickless_enter();
+    // sti only takes effect after the next instruction: no interrupt can
+    // be lost between the checks above and hlt
+    __asm__ __volatile__ ("sti; hlt" : : : "memory");
+
+    cpu__cli();
+    if (oneshot) {
+        pit__tickless_exit();
+    }
+    // Threads woken up by the interrupt run right away
+    if (sched__need_resched()) {
+        sched__schedule();
+    }
+    cpu__sti();
+}
+
+void idle__set_tickless(bool enabled) {
+    tickless = enabled;
+}
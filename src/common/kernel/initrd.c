@@ -0,0 +1,363 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/initrd.h"
+#include "kernel/kmem.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+#include "libk/hash.h"
+
+#define TAR_BLOCK_SIZE 512
+#define TAR_REGULAR '0'
+#define TAR_REGULAR_OLD '\0'
+#define TAR_DIRECTORY '5'
+#define MIN_BUCKETS 16
+
+typedef struct {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6]; // "ustar"
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed)) tar_header_t;
+
+static uint32_t parse_octal(const char* field, size_t size);
+static size_t field_length(const char* field, size_t size);
+static bool check_header(const tar_header_t* header);
+static char* make_path(const tar_header_t* header);
+static size_t walk(const char* image, size_t size, uint32_t phys, initrd_file_t* out);
+static const char* normalize(const char* path, size_t* length);
+static bool in_directory(const char* path, const char* dir, size_t dir_length);
+static int fs_mount(mount_t* mount, void* source);
+static int fs_read_inode(vnode_t* vnode);
+static int fs_lookup(vnode_t* dir, const char* name, size_t length, uint32_t* ino);
+static int32_t fs_read(vnode_t* vnode, uint32_t offset, void* buffer, uint32_t size);
+static int fs_readdir(vnode_t* dir, uint32_t index, char* name, size_t size);
+
+// Inode 0 is the root, inode i + 1 is files[i]
+#define ROOT_INO 0
+
+static const vnode_ops_t fs_ops = {
+    .lookup = fs_lookup,
+    .read = fs_read,
+    .write = NULL,
+    .readdir = fs_readdir,
+    .create = NULL,
+    .unlink = NULL,
+    .truncate = NULL,
+};
+
+const filesystem_t initrd__filesystem = {
+    .name = "initrd",
+    .mount = fs_mount,
+    .read_inode = fs_read_inode,
+    .evict_inode = NULL,
+};
+
+static initrd_file_t* files;
+static size_t files_count;
+// Hash table of the files by path, built once
+static initrd_file_t** buckets;
+static uint32_t buckets_mask;
+
+static uint32_t parse_octal(const char* field, size_t size) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < size && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = value * 8 + (uint32_t) (field[i] - '0');
+    }
+    return value;
+}
+
+static size_t field_length(const char* field, size_t size) {
+    size_t length = 0;
+    while (length < size && field[length] != '\0') {
+        length++;
+    }
+    return length;
+}
+
+static bool check_header(const tar_header_t* header) {
+    if (memcmp(header->magic, "ustar", 5) != 0) {
+        return false;
+    }
+    // Sum of the header bytes, the checksum field counting as spaces
+    const uint8_t* bytes = (const uint8_t*) header;
+    uint32_t sum = 0;
+    for (size_t i = 0; i < TAR_BLOCK_SIZE; i++) {
+        bool in_checksum = i >= offsetof(tar_header_t, checksum)
+            && i < offsetof(tar_header_t, checksum) + sizeof(header->checksum);
+        sum += in_checksum ? ' ' : bytes[i];
+    }
+    return sum == parse_octal(header->checksum, sizeof(header->checksum));
+}
+
+/**
+ * Skip the leading "./" and '/', and the trailing '/' of path
+ */
+static const char* normalize(const char* path, size_t* length) {
+    for (;;) {
+        if (*length >= 2 && path[0] == '.' && path[1] == '/') {
+            path += 2;
+            *length -= 2;
+        }
+        else if (*length >= 1 && path[0] == '/') {
+            path++;
+            (*length)--;
+        }
+        else {
+            break;
+        }
+    }
+    while (*length > 0 && path[*length - 1] == '/') {
+        (*length)--;
+    }
+    return path;
+}
+
+/**
+ * @returns the normalized path of the header, prefix included, allocated
+ * with kmem__alloc. NULL for the root directory.
+ */
+static char* make_path(const tar_header_t* header) {
+    size_t prefix_length = field_length(header->prefix, sizeof(header->prefix));
+    size_t name_length = field_length(header->name, sizeof(header->name));
+    char full[sizeof(header->prefix) + 1 + sizeof(header->name)];
+    size_t length = 0;
+    if (prefix_length > 0) {
+        memmove(full, header->prefix, prefix_length);
+        full[prefix_length] = '/';
+        length = prefix_length + 1;
+    }
+    memmove(full + length, header->name, name_length);
+    length += name_length;
+
+    const char* normalized = normalize(full, &length);
+    if (length == 0) {
+        return NULL;
+    }
+    char* path = kmem__alloc((uint32_t) length + 1, 0);
+    if (path != NULL) {
+        memmove(path, normalized, length);
+        path[length] = '\0';
+    }
+    return path;
+}
+
+/**
+ * Walk the archive, filling out with its files if it is not NULL
+ * @returns the number of files
+ */
+static size_t walk(const char* image, size_t size, uint32_t phys, initrd_file_t* out) {
+    size_t count = 0;
+    size_t offset = 0;
+    while (offset + TAR_BLOCK_SIZE <= size) {
+        const tar_header_t* header = (const tar_header_t*) (image + offset);
+        if (header->name[0] == '\0' || !check_header(header)) {
+            // End of archive: zero blocks
+            break;
+        }
+        uint32_t file_size = parse_octal(header->size, sizeof(header->size));
+        size_t data_offset = offset + TAR_BLOCK_SIZE;
+        if (file_size > size - data_offset) {
+            debug("initrd: truncated archive");
+            break;
+        }
+        bool regular = header->typeflag == TAR_REGULAR || header->typeflag == TAR_REGULAR_OLD;
+        bool directory = header->typeflag == TAR_DIRECTORY;
+        if (regular || directory) {
+            char* path = (out != NULL) ? make_path(header) : NULL;
+            if (out == NULL || path != NULL) {
+                if (out != NULL) {
+                    initrd_file_t* file = &out[count];
+                    file->path = path;
+                    file->hash = hash__fnv1a(FNV_OFFSET_BASIS, path, strlen(path));
+                    file->data = image + data_offset;
+                    file->phys = phys + (uint32_t) data_offset;
+                    file->size = directory ? 0 : file_size;
+                    file->directory = directory;
+                    file->next = NULL;
+                }
+                count++;
+            }
+        }
+        offset = data_offset + (file_size + TAR_BLOCK_SIZE - 1) / TAR_BLOCK_SIZE * TAR_BLOCK_SIZE;
+    }
+    return count;
+}
+
+int initrd__init(module_t* module) {
+    const char* image = module__data(module);
+    if (module->size < TAR_BLOCK_SIZE || !check_header((const tar_header_t*) image)) {
+        debug("initrd: \"%s\" is not a ustar archive", module->cmdline);
+        return -1;
+    }
+
+    // The root directory is counted, but has no entry
+    size_t count = walk(image, module->size, module->phys_start, NULL);
+    files = kmem__alloc((uint32_t) (sizeof(initrd_file_t) * count), 0);
+    if (files == NULL) {
+        return -1;
+    }
+    files_count = walk(image, module->size, module->phys_start, files);
+
+    uint32_t buckets_count = MIN_BUCKETS;
+    while (buckets_count < files_count * 2) {
+        buckets_count *= 2;
+    }
+    buckets = kmem__alloc((uint32_t) (sizeof(initrd_file_t*) * buckets_count), 0);
+    if (buckets == NULL) {
+        kmem__free(files);
+        files = NULL;
+        files_count = 0;
+        return -1;
+    }
+    memset(buckets, 0, sizeof(initrd_file_t*) * buckets_count);
+    buckets_mask = buckets_count - 1;
+    for (size_t i = 0; i < files_count; i++) {
+        initrd_file_t** bucket = &buckets[files[i].hash & buckets_mask];
+        files[i].next = *bucket;
+        *bucket = &files[i];
+    }
+    debug("initrd: %u files, %u buckets", files_count, buckets_count);
+    return 0;
+}
+
+const initrd_file_t* initrd__lookup(const char* path) {
+    if (buckets == NULL) {
+        return NULL;
+    }
+    size_t length = strlen(path);
+    path = normalize(path, &length);
+    uint32_t hash = hash__fnv1a(FNV_OFFSET_BASIS, path, length);
+    for (initrd_file_t* file = buckets[hash & buckets_mask]; file != NULL; file = file->next) {
+        if (file->hash == hash && strlen(file->path) == length
+                && memcmp(file->path, path, length) == 0) {
+            return file;
+        }
+    }
+    return NULL;
+}
+
+size_t initrd__count() {
+    return files_count;
+}
+
+const initrd_file_t* initrd__get(size_t index) {
+    return (index < files_count) ? &files[index] : NULL;
+}
+
+/*
+ * Filesystem
+ */
+
+/**
+ * @returns true if path is an entry of the directory dir (dir_length
+ * bytes, empty for the root)
+ */
+static bool in_directory(const char* path, const char* dir, size_t dir_length) {
+    if (dir_length > 0) {
+        if (memcmp(path, dir, dir_length) != 0 || path[dir_length] != '/') {
+            return false;
+        }
+        path += dir_length + 1;
+    }
+    while (*path != '\0') {
+        if (*path++ == '/') {
+            return false;
+        }
+    }
+    return true;
+}
+
+static int fs_mount(mount_t* mount, void* source) {
+    (void) source;
+    mount->root_ino = ROOT_INO;
+    return 0;
+}
+
+static int fs_read_inode(vnode_t* vnode) {
+    vnode->ops = &fs_ops;
+    if (vnode->ino == ROOT_INO) {
+        vnode->type = VNODE_DIRECTORY;
+        vnode->size = 0;
+        vnode->data = NULL;
+        return 0;
+    }
+    if (vnode->ino > files_count) {
+        return -1;
+    }
+    initrd_file_t* file = &files[vnode->ino - 1];
+    vnode->type = file->directory ? VNODE_DIRECTORY : VNODE_FILE;
+    vnode->size = (uint32_t) file->size;
+    vnode->data = file;
+    return 0;
+}
+
+static int fs_lookup(vnode_t* dir, const char* name, size_t length, uint32_t* ino) {
+    const initrd_file_t* dir_file = dir->data;
+    size_t dir_length = (dir_file != NULL) ? strlen(dir_file->path) : 0;
+    char path[VFS_PATH_MAX];
+    if (dir_length + 1 + length >= VFS_PATH_MAX) {
+        return -1;
+    }
+    memmove(path, dir_file != NULL ? dir_file->path : "", dir_length);
+    size_t path_length = dir_length;
+    if (dir_length > 0) {
+        path[path_length++] = '/';
+    }
+    memmove(path + path_length, name, length);
+    path[path_length + length] = '\0';
+
+    const initrd_file_t* file = initrd__lookup(path);
+    if (file == NULL) {
+        return -1;
+    }
+    *ino = (uint32_t) (file - files) + 1;
+    return 0;
+}
+
+static int32_t fs_read(vnode_t* vnode, uint32_t offset, void* buffer, uint32_t size) {
+    const initrd_file_t* file = vnode->data;
+    if (offset >= file->size) {
+        return 0;
+    }
+    if (size > file->size - offset) {
+        size = (uint32_t) file->size - offset;
+    }
+    memmove(buffer, (const char*) file->data + offset, size);
+    return (int32_t) size;
+}
+
+static int fs_readdir(vnode_t* dir, uint32_t index, char* name, size_t size) {
+    const initrd_file_t* dir_file = dir->data;
+    const char* dir_path = (dir_file != NULL) ? dir_file->path : "";
+    size_t dir_length = strlen(dir_path);
+    for (size_t i = 0; i < files_count; i++) {
+        if (!in_directory(files[i].path, dir_path, dir_length)) {
+            continue;
+        }
+        if (index-- == 0) {
+            const char* entry = files[i].path + (dir_length > 0 ? dir_length + 1 : 0);
+            size_t length = strlen(entry);
+            if (length >= size) {
+                return -1;
+            }
+            memmove(name, entry, length + 1);
+            return 0;
+        }
+    }
+    return -1;
+}
@@ -12,7 +12,31 @@
 #include "kernel/pmm.h"
 #include "kernel/kmem.h"
 #include "libk/stdio.h"
+#include "libk/string.h"
 #include "kernel/vmm.h"
+#include "kernel/irq.h"
+#include "kernel/clock.h"
+#include "kernel/timer.h"
+#include "kernel/sched.h"
+#include "kernel/smp.h"
+#include "kernel/syscall.h"
+#include "kernel/syscall_bench.h"
+#include "kernel/module.h"
+#include "kernel/elf.h"
+#include "kernel/initrd.h"
+#include "kernel/vfs.h"
+#include "kernel/tmpfs.h"
+#include "kernel/block.h"
+#include "kernel/page_cache.h"
+#include "drivers/pci.h"
+#include "drivers/ide.h"
+#include "drivers/virtio_blk.h"
+#include "drivers/serial.h"
+#include "kernel/profiler.h"
+#include "kernel/trace.h"
+#include "kernel/bench.h"
+#include "kernel/cmdline.h"
+#include "drivers/debug_exit.h"
 
 /* Check if the compiler thinks you are targeting the wrong operating system. */
 #if defined(__linux__)
@@ -34,6 +58,9 @@ void kernel_main(multiboot_info_t* mbi) {
 
     /* Initialize stdio with vga primitives */
     stdio__init(vga__putchar, vga__writestring);
+
+    /* Serial port, for the profiles */
+    serial__init();
     
     /* Initialize bootstrap heap */
     kmem__bootstrap_init();
@@ -41,12 +68,24 @@ void kernel_main(multiboot_info_t* mbi) {
     /* Initialize Physical Memory Manager */
     // Translate mbi into its virtual address
     mbi = (multiboot_info_t*) ((char*) mbi + KERNEL_OFFSET);
+
+    /* Options given by the bootloader: console=serial sends the console
+     * output to the serial port, for headless runs */
+    cmdline__init(mbi);
+    char option[CMDLINE_SIZE];
+    if (cmdline__get("console", option, sizeof(option)) == 0 && memcmp(option, "serial", 7) == 0) {
+        stdio__init(serial__putchar, serial__writestring);
+    }
+
     if (mbi->flags & MULTIBOOT_INFO_MEM_MAP) {
         pmm__init((multiboot_memory_map_t*) ((char*) mbi->mmap_addr + KERNEL_OFFSET), mbi->mmap_length);
     }
     else {
         PANIC("No information about available memory.");
     }
+
+    /* Keep the frames of the bootloader modules */
+    module__init(mbi);
     
     /* Initialize the descriptor tables */
     descriptor_tables__init();
@@ -57,23 +96,137 @@ void kernel_main(multiboot_info_t* mbi) {
     /* Initialize real heap */
     kmem__init();  
 
+    /* Index the initial ramdisk */
+    module_t* initrd = module__find("initrd");
+    if (initrd != NULL) {
+        initrd__init(initrd);
+    }
+
+    /* Route the IRQs through the APIC when there is one */
+    irq__init();
+
     /* Initialize the PIT */
     pit__init(100);
+
+    /* Initialize the kernel timers */
+    timer__init();
+
+    /* Start the scheduler, kernel_main now runs in the "main" thread */
+    sched__init();
+
+    /* Let user mode enter the kernel */
+    syscall__init();
+
+    /* Build the file tree: tmpfs root, ramdisk under /initrd */
+    vfs__init();
+    if (vfs__mount("/", &tmpfs__filesystem, NULL) != 0) {
+        PANIC("Cannot mount the root filesystem.");
+    }
+    vfs__mkdir("/tmp");
+    vfs__mkdir("/initrd");
+    if (initrd != NULL) {
+        vfs__mount("/initrd", &initrd__filesystem, NULL);
+    }
+
+    /* Calibrate the high resolution clock */
+    clock__init();
+
+    /* Start the other CPUs */
+    smp__init();
     
     /* Initialize the keyboard */
     keyboard__init();
+
+    /* Find the disks */
+    pci__init();
+    ide__init();
+    virtio_blk__init();
+    page_cache__init();
+
+    /* bench[=prefix] only runs the benchmarks, and stops QEMU */
+    if (cmdline__get("bench", option, sizeof(option)) == 0) {
+        uint32_t count = bench__run((option[0] != '\0') ? option : NULL);
+        printf("bench: %u benchmarks run\n", count);
+        debug_exit__exit((count > 0) ? DEBUG_EXIT_SUCCESS : DEBUG_EXIT_FAILURE);
+    }
+
+    /* profile samples the rest of the boot, dumped on the serial port
+     * before running the user program */
+    bool profile = cmdline__get("profile", option, sizeof(option)) == 0;
+    if (profile && profiler__start(100, PROFILER_MAX_DEPTH) != 0) {
+        debug("Could not start the profiler");
+        profile = false;
+    }
     
 #if 1
-    /* Play a welcome frightening sound */
-    pc_speaker__play(340);
-    for (volatile int i = 0; i < 100000000; i++);
-    pc_speaker__stop();
-    for (volatile int i = 0; i < 100000000; i++);
-    pc_speaker__play(480);
-    for (volatile int i = 0; i < 100000000; i++);
-    pc_speaker__stop();
+    /* Play a welcome frightening sound while booting goes on */
+    static const uint32_t welcome_notes[] = {340, 0, 480};
+    static const uint32_t welcome_durations[] = {500, 500, 500};
+    pc_speaker__play_sequence(welcome_notes, welcome_durations, 3);
 #endif
     
+    /* syscall_bench compares the cost of the int 0x80 and sysenter system
+     * calls */
+    if (cmdline__get("syscall_bench", option, sizeof(option)) == 0) {
+        syscall_bench__run(10000);
+    }
+
+    /* trace records the file and disk accesses below, dumped on the
+     * serial port */
+    bool trace = cmdline__get("trace", option, sizeof(option)) == 0;
+    if (trace && trace__start(TRACE_ALL) != 0) {
+        debug("Could not start tracing");
+        trace = false;
+    }
+
+    /* Print the message of the day from the ramdisk */
+    int motd = vfs__open("/initrd/etc/motd", VFS_O_READ);
+    if (motd >= 0) {
+        char text[64];
+        int32_t count;
+        while ((count = vfs__read(motd, text, sizeof(text))) > 0) {
+            for (int32_t i = 0; i < count; i++) {
+                putchar(text[i]);
+            }
+        }
+        vfs__close(motd);
+    }
+    vfs__dump_stats();
+
+    /* Scan the start of the first disk twice: the second pass is served
+     * by the page cache */
+    block_device_t* disk = block__get(0);
+    if (disk != NULL) {
+        uint16_t* sector = kmem__alloc(disk->block_size, 0);
+        for (uint32_t pass = 0; pass < 2; pass++) {
+            for (uint32_t block = 0; block < 1024 && block < disk->blocks; block++) {
+                page_cache__read(disk, block, 1, sector);
+            }
+        }
+        if (page_cache__read(disk, 0, 1, sector) == 0) {
+            printf("%s: boot signature 0x%x\n", disk->name, sector[255]);
+        }
+        kmem__free(sector);
+        page_cache__dump_stats();
+    }
+
+    if (trace) {
+        trace__stop();
+        trace__dump();
+    }
+
+    if (profile) {
+        profiler__stop();
+        profiler__report(5);
+        profiler__dump();
+    }
+
+    /* Run the user program loaded next to the kernel */
+    module_t* hello = module__find("hello");
+    if (hello != NULL) {
+        elf__exec(hello);
+    }
+
     uint32_t* test = kmem__alloc(sizeof(uint32_t) * 10, 0);
     printf("test: 0x%x\n", test);
     for (size_t i = 0; i < 10; i++) {
@@ -81,11 +234,13 @@ void kernel_main(multiboot_info_t* mbi) {
         printf("test[%u] = %u\n", i, test[i]);
     }
     kmem__free(test);
-    
-    /* Infinite loop */
-    for(;;) {
-        __asm__ __volatile__ ("hlt");
-    };
 
-    PANIC("This should never happen...");
+    /* test checks that the whole boot goes without a panic, and stops QEMU */
+    if (cmdline__get("test", option, sizeof(option)) == 0) {
+        printf("test: boot ok\n");
+        debug_exit__exit(DEBUG_EXIT_SUCCESS);
+    }
+    
+    /* The idle thread takes over */
+    thread__exit();
 }
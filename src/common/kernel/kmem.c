@@ -5,6 +5,8 @@
 #include "kernel/vmm.h"
 #include "kernel/kmem.h"
 #include "kernel/utils.h"
+#include "kernel/spinlock.h"
+#include "kernel/trace.h"
 
 #define MAX_HEAP_SIZE 0x10000000 // 256 MiB
 #define MIN_HEAP_BLOCK_PAYLOAD_SIZE 16 // 16o
@@ -28,6 +30,7 @@ static void dump_heap_block(heap_block_t* block);
 static uint32_t bootstrap_heap;
 static uint32_t bootstrap_heap_available;
 
+static spinlock_t heap_lock = SPINLOCK_INIT;
 static bool heap_initialized;
 static void* heap_end;
 static void* heap_start;
@@ -54,19 +57,27 @@ void kmem__init() {
 }
 
 void* kmem__alloc(uint32_t size, uint32_t flags) {
+    uint32_t irq_flags = spinlock__lock_irqsave(&heap_lock);
+    void* addr;
     if (heap_initialized) {
-        return real_alloc(size, flags);
+        addr = real_alloc(size, flags);
     }
     else {
-        return bootstrap_alloc(size, flags);
+        addr = bootstrap_alloc(size, flags);
     }
+    spinlock__unlock_irqrestore(&heap_lock, irq_flags);
+    TRACE(TRACE_KMEM_ALLOC, size, addr, 0);
+    return addr;
 }
 
 void kmem__free(void* addr) {
     if (!heap_initialized) {
         PANIC("bootstrap heap blocks can not be freed");
     }
+    TRACE(TRACE_KMEM_FREE, addr, 0, 0);
+    uint32_t irq_flags = spinlock__lock_irqsave(&heap_lock);
     real_free(addr);
+    spinlock__unlock_irqrestore(&heap_lock, irq_flags);
 }
 
 static void* bootstrap_alloc(uint32_t size, uint32_t flags) {
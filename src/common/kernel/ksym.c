@@ -0,0 +1,115 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/ksym.h"
+#include "kernel/thread.h"
+#include "kernel/sched.h"
+#include "kernel/vmm.h"
+#include "libk/stdio.h"
+
+#define BACKTRACE_MAX_DEPTH 16
+#define KERNEL_OFFSET 0xC0000000
+
+/*
+ * An entry of the symbol table generated by tools/ksyms.awk from the
+ * symbols of the first link, sorted by address. The last entry is the end
+ * of the code, with an empty name.
+ */
+typedef struct {
+    uint32_t address;
+    uint32_t name; // offset in ksym__names
+} ksym_t;
+
+static void print_address(uint32_t addr);
+static bool is_frame(uint32_t frame, uint32_t low, uint32_t high);
+
+// Weak: the first link pass has no symbol table
+extern const ksym_t ksym__table[] __attribute__((weak));
+extern const uint32_t ksym__count __attribute__((weak));
+extern const char ksym__names[] __attribute__((weak));
+
+const char* ksym__lookup(uint32_t addr, uint32_t* offset) {
+    if (&ksym__count == NULL || ksym__count < 2) {
+        return NULL;
+    }
+    uint32_t last = ksym__count - 1;
+    if (addr < ksym__table[0].address || addr >= ksym__table[last].address) {
+        return NULL;
+    }
+    // Find the last entry at or below addr
+    uint32_t low = 0;
+    uint32_t high = last;
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (ksym__table[middle].address <= addr) {
+            low = middle;
+        }
+        else {
+            high = middle;
+        }
+    }
+    if (offset != NULL) {
+        *offset = addr - ksym__table[low].address;
+    }
+    return &ksym__names[ksym__table[low].name];
+}
+
+static void print_address(uint32_t addr) {
+    uint32_t offset;
+    const char* name = ksym__lookup(addr, &offset);
+    if (name != NULL) {
+        printf("  [0x%x] %s+0x%x\n", addr, name, offset);
+    }
+    else {
+        printf("  [0x%x] ?\n", addr);
+    }
+}
+
+/**
+ * @returns true if frame can be a saved frame pointer of the kernel stack
+ * between low and high, which can be read without faulting
+ */
+static bool is_frame(uint32_t frame, uint32_t low, uint32_t high) {
+    if (frame < low || frame < KERNEL_OFFSET || frame >= high || high - frame < 8 || (frame & 3) != 0) {
+        return false;
+    }
+    // Holds the caller's frame pointer and the return address
+    return vmm__get_physical((void*) frame) != 0 && vmm__get_physical((void*) (frame + 4)) != 0;
+}
+
+uint32_t ksym__walk_frames(uint32_t ebp, uint32_t low, uint32_t high, uint32_t* callers, uint32_t max) {
+    uint32_t frame = ebp;
+    uint32_t depth = 0;
+    while (depth < max && is_frame(frame, low, high)) {
+        uint32_t* saved = (uint32_t*) frame;
+        // Return addresses point after the call
+        if (ksym__lookup(saved[1] - 1, NULL) == NULL) {
+            break;
+        }
+        callers[depth++] = saved[1];
+        // The frames of the callers are higher on the same kernel stack
+        if (saved[0] <= frame) {
+            break;
+        }
+        frame = saved[0];
+    }
+    return depth;
+}
+
+void ksym__backtrace(uint32_t eip, uint32_t ebp) {
+    printf("Backtrace:\n");
+    print_address(eip);
+    // ebp is on the stack of the current thread, unless the scheduler is
+    // not started yet: then at most a thread stack above it
+    thread_t* current = sched__current();
+    uint32_t high = (ebp < UINT32_MAX - THREAD_STACK_SIZE) ? ebp + THREAD_STACK_SIZE : UINT32_MAX;
+    if (current != NULL && ebp >= current->stack_bottom && ebp < current->stack_top) {
+        high = current->stack_top;
+    }
+    uint32_t callers[BACKTRACE_MAX_DEPTH];
+    uint32_t depth = ksym__walk_frames(ebp, ebp, high, callers, BACKTRACE_MAX_DEPTH);
+    for (uint32_t i = 0; i < depth; i++) {
+        print_address(callers[i]);
+    }
+}
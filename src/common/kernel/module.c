@@ -0,0 +1,99 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/module.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+#define KERNEL_OFFSET 0xC0000000
+// The first 4 MiB are always mapped at KERNEL_OFFSET
+#define LOW_MEMORY_END 0x400000
+
+static bool word_matches(const char* word, size_t length, const char* name);
+
+static module_t modules[MODULES_MAX];
+static size_t modules_count;
+
+void module__init(multiboot_info_t* mbi) {
+    if (!(mbi->flags & MULTIBOOT_INFO_MODS)) {
+        return;
+    }
+    multiboot_module_t* mods = (multiboot_module_t*) (mbi->mods_addr + KERNEL_OFFSET);
+    for (size_t i = 0; i < mbi->mods_count; i++) {
+        if (modules_count == MODULES_MAX) {
+            debug("Too many modules, %u ignored", mbi->mods_count - i);
+            break;
+        }
+        module_t* module = &modules[modules_count++];
+        module->phys_start = mods[i].mod_start;
+        module->size = mods[i].mod_end - mods[i].mod_start;
+        module->data = NULL;
+        module->cmdline[0] = '\0';
+        if (mods[i].cmdline != 0 && mods[i].cmdline < LOW_MEMORY_END) {
+            const char* cmdline = (const char*) (mods[i].cmdline + KERNEL_OFFSET);
+            size_t length = strlen(cmdline);
+            if (length >= MODULE_CMDLINE_SIZE) {
+                length = MODULE_CMDLINE_SIZE - 1;
+            }
+            memmove(module->cmdline, cmdline, length);
+            module->cmdline[length] = '\0';
+        }
+        pmm__reserve(mods[i].mod_start, mods[i].mod_end);
+        debug("Module \"%s\" at 0x%x, %u bytes", module->cmdline, module->phys_start, module->size);
+    }
+}
+
+size_t module__count() {
+    return modules_count;
+}
+
+module_t* module__get(size_t index) {
+    return (index < modules_count) ? &modules[index] : NULL;
+}
+
+static bool word_matches(const char* word, size_t length, const char* name) {
+    // Compare the file name of paths
+    for (size_t i = length; i > 0; i--) {
+        if (word[i - 1] == '/') {
+            word += i;
+            length -= i;
+            break;
+        }
+    }
+    return strlen(name) == length && memcmp(word, name, length) == 0;
+}
+
+module_t* module__find(const char* name) {
+    for (size_t i = 0; i < modules_count; i++) {
+        const char* word = modules[i].cmdline;
+        while (*word != '\0') {
+            size_t length = 0;
+            while (word[length] != '\0' && word[length] != ' ') {
+                length++;
+            }
+            if (length > 0 && word_matches(word, length, name)) {
+                return &modules[i];
+            }
+            word += length;
+            while (*word == ' ') {
+                word++;
+            }
+        }
+    }
+    return NULL;
+}
+
+const void* module__data(module_t* module) {
+    if (module->data == NULL) {
+        if (module->phys_start + module->size <= LOW_MEMORY_END) {
+            module->data = (const void*) (module->phys_start + KERNEL_OFFSET);
+        }
+        else {
+            module->data = vmm__map_physical(module->phys_start, module->size, 0);
+        }
+    }
+    return module->data;
+}
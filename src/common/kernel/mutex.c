@@ -0,0 +1,78 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/mutex.h"
+#include "kernel/sched.h"
+#include "kernel/percpu.h"
+#include "kernel/cpu.h"
+#include "kernel/utils.h"
+
+static bool spin_on_owner(mutex_t* mutex);
+
+void mutex__init(mutex_t* mutex, bool adaptive) {
+    mutex->owner = 0;
+    mutex->adaptive = adaptive;
+    waitqueue__init(&mutex->waiters);
+}
+
+bool mutex__trylock(mutex_t* mutex) {
+    uint32_t self = (uint32_t) sched__current();
+    return cpu__cmpxchg(&mutex->owner, 0, self) == 0;
+}
+
+/**
+ * Spin while the owner of the mutex is running on another CPU: it is
+ * likely to release it before a sleep and wake up would complete
+ * @returns true if the mutex was released
+ */
+static bool spin_on_owner(mutex_t* mutex) {
+    thread_t* owner = (thread_t*) mutex->owner;
+    if (owner == NULL) {
+        // Released since the trylock failed
+        return true;
+    }
+    for (uint32_t i = 0; i < MUTEX_SPIN_LIMIT; i++) {
+        if (mutex->owner != (uint32_t) owner) {
+            return true;
+        }
+        thread_state_t state = owner->state;
+        // The owner may have released the mutex and exited meanwhile: its
+        // state only means something if it still owns the mutex
+        if (mutex->owner != (uint32_t) owner) {
+            return true;
+        }
+        if (state != THREAD_RUNNING) {
+            // The owner sleeps or waits for the CPU
+            return false;
+        }
+        cpu__pause();
+    }
+    return false;
+}
+
+void mutex__lock(mutex_t* mutex) {
+    if (mutex__trylock(mutex)) {
+        return;
+    }
+    if (mutex->owner == (uint32_t) sched__current()) {
+        PANIC("Mutex locked twice by the same thread");
+    }
+
+    if (mutex->adaptive && percpu__online_count() > 1) {
+        while (spin_on_owner(mutex)) {
+            if (mutex__trylock(mutex)) {
+                return;
+            }
+        }
+    }
+
+    WAITQUEUE_WAIT(&mutex->waiters, mutex__trylock(mutex));
+}
+
+void mutex__unlock(mutex_t* mutex) {
+    mutex->owner = 0;
+    // Orders the release with the read of the waiters
+    __asm__ __volatile__ ("lock orl $0, (%%esp)" : : : "memory");
+    waitqueue__wake_one(&mutex->waiters);
+}
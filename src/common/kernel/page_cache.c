@@ -0,0 +1,710 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/page_cache.h"
+#include "kernel/block.h"
+#include "kernel/mutex.h"
+#include "kernel/waitqueue.h"
+#include "kernel/sched.h"
+#include "kernel/thread.h"
+#include "kernel/timer.h"
+#include "kernel/kmem.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+#include "libk/stdio.h"
+
+// Virtual window of the cached pages, between the heap and the MMIO window
+#define WINDOW_BASE 0xE0000000
+#define WINDOW_PAGES 8192 // 32 MiB
+#define HASH_BUCKETS 1024
+// Frames the cache leaves to the rest of the kernel
+#define LOW_WATERMARK 1024
+#define READAHEAD_MIN 4
+#define READAHEAD_MAX 32
+#define READAHEAD_QUEUE 8
+// Pages per read or write-back batch
+#define BATCH_MAX 32
+#define WRITEBACK_MS 1000
+
+typedef struct {
+    page_t* head; // least recently used
+    page_t* tail;
+    uint32_t count;
+} lru_t;
+
+/*
+ * Sequential access detection, per device
+ */
+typedef struct {
+    block_device_t* device;
+    uint32_t next; // page expected next if the access is sequential
+    uint32_t end; // first page not read ahead yet
+    uint32_t window; // pages of the last readahead
+} stream_t;
+
+typedef struct {
+    block_device_t* device;
+    uint32_t first;
+    uint32_t count;
+} readahead_t;
+
+static uint32_t blocks_per_page(block_device_t* device);
+static uint32_t device_pages(block_device_t* device);
+static uint32_t hash(block_device_t* device, uint32_t index);
+static page_t* find(block_device_t* device, uint32_t index);
+static void lru_remove(lru_t* lru, page_t* page);
+static void lru_append(lru_t* lru, page_t* page);
+static void balance(void);
+static void touch(page_t* page);
+static void unhash(page_t* page);
+static page_t* evict(void);
+static void discard(page_t* page);
+static page_t* alloc_page(void);
+static void insert(page_t* page, block_device_t* device, uint32_t index);
+static int submit_pages(page_t** batch, size_t count, bool write);
+static void finish_pages(page_t** batch, size_t count, int result, bool write);
+static void fill_page(page_t* page);
+static size_t read_range(block_device_t* device, uint32_t first, uint32_t count, page_t* held);
+static stream_t* get_stream(block_device_t* device);
+static void queue_readahead(stream_t* stream);
+static void wait_page(page_t* page);
+static page_t* get(block_device_t* device, uint32_t index, bool read);
+static int writeback(block_device_t* device, size_t* written);
+static void writeback_callback(void* data);
+static void worker(void* data);
+
+static mutex_t cache_lock = MUTEX_INIT;
+// Write-backs are serialized, so that a sync waits for the one in flight
+static mutex_t writeback_lock = MUTEX_INIT;
+static page_t* pages;
+static uint32_t capacity;
+static uint32_t allocated; // pages which have a frame
+static page_t* free_pages; // have a frame, but no device (chained by hash_next)
+static page_t* buckets[HASH_BUCKETS];
+static lru_t active;
+static lru_t inactive;
+static uint32_t dirty_count;
+static uint32_t dirty_limit;
+// Woken up each time pages are no longer busy
+static waitqueue_t io_done = WAITQUEUE_INIT;
+
+static stream_t streams[BLOCK_DEVICES_MAX];
+static readahead_t readahead_queue[READAHEAD_QUEUE];
+static volatile uint32_t readahead_head;
+static volatile uint32_t readahead_tail;
+static waitqueue_t worker_wakeup = WAITQUEUE_INIT;
+static volatile bool writeback_due;
+static timer_t writeback_timer;
+
+// Statistics
+static uint32_t hits;
+static uint32_t misses;
+static uint32_t readahead_pages;
+static uint32_t evictions;
+static uint32_t written_pages;
+static uint32_t writeback_batches;
+
+static uint32_t blocks_per_page(block_device_t* device) {
+    return PAGE_SIZE / device->block_size;
+}
+
+static uint32_t device_pages(block_device_t* device) {
+    uint32_t per_page = blocks_per_page(device);
+    return device->blocks / per_page + (device->blocks % per_page != 0);
+}
+
+static uint32_t hash(block_device_t* device, uint32_t index) {
+    return ((uint32_t) device / sizeof(block_device_t) + index) % HASH_BUCKETS;
+}
+
+static page_t* find(block_device_t* device, uint32_t index) {
+    page_t* page = buckets[hash(device, index)];
+    while (page != NULL && (page->device != device || page->index != index)) {
+        page = page->hash_next;
+    }
+    return page;
+}
+
+static void lru_remove(lru_t* lru, page_t* page) {
+    if (page->lru_prev != NULL) {
+        page->lru_prev->lru_next = page->lru_next;
+    }
+    else {
+        lru->head = page->lru_next;
+    }
+    if (page->lru_next != NULL) {
+        page->lru_next->lru_prev = page->lru_prev;
+    }
+    else {
+        lru->tail = page->lru_prev;
+    }
+    page->lru_prev = NULL;
+    page->lru_next = NULL;
+    lru->count--;
+}
+
+static void lru_append(lru_t* lru, page_t* page) {
+    page->lru_prev = lru->tail;
+    page->lru_next = NULL;
+    if (lru->tail != NULL) {
+        lru->tail->lru_next = page;
+    }
+    else {
+        lru->head = page;
+    }
+    lru->tail = page;
+    lru->count++;
+}
+
+/**
+ * Keep the active list at most as long as the inactive one, by aging its
+ * least recently used pages
+ */
+static void balance() {
+    while (active.count > inactive.count) {
+        page_t* page = active.head;
+        lru_remove(&active, page);
+        page->flags &= ~(uint32_t) (PAGE_ACTIVE | PAGE_REFERENCED);
+        lru_append(&inactive, page);
+    }
+}
+
+/**
+ * A page is activated by its second access while inactive: pages read
+ * once by a scan never push the working set out
+ */
+static void touch(page_t* page) {
+    if (page->flags & PAGE_ACTIVE) {
+        lru_remove(&active, page);
+        lru_append(&active, page);
+    }
+    else if (page->flags & PAGE_REFERENCED) {
+        lru_remove(&inactive, page);
+        page->flags = (page->flags & ~(uint32_t) PAGE_REFERENCED) | PAGE_ACTIVE;
+        lru_append(&active, page);
+        balance();
+    }
+    else {
+        page->flags |= PAGE_REFERENCED;
+    }
+}
+
+static void unhash(page_t* page) {
+    page_t** link = &buckets[hash(page->device, page->index)];
+    while (*link != page) {
+        link = &(*link)->hash_next;
+    }
+    *link = page->hash_next;
+}
+
+/**
+ * Take the least recently used inactive page which is clean and unused
+ * @returns NULL if there is none
+ */
+static page_t* evict() {
+    balance();
+    // The first pass may only clear the referenced flags
+    for (size_t pass = 0; pass < 2; pass++) {
+        for (page_t* page = inactive.head; page != NULL; page = page->lru_next) {
+            if (page->refs != 0 || (page->flags & (PAGE_BUSY | PAGE_DIRTY))) {
+                continue;
+            }
+            if (page->flags & PAGE_REFERENCED) {
+                // Second chance
+                page->flags &= ~(uint32_t) PAGE_REFERENCED;
+                continue;
+            }
+            lru_remove(&inactive, page);
+            unhash(page);
+            evictions++;
+            return page;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Take an unused page whose read failed out of the cache, so that the next
+ * access reads it again. Its frame is kept for alloc_page.
+ */
+static void discard(page_t* page) {
+    lru_remove((page->flags & PAGE_ACTIVE) ? &active : &inactive, page);
+    unhash(page);
+    page->device = NULL;
+    page->flags = 0;
+    page->hash_next = free_pages;
+    free_pages = page;
+}
+
+/**
+ * @returns a page which has a frame and is not in the cache, NULL if every
+ * page is in use or dirty
+ */
+static page_t* alloc_page() {
+    page_t* page = free_pages;
+    if (page != NULL) {
+        free_pages = page->hash_next;
+        return page;
+    }
+    if (allocated < capacity && pmm__available() > LOW_WATERMARK) {
+        page = &pages[allocated];
+        page->data = (void*) (WINDOW_BASE + allocated * PAGE_SIZE);
+        vmm__map_page(page->data, pmm__alloc_frame(), PAGE_WRITABLE);
+        allocated++;
+        return page;
+    }
+    // Memory pressure: reuse the least recently used page
+    return evict();
+}
+
+/**
+ * Add a busy page to the cache, in the inactive list
+ */
+static void insert(page_t* page, block_device_t* device, uint32_t index) {
+    page->device = device;
+    page->index = index;
+    page->flags = PAGE_BUSY;
+    page->refs = 0;
+    uint32_t bucket = hash(device, index);
+    page->hash_next = buckets[bucket];
+    buckets[bucket] = page;
+    lru_append(&inactive, page);
+}
+
+/**
+ * Read or write the busy pages of batch, which belong to the same device,
+ * in a single block__submit call. Pages consecutive on the device and in
+ * the window are merged in a single request.
+ * @returns 0 if success, -1 if a request failed
+ */
+static int submit_pages(page_t** batch, size_t count, bool write) {
+    block_request_t requests[BATCH_MAX];
+    block_device_t* device = batch[0]->device;
+    uint32_t per_page = blocks_per_page(device);
+    size_t requests_count = 0;
+    for (size_t i = 0; i < count; i++) {
+        page_t* page = batch[i];
+        uint32_t block = page->index * per_page;
+        uint32_t blocks = per_page;
+        if (blocks > device->blocks - block) {
+            // Last page of the device
+            blocks = device->blocks - block;
+            memset((char*) page->data + blocks * device->block_size, 0, PAGE_SIZE - blocks * device->block_size);
+        }
+        block_request_t* last = (requests_count > 0) ? &requests[requests_count - 1] : NULL;
+        if (last != NULL && last->block + last->count == block
+                && (char*) last->buffer + last->count * device->block_size == page->data) {
+            last->count += blocks;
+        }
+        else {
+            requests[requests_count].block = block;
+            requests[requests_count].count = blocks;
+            requests[requests_count].buffer = page->data;
+            requests[requests_count].write = write;
+            requests[requests_count].result = 0;
+            requests_count++;
+        }
+    }
+    return block__submit(device, requests, requests_count);
+}
+
+/**
+ * End the I/O of the pages of batch
+ */
+static void finish_pages(page_t** batch, size_t count, int result, bool write) {
+    mutex__lock(&cache_lock);
+    for (size_t i = 0; i < count; i++) {
+        page_t* page = batch[i];
+        if (!write) {
+            page->flags |= (result == 0) ? PAGE_UPTODATE : PAGE_ERROR;
+        }
+        page->flags &= ~(uint32_t) PAGE_BUSY;
+        // Read ahead pages have no user yet, the others go on their last
+        // page_cache__put
+        if ((page->flags & PAGE_ERROR) && page->refs == 0) {
+            discard(page);
+        }
+    }
+    mutex__unlock(&cache_lock);
+    waitqueue__wake_all(&io_done);
+}
+
+/**
+ * The whole page has been written by the caller: it is up to date, and
+ * no longer busy if the caller inserted it
+ */
+static void fill_page(page_t* page) {
+    mutex__lock(&cache_lock);
+    page->flags = (page->flags | PAGE_UPTODATE) & ~(uint32_t) (PAGE_BUSY | PAGE_ERROR);
+    mutex__unlock(&cache_lock);
+    waitqueue__wake_all(&io_done);
+}
+
+/**
+ * Read the pages of [first, first + count) which are not cached yet, in a
+ * single batch. held, if not NULL, is a busy page of the range already
+ * inserted by the caller. Must be called with the cache locked, returns
+ * with it unlocked.
+ * @returns the number of pages read
+ */
+static size_t read_range(block_device_t* device, uint32_t first, uint32_t count, page_t* held) {
+    page_t* batch[BATCH_MAX];
+    size_t batch_count = 0;
+    uint32_t limit = device_pages(device);
+    for (uint32_t index = first; index < first + count && index < limit && batch_count < BATCH_MAX; index++) {
+        page_t* page = (held != NULL && held->index == index) ? held : find(device, index);
+        if (page != NULL && page != held) {
+            continue;
+        }
+        if (page == NULL) {
+            page = alloc_page();
+            if (page == NULL) {
+                break;
+            }
+            insert(page, device, index);
+        }
+        batch[batch_count++] = page;
+    }
+    mutex__unlock(&cache_lock);
+    if (batch_count > 0) {
+        int result = submit_pages(batch, batch_count, false);
+        finish_pages(batch, batch_count, result, false);
+    }
+    return batch_count;
+}
+
+static stream_t* get_stream(block_device_t* device) {
+    stream_t* free_stream = NULL;
+    for (size_t i = 0; i < BLOCK_DEVICES_MAX; i++) {
+        if (streams[i].device == device) {
+            return &streams[i];
+        }
+        if (streams[i].device == NULL && free_stream == NULL) {
+            free_stream = &streams[i];
+        }
+    }
+    if (free_stream != NULL) {
+        free_stream->device = device;
+    }
+    return free_stream;
+}
+
+/**
+ * Ask the page cache thread to read the next window of the stream. The page
+ * in the middle of the window is marked: reaching it starts the following
+ * one, so the reads stay ahead of the reader.
+ */
+static void queue_readahead(stream_t* stream) {
+    uint32_t next = (readahead_tail + 1) % READAHEAD_QUEUE;
+    if (next == readahead_head || stream->end >= device_pages(stream->device)) {
+        return;
+    }
+    uint32_t window = stream->window * 2;
+    stream->window = (window > READAHEAD_MAX) ? READAHEAD_MAX : window;
+    readahead_queue[readahead_tail].device = stream->device;
+    readahead_queue[readahead_tail].first = stream->end;
+    readahead_queue[readahead_tail].count = stream->window;
+    readahead_tail = next;
+    stream->end += stream->window;
+    waitqueue__wake_one(&worker_wakeup);
+}
+
+static void wait_page(page_t* page) {
+    WAITQUEUE_WAIT(&io_done, (page->flags & PAGE_BUSY) == 0);
+}
+
+/**
+ * @returns the referenced page index of device, read from the device if
+ * read is true. Otherwise a missing page is returned busy and not up to
+ * date: the caller fills it and ends its I/O.
+ */
+static page_t* get(block_device_t* device, uint32_t index, bool read) {
+    if (index >= device_pages(device)) {
+        return NULL;
+    }
+    mutex__lock(&cache_lock);
+    stream_t* stream = get_stream(device);
+    bool sequential = stream != NULL && stream->next == index;
+    if (stream != NULL) {
+        stream->next = index + 1;
+    }
+    page_t* page = find(device, index);
+    if (page != NULL) {
+        hits++;
+        page->refs++;
+        touch(page);
+        if ((page->flags & PAGE_READAHEAD) && stream != NULL) {
+            page->flags &= ~(uint32_t) PAGE_READAHEAD;
+            queue_readahead(stream);
+        }
+        mutex__unlock(&cache_lock);
+        wait_page(page);
+        uint32_t flags = page->flags;
+        if ((flags & PAGE_UPTODATE) == 0 && read) {
+            // The read failed
+            page_cache__put(page);
+            return NULL;
+        }
+        return page;
+    }
+
+    misses++;
+    page = alloc_page();
+    while (page == NULL) {
+        // Every page is dirty or in use: write some back
+        mutex__unlock(&cache_lock);
+        size_t written = 0;
+        writeback(NULL, &written);
+        if (written == 0) {
+            debug("page cache: no page can be evicted");
+            return NULL;
+        }
+        mutex__lock(&cache_lock);
+        page = find(device, index);
+        if (page != NULL) {
+            // Read by another thread meanwhile
+            mutex__unlock(&cache_lock);
+            return get(device, index, read);
+        }
+        page = alloc_page();
+    }
+    insert(page, device, index);
+    page->refs = 1;
+    if (!read) {
+        mutex__unlock(&cache_lock);
+        return page;
+    }
+
+    uint32_t count = 1;
+    if (sequential && stream != NULL) {
+        // Sequential miss: read a window synchronously, and mark the page
+        // which starts the next one asynchronously
+        uint32_t window = stream->window * 2;
+        window = (window < READAHEAD_MIN) ? READAHEAD_MIN : window;
+        stream->window = (window > READAHEAD_MAX) ? READAHEAD_MAX : window;
+        count = stream->window;
+        stream->end = index + count;
+    }
+    else if (stream != NULL) {
+        stream->window = 0;
+    }
+    size_t read_count = read_range(device, index, count, page);
+    if (read_count > 1) {
+        mutex__lock(&cache_lock);
+        page_t* marker = find(device, index + (uint32_t) read_count / 2);
+        if (marker != NULL) {
+            marker->flags |= PAGE_READAHEAD;
+        }
+        readahead_pages += (uint32_t) read_count - 1;
+        mutex__unlock(&cache_lock);
+    }
+    if ((page->flags & PAGE_UPTODATE) == 0) {
+        page_cache__put(page);
+        return NULL;
+    }
+    return page;
+}
+
+page_t* page_cache__get(block_device_t* device, uint32_t index) {
+    return get(device, index, true);
+}
+
+void page_cache__put(page_t* page) {
+    mutex__lock(&cache_lock);
+    page->refs--;
+    if ((page->flags & PAGE_ERROR) && page->refs == 0) {
+        discard(page);
+    }
+    mutex__unlock(&cache_lock);
+}
+
+void page_cache__mark_dirty(page_t* page) {
+    mutex__lock(&cache_lock);
+    if ((page->flags & PAGE_DIRTY) == 0) {
+        page->flags |= PAGE_DIRTY;
+        dirty_count++;
+        if (dirty_count > dirty_limit) {
+            waitqueue__wake_one(&worker_wakeup);
+        }
+    }
+    mutex__unlock(&cache_lock);
+}
+
+int page_cache__read(block_device_t* device, uint32_t block, uint32_t count, void* buffer) {
+    if (block >= device->blocks || count > device->blocks - block) {
+        return -1;
+    }
+    uint32_t per_page = blocks_per_page(device);
+    char* destination = buffer;
+    while (count > 0) {
+        page_t* page = page_cache__get(device, block / per_page);
+        if (page == NULL) {
+            return -1;
+        }
+        uint32_t offset = block % per_page;
+        uint32_t blocks = per_page - offset;
+        blocks = (blocks > count) ? count : blocks;
+        memmove(destination, (char*) page->data + offset * device->block_size, blocks * device->block_size);
+        page_cache__put(page);
+        destination += blocks * device->block_size;
+        block += blocks;
+        count -= blocks;
+    }
+    return 0;
+}
+
+int page_cache__write(block_device_t* device, uint32_t block, uint32_t count, const void* buffer) {
+    if (block >= device->blocks || count > device->blocks - block || device->write == NULL) {
+        return -1;
+    }
+    uint32_t per_page = blocks_per_page(device);
+    const char* source = buffer;
+    while (count > 0) {
+        uint32_t offset = block % per_page;
+        uint32_t blocks = per_page - offset;
+        blocks = (blocks > count) ? count : blocks;
+        // A page entirely overwritten does not need to be read first
+        bool whole = blocks == per_page;
+        page_t* page = get(device, block / per_page, !whole);
+        if (page == NULL) {
+            return -1;
+        }
+        memmove((char*) page->data + offset * device->block_size, source, blocks * device->block_size);
+        if (whole) {
+            fill_page(page);
+        }
+        page_cache__mark_dirty(page);
+        page_cache__put(page);
+        source += blocks * device->block_size;
+        block += blocks;
+        count -= blocks;
+    }
+    return 0;
+}
+
+/**
+ * Write back a batch of dirty pages, in device order
+ * @returns 0 if success, -1 if a write failed. written is set to the
+ * number of pages written.
+ */
+static int writeback(block_device_t* device, size_t* written) {
+    page_t* batch[BATCH_MAX];
+    size_t count = 0;
+    mutex__lock(&writeback_lock);
+    mutex__lock(&cache_lock);
+    for (uint32_t i = 0; i < allocated && count < BATCH_MAX; i++) {
+        page_t* page = &pages[i];
+        if (page->device == NULL || (device != NULL && page->device != device)
+                || (page->flags & PAGE_DIRTY) == 0 || (page->flags & PAGE_BUSY)) {
+            continue;
+        }
+        page->flags = (page->flags & ~(uint32_t) PAGE_DIRTY) | PAGE_BUSY;
+        dirty_count--;
+        // Insertion sort: the device sees the writes in ascending order
+        size_t j = count++;
+        while (j > 0 && (batch[j - 1]->device > page->device
+                    || (batch[j - 1]->device == page->device && batch[j - 1]->index > page->index))) {
+            batch[j] = batch[j - 1];
+            j--;
+        }
+        batch[j] = page;
+    }
+    mutex__unlock(&cache_lock);
+
+    int result = 0;
+    for (size_t start = 0; start < count;) {
+        size_t end = start;
+        while (end < count && batch[end]->device == batch[start]->device) {
+            end++;
+        }
+        int batch_result = submit_pages(&batch[start], end - start, true);
+        if (batch_result != 0) {
+            debug("page cache: write-back to %s failed", batch[start]->device->name);
+            result = -1;
+        }
+        finish_pages(&batch[start], end - start, batch_result, true);
+        start = end;
+    }
+    if (count > 0) {
+        mutex__lock(&cache_lock);
+        written_pages += (uint32_t) count;
+        writeback_batches++;
+        mutex__unlock(&cache_lock);
+    }
+    mutex__unlock(&writeback_lock);
+    *written = count;
+    return result;
+}
+
+int page_cache__sync(block_device_t* device) {
+    int result = 0;
+    size_t written;
+    do {
+        if (writeback(device, &written) != 0) {
+            result = -1;
+        }
+    } while (written > 0);
+    return result;
+}
+
+static void writeback_callback(void* data) {
+    (void) data;
+    if (dirty_count > 0) {
+        writeback_due = true;
+        waitqueue__wake_one(&worker_wakeup);
+    }
+}
+
+/**
+ * Page cache thread: reads ahead, and writes the dirty pages back
+ * periodically or when there are too many of them
+ */
+static void worker(void* data) {
+    (void) data;
+    for (;;) {
+        WAITQUEUE_WAIT(&worker_wakeup, readahead_head != readahead_tail || writeback_due
+                || dirty_count > dirty_limit);
+        while (readahead_head != readahead_tail) {
+            mutex__lock(&cache_lock);
+            readahead_t request = readahead_queue[readahead_head];
+            readahead_head = (readahead_head + 1) % READAHEAD_QUEUE;
+            size_t count = read_range(request.device, request.first, request.count, NULL);
+            if (count > 0) {
+                mutex__lock(&cache_lock);
+                page_t* marker = find(request.device, request.first + request.count / 2);
+                if (marker != NULL) {
+                    marker->flags |= PAGE_READAHEAD;
+                }
+                readahead_pages += (uint32_t) count;
+                mutex__unlock(&cache_lock);
+            }
+        }
+        if (writeback_due || dirty_count > dirty_limit) {
+            writeback_due = false;
+            page_cache__sync(NULL);
+        }
+    }
+}
+
+void page_cache__init() {
+    capacity = (uint32_t) pmm__available() / 4;
+    capacity = (capacity > WINDOW_PAGES) ? WINDOW_PAGES : capacity;
+    pages = kmem__alloc(sizeof(page_t) * capacity, 0);
+    memset(pages, 0, sizeof(page_t) * capacity);
+    dirty_limit = capacity / 4;
+    debug("page cache: up to %u pages", capacity);
+    thread__create("page_cache", worker, NULL);
+    timer__add_periodic(&writeback_timer, timer__ms_to_ticks(WRITEBACK_MS), writeback_callback, NULL);
+}
+
+void page_cache__dump_stats() {
+    mutex__lock(&cache_lock);
+    printf("page cache: %u/%u pages (%u active, %u dirty), %u hits, %u misses, %u read ahead\n",
+            active.count + inactive.count, capacity, active.count, dirty_count, hits, misses, readahead_pages);
+    printf("page cache: %u evictions, %u pages written back in %u batches\n",
+            evictions, written_pages, writeback_batches);
+    mutex__unlock(&cache_lock);
+}
@@ -0,0 +1,544 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/sched.h"
+#include "kernel/thread.h"
+#include "kernel/idle.h"
+#include "kernel/timer.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/cpu.h"
+#include "kernel/utils.h"
+#include "kernel/irq.h"
+#include "kernel/percpu.h"
+#include "kernel/smp.h"
+#include "kernel/spinlock.h"
+#include "drivers/pit.h"
+#include "libk/bitset.h"
+
+typedef struct {
+    thread_t* head;
+    thread_t* tail;
+} run_queue_t;
+
+/*
+ * Scheduler state of a CPU. One FIFO of ready threads per priority, and a
+ * bitmap of the non-empty ones: picking the next thread is a single bit
+ * scan. A CPU without ready threads steals one from a busy CPU.
+ */
+typedef struct {
+    spinlock_t lock;
+    run_queue_t queues[SCHED_PRIORITIES];
+    uint32_t bitmap_words[BITSET_WORDS(SCHED_PRIORITIES)];
+    bitset_t bitmap;
+    uint32_t ready; // number of queued threads
+    thread_t* current;
+    thread_t* idle;
+    thread_t* prev; // thread being switched away from (see finish_switch)
+    bool need_resched;
+    uint32_t slice_start;
+} cpu_sched_t;
+
+static int_result_t sched_irq_handler(registers_t* regs);
+static int_result_t reschedule_handler(registers_t* regs);
+static void idle_loop(void* data);
+static cpu_sched_t* this_rq(void);
+static uint32_t rq_index(cpu_sched_t* rq);
+static uint32_t peek_ready(cpu_sched_t* rq);
+static thread_t* peek_current(cpu_sched_t* rq);
+static uint32_t effective_priority(thread_t* thread);
+static void push(cpu_sched_t* rq, thread_t* thread, bool head);
+static thread_t* pop(cpu_sched_t* rq);
+static void remove(cpu_sched_t* rq, thread_t* thread);
+static int best_ready_priority(cpu_sched_t* rq);
+static bool must_preempt(cpu_sched_t* rq, thread_t* thread);
+static void request_slice_end(cpu_sched_t* rq);
+static cpu_sched_t* select_rq(thread_t* thread);
+static void enqueue_locked(cpu_sched_t* rq, thread_t* thread);
+static thread_t* steal(cpu_sched_t* rq);
+static void finish_switch(void);
+static void schedule(bool preempt);
+static void reap_zombies(void);
+
+static cpu_sched_t rqs[MAX_CPUS];
+static thread_t main_thread;
+static thread_t ap_idle_threads[MAX_CPUS];
+// Dead threads, freed by the idle threads: a thread can not free the stack
+// it is running on, and the heap must not be used from interrupt context
+static thread_t* zombies;
+static spinlock_t zombies_lock = SPINLOCK_INIT;
+static uint32_t timeslice; // in ticks
+
+extern char bootstrap_stack_bottom[];
+extern char bootstrap_stack_top[];
+
+static cpu_sched_t* this_rq() {
+    return &rqs[percpu__id()];
+}
+
+static uint32_t rq_index(cpu_sched_t* rq) {
+    return (uint32_t) (rq - rqs);
+}
+
+/*
+ * The load of the other CPUs is read without their run queue locks: the
+ * callers may hold a run queue lock already, and taking another one could
+ * deadlock with a CPU doing the opposite. The values can be stale by the
+ * time they are used, which only makes the choice of a CPU less balanced:
+ * the run queue finally chosen is locked before it is changed.
+ */
+static uint32_t peek_ready(cpu_sched_t* rq) {
+    return *(volatile uint32_t*) &rq->ready;
+}
+
+static thread_t* peek_current(cpu_sched_t* rq) {
+    return *(thread_t* volatile*) &rq->current;
+}
+
+static uint32_t effective_priority(thread_t* thread) {
+    return (thread->boost < thread->priority) ? thread->priority - thread->boost : 0;
+}
+
+static void push(cpu_sched_t* rq, thread_t* thread, bool head) {
+    uint32_t priority = effective_priority(thread);
+    run_queue_t* queue = &rq->queues[priority];
+    thread->state = THREAD_READY;
+    thread->cpu = rq_index(rq);
+    thread->next = NULL;
+    if (!queue->head) {
+        queue->head = thread;
+        queue->tail = thread;
+        bitset__set(priority, &rq->bitmap);
+    }
+    else if (head) {
+        thread->next = queue->head;
+        queue->head = thread;
+    }
+    else {
+        queue->tail->next = thread;
+        queue->tail = thread;
+    }
+    rq->ready++;
+}
+
+static thread_t* pop(cpu_sched_t* rq) {
+    int priority = bitset__find_first_set(&rq->bitmap);
+    if (priority < 0) {
+        return NULL;
+    }
+    thread_t* thread = rq->queues[priority].head;
+    remove(rq, thread);
+    return thread;
+}
+
+static void remove(cpu_sched_t* rq, thread_t* thread) {
+    uint32_t priority = effective_priority(thread);
+    run_queue_t* queue = &rq->queues[priority];
+    thread_t** link = &queue->head;
+    thread_t* prev = NULL;
+    while (*link != thread) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    *link = thread->next;
+    if (queue->tail == thread) {
+        queue->tail = prev;
+    }
+    if (!queue->head) {
+        bitset__clear(priority, &rq->bitmap);
+    }
+    thread->next = NULL;
+    rq->ready--;
+}
+
+// -1 if no thread is ready
+static int best_ready_priority(cpu_sched_t* rq) {
+    return bitset__find_first_set(&rq->bitmap);
+}
+
+// true if a ready thread may take the CPU from the running one
+static bool must_preempt(cpu_sched_t* rq, thread_t* thread) {
+    if (rq->current == rq->idle) {
+        return true;
+    }
+    return effective_priority(thread) < effective_priority(rq->current);
+}
+
+static void request_slice_end(cpu_sched_t* rq) {
+    // The other CPUs have a periodic local timer, the boot CPU asks the
+    // PIT fast path for the end of the slice. Round robin is only needed
+    // when a thread of the same priority waits.
+    int best = best_ready_priority(rq);
+    if (rq == &rqs[0] && rq->current != rq->idle && best >= 0
+            && (uint32_t) best <= effective_priority(rq->current)) {
+        pit__request_event(rq->slice_start + timeslice);
+    }
+}
+
+static int_result_t sched_irq_handler(registers_t* regs) {
+    (void) regs;
+    cpu_sched_t* rq = this_rq();
+    spinlock__lock(&rq->lock);
+    int best = best_ready_priority(rq);
+    if (rq->current != rq->idle && best >= 0 && (uint32_t) best <= effective_priority(rq->current)) {
+        if ((int32_t) (pit__get_ticks() - rq->slice_start) >= (int32_t) timeslice) {
+            rq->need_resched = true;
+        }
+        else {
+            request_slice_end(rq);
+        }
+    }
+    spinlock__unlock(&rq->lock);
+    return INT_HANDLED;
+}
+
+static int_result_t reschedule_handler(registers_t* regs) {
+    (void) regs;
+    // need_resched was set by the sender, the switch happens on the way
+    // out of the interrupt (or when hlt returns in the idle thread)
+    return INT_HANDLED;
+}
+
+/**
+ * Choose the CPU which runs a thread made ready
+ */
+static cpu_sched_t* select_rq(thread_t* thread) {
+    cpu_sched_t* last = &rqs[thread->cpu];
+    // A thread still being switched away from must stay on its CPU, whose
+    // lock is held until the switch is complete
+    if (thread->on_cpu || peek_current(last) == last->idle) {
+        return last;
+    }
+    cpu_sched_t* best = last;
+    uint32_t best_load = peek_ready(last) + 1;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpu_sched_t* rq = &rqs[i];
+        thread_t* current = peek_current(rq);
+        if (!percpu__get(i)->online || current == NULL) {
+            continue;
+        }
+        uint32_t load = peek_ready(rq) + (current != rq->idle);
+        if (load < best_load) {
+            best = rq;
+            best_load = load;
+        }
+    }
+    return best;
+}
+
+static void enqueue_locked(cpu_sched_t* rq, thread_t* thread) {
+    push(rq, thread, false);
+    if (must_preempt(rq, thread)) {
+        rq->need_resched = true;
+        if (rq != this_rq()) {
+            smp__send_reschedule(rq_index(rq));
+        }
+    }
+    else {
+        request_slice_end(rq);
+    }
+}
+
+/**
+ * Take a ready thread from the run queues of a busy CPU
+ */
+static thread_t* steal(cpu_sched_t* rq) {
+    uint32_t self = rq_index(rq);
+    for (uint32_t i = 1; i < MAX_CPUS; i++) {
+        cpu_sched_t* victim = &rqs[(self + i) % MAX_CPUS];
+        // A CPU which idles runs its own threads. Checked again under the
+        // lock, through the bitmap.
+        if (peek_ready(victim) == 0 || peek_current(victim) == victim->idle) {
+            continue;
+        }
+        // Never wait for another run queue while holding ours
+        if (!spinlock__trylock(&victim->lock)) {
+            continue;
+        }
+        for (uint32_t priority = 0; priority < SCHED_PRIORITIES; priority++) {
+            if (bitset__test(priority, &victim->bitmap) != 1) {
+                continue;
+            }
+            for (thread_t* thread = victim->queues[priority].head; thread; thread = thread->next) {
+                if (!thread->on_cpu) {
+                    remove(victim, thread);
+                    spinlock__unlock(&victim->lock);
+                    thread->cpu = self;
+                    return thread;
+                }
+            }
+        }
+        spinlock__unlock(&victim->lock);
+    }
+    return NULL;
+}
+
+/**
+ * Second half of a context switch, run by the thread switched to: the
+ * previous thread is off its stack, so it can run on another CPU or be
+ * freed, and the run queue lock taken by sched__schedule is released.
+ */
+static void finish_switch() {
+    cpu_sched_t* rq = this_rq();
+    thread_t* prev = rq->prev;
+    rq->prev = NULL;
+    if (prev) {
+        prev->on_cpu = false;
+        if (prev->state == THREAD_DEAD) {
+            spinlock__lock(&zombies_lock);
+            prev->next = zombies;
+            zombies = prev;
+            spinlock__unlock(&zombies_lock);
+        }
+    }
+    spinlock__unlock(&rq->lock);
+}
+
+static void reap_zombies() {
+    uint32_t flags = spinlock__lock_irqsave(&zombies_lock);
+    thread_t* list = zombies;
+    zombies = NULL;
+    spinlock__unlock_irqrestore(&zombies_lock, flags);
+
+    while (list) {
+        thread_t* thread = list;
+        list = thread->next;
+        thread__free(thread);
+    }
+}
+
+static void idle_loop(void* data) {
+    (void) data;
+    for(;;) {
+        reap_zombies();
+        idle__enter();
+    }
+}
+
+void sched__init() {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        spinlock__init(&rqs[i].lock);
+        bitset__init(&rqs[i].bitmap, rqs[i].bitmap_words, SCHED_PRIORITIES);
+    }
+    thread__init_boot(&main_thread, "main", (uint32_t) bootstrap_stack_bottom, (uint32_t) bootstrap_stack_top);
+    cpu_sched_t* rq = &rqs[0];
+    timeslice = timer__ms_to_ticks(SCHED_DEFAULT_TIMESLICE_MS);
+    rq->slice_start = pit__get_ticks();
+
+    // The idle threads are never in the run queues: they run when those
+    // are empty
+    rq->idle = thread__alloc("idle", idle_loop, NULL);
+    if (rq->idle == NULL) {
+        PANIC("Could not create the idle thread");
+    }
+    rq->current = &main_thread;
+
+    interrupt_handlers__register(IRQ0, sched_irq_handler);
+    interrupt_handlers__register(IRQ_LAPIC_TIMER, sched_irq_handler);
+    interrupt_handlers__register(IRQ_RESCHEDULE, reschedule_handler);
+    debug("Scheduler initialized (time slice: %u ticks)", timeslice);
+}
+
+void sched__start_ap(uint32_t stack_bottom, uint32_t stack_top) {
+    cpu__cli();
+    uint32_t index = percpu__id();
+    cpu_sched_t* rq = &rqs[index];
+    thread_t* idle = &ap_idle_threads[index];
+    thread__init_boot(idle, "idle", stack_bottom, stack_top);
+    idle->cpu = index;
+    idle->on_cpu = true;
+    rq->slice_start = pit__get_ticks();
+    rq->idle = idle;
+    rq->current = idle;
+    cpu__sti();
+    idle_loop(NULL);
+    // Not reached, the idle loop never returns
+    for(;;) {
+        cpu__hlt();
+    }
+}
+
+thread_t* sched__current() {
+    uint32_t flags = cpu__irq_save();
+    thread_t* current = this_rq()->current;
+    cpu__irq_restore(flags);
+    return current;
+}
+
+void sched__enqueue(thread_t* thread) {
+    uint32_t flags = cpu__irq_save();
+    cpu_sched_t* rq = select_rq(thread);
+    spinlock__lock(&rq->lock);
+    enqueue_locked(rq, thread);
+    spinlock__unlock(&rq->lock);
+    cpu__irq_restore(flags);
+}
+
+void sched__wake_up(thread_t* thread) {
+    uint32_t flags = cpu__irq_save();
+    // A blocked thread is in no run queue, and its CPU does not change
+    cpu_sched_t* rq = &rqs[thread->cpu];
+    spinlock__lock(&rq->lock);
+    if (thread->state != THREAD_BLOCKED) {
+        spinlock__unlock(&rq->lock);
+        cpu__irq_restore(flags);
+        return;
+    }
+    // Threads which sleep a lot are interactive, the ones woken up by
+    // interrupts are usually bottom halves: both get to run sooner
+    thread->boost = irq__in_interrupt() ? SCHED_IRQ_WAKE_BOOST : SCHED_WAKE_BOOST;
+    // Other wakers must see the thread is not blocked anymore
+    thread->state = THREAD_WAKING;
+    cpu_sched_t* target = select_rq(thread);
+    if (target != rq) {
+        spinlock__unlock(&rq->lock);
+        spinlock__lock(&target->lock);
+    }
+    enqueue_locked(target, thread);
+    spinlock__unlock(&target->lock);
+    cpu__irq_restore(flags);
+}
+
+void sched__set_priority(thread_t* thread, uint32_t priority) {
+    if (priority >= SCHED_PRIORITIES) {
+        priority = SCHED_PRIORITIES - 1;
+    }
+    uint32_t flags = cpu__irq_save();
+    cpu_sched_t* rq = &rqs[thread->cpu];
+    spinlock__lock(&rq->lock);
+    if (thread->state == THREAD_READY) {
+        // Move the thread to its new run queue
+        remove(rq, thread);
+        thread->priority = (uint8_t) priority;
+        enqueue_locked(rq, thread);
+    }
+    else {
+        thread->priority = (uint8_t) priority;
+        int best = best_ready_priority(rq);
+        if (thread == rq->current && best >= 0 && (uint32_t) best < effective_priority(thread)) {
+            rq->need_resched = true;
+        }
+    }
+    spinlock__unlock(&rq->lock);
+    cpu__irq_restore(flags);
+}
+
+static void schedule(bool preempt) {
+    cpu_sched_t* rq = this_rq();
+    spinlock__lock(&rq->lock);
+    thread_t* prev = rq->current;
+    if (preempt && prev->state == THREAD_BLOCKED) {
+        // Preempted between waitqueue__prepare and sched__block: it must
+        // run again to check its wait condition
+        prev->state = THREAD_RUNNING;
+    }
+    if (prev->state == THREAD_RUNNING && prev != rq->idle) {
+        if ((int32_t) (pit__get_ticks() - rq->slice_start) >= (int32_t) timeslice) {
+            // The whole slice was used: the thread is CPU bound, its boost
+            // decays and it goes after the threads of the same priority
+            if (prev->boost) {
+                prev->boost--;
+            }
+            push(rq, prev, false);
+        }
+        else {
+            // Preempted by a higher priority thread: it resumes first
+            push(rq, prev, true);
+        }
+    }
+    thread_t* next = pop(rq);
+    if (next == NULL) {
+        next = steal(rq);
+    }
+    if (next == NULL) {
+        next = rq->idle;
+    }
+
+    rq->need_resched = false;
+    rq->slice_start = pit__get_ticks();
+    next->state = THREAD_RUNNING;
+    if (next == prev) {
+        spinlock__unlock(&rq->lock);
+        return;
+    }
+
+    next->on_cpu = true;
+    rq->current = next;
+    rq->prev = prev;
+    request_slice_end(rq);
+    thread__load_kernel_stack(next);
+    thread__switch(&prev->esp, next->esp);
+    // Back in prev, possibly on another CPU
+    finish_switch();
+}
+
+void sched__schedule() {
+    schedule(false);
+}
+
+void sched__finish_switch() {
+    finish_switch();
+}
+
+void sched__preempt() {
+    uint32_t flags = cpu__irq_save();
+    cpu_sched_t* rq = this_rq();
+    if (rq->need_resched && rq->current != rq->idle) {
+        schedule(true);
+    }
+    cpu__irq_restore(flags);
+}
+
+bool sched__prepare_block(const volatile bool* condition) {
+    uint32_t flags = cpu__irq_save();
+    cpu_sched_t* rq = this_rq();
+    spinlock__lock(&rq->lock);
+    bool block = !*condition;
+    if (block) {
+        rq->current->state = THREAD_BLOCKED;
+    }
+    spinlock__unlock(&rq->lock);
+    cpu__irq_restore(flags);
+    return block;
+}
+
+void sched__block() {
+    uint32_t flags = cpu__irq_save();
+    schedule(false);
+    cpu__irq_restore(flags);
+}
+
+void sched__cancel_block() {
+    uint32_t flags = cpu__irq_save();
+    cpu_sched_t* rq = this_rq();
+    spinlock__lock(&rq->lock);
+    thread_t* current = rq->current;
+    if (current->state == THREAD_READY) {
+        // Woken up before it slept: a running thread must not stay in the
+        // run queue. Wakers queue a running thread on its own CPU.
+        remove(rq, current);
+    }
+    current->state = THREAD_RUNNING;
+    spinlock__unlock(&rq->lock);
+    cpu__irq_restore(flags);
+}
+
+bool sched__need_resched() {
+    return this_rq()->need_resched;
+}
+
+bool sched__can_steal() {
+    cpu_sched_t* self = this_rq();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpu_sched_t* rq = &rqs[i];
+        if (rq != self && peek_ready(rq) != 0 && peek_current(rq) != rq->idle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void sched__set_timeslice(uint32_t ms) {
+    uint32_t ticks = timer__ms_to_ticks(ms);
+    timeslice = ticks ? ticks : 1;
+}
@@ -0,0 +1,36 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/semaphore.h"
+#include "kernel/sched.h"
+#include "kernel/cpu.h"
+
+void semaphore__init(semaphore_t* semaphore, uint32_t count) {
+    semaphore->count = count;
+    waitqueue__init(&semaphore->waiters);
+}
+
+bool semaphore__trydown(semaphore_t* semaphore) {
+    uint32_t count = semaphore->count;
+    while (count != 0) {
+        uint32_t previous = cpu__cmpxchg(&semaphore->count, count, count - 1);
+        if (previous == count) {
+            return true;
+        }
+        count = previous;
+    }
+    return false;
+}
+
+void semaphore__down(semaphore_t* semaphore) {
+    if (semaphore__trydown(semaphore)) {
+        return;
+    }
+    WAITQUEUE_WAIT(&semaphore->waiters, semaphore__trydown(semaphore));
+}
+
+void semaphore__up(semaphore_t* semaphore) {
+    __asm__ __volatile__ ("lock incl %0" : "+m" (semaphore->count) : : "memory");
+    waitqueue__wake_one(&semaphore->waiters);
+}
@@ -0,0 +1,69 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/slab.h"
+#include "kernel/kmem.h"
+#include "kernel/utils.h"
+
+static void* pop(slab_cache_t* cache);
+
+void slab__init(slab_cache_t* cache, const char* name, uint32_t object_size) {
+    // Free objects hold a pointer, and objects stay aligned
+    uint32_t align = sizeof(void*);
+    if (object_size < align) {
+        object_size = align;
+    }
+    object_size = (object_size + align - 1) & ~(align - 1);
+    if (object_size > SLAB_SIZE) {
+        PANIC("Slab object too large");
+    }
+    cache->name = name;
+    cache->object_size = object_size;
+    cache->objects_per_slab = SLAB_SIZE / object_size;
+    cache->free_list = NULL;
+    spinlock__init(&cache->lock);
+    cache->slabs = 0;
+    cache->allocated = 0;
+}
+
+static void* pop(slab_cache_t* cache) {
+    void* object = cache->free_list;
+    if (object != NULL) {
+        cache->free_list = *(void**) object;
+        cache->allocated++;
+    }
+    return object;
+}
+
+void* slab__alloc(slab_cache_t* cache) {
+    uint32_t flags = spinlock__lock_irqsave(&cache->lock);
+    void* object = pop(cache);
+    spinlock__unlock_irqrestore(&cache->lock, flags);
+    if (object != NULL) {
+        return object;
+    }
+
+    // The heap has its own lock: grow the cache without holding ours
+    char* slab = kmem__alloc(SLAB_SIZE, 0);
+    if (slab == NULL) {
+        return NULL;
+    }
+    flags = spinlock__lock_irqsave(&cache->lock);
+    for (uint32_t i = 0; i < cache->objects_per_slab; i++) {
+        void** free_object = (void**) (slab + i * cache->object_size);
+        *free_object = cache->free_list;
+        cache->free_list = free_object;
+    }
+    cache->slabs++;
+    object = pop(cache);
+    spinlock__unlock_irqrestore(&cache->lock, flags);
+    return object;
+}
+
+void slab__free(slab_cache_t* cache, void* object) {
+    uint32_t flags = spinlock__lock_irqsave(&cache->lock);
+    *(void**) object = cache->free_list;
+    cache->free_list = object;
+    cache->allocated--;
+    spinlock__unlock_irqrestore(&cache->lock, flags);
+}
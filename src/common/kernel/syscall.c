@@ -0,0 +1,73 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/syscall.h"
+#include "kernel/thread.h"
+#include "kernel/vmm.h"
+#include "libk/stdio.h"
+
+typedef int32_t (*syscall_t)(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+static int32_t sys_null(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+static int32_t sys_exit(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+static int32_t sys_write(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+static int32_t sys_yield(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+static int32_t sys_sleep(uint32_t arg1, uint32_t arg2, uint32_t arg3);
+
+static const syscall_t syscalls[SYSCALLS_NUMBER] = {
+    [SYS_NULL] = sys_null,
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_YIELD] = sys_yield,
+    [SYS_SLEEP] = sys_sleep,
+};
+
+static int32_t sys_null(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+    return 0;
+}
+
+static int32_t sys_exit(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+    thread__exit();
+}
+
+static int32_t sys_write(uint32_t buffer, uint32_t size, uint32_t arg3) {
+    (void) arg3;
+    // User mode must not make the kernel read its own memory, or fault on
+    // an unmapped address
+    if (!vmm__is_user_range(buffer, size)) {
+        return -1;
+    }
+    const char* str = (const char*) buffer;
+    for (uint32_t i = 0; i < size; i++) {
+        putchar(str[i]);
+    }
+    return (int32_t) size;
+}
+
+static int32_t sys_yield(uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    (void) arg1;
+    (void) arg2;
+    (void) arg3;
+    thread__yield();
+    return 0;
+}
+
+static int32_t sys_sleep(uint32_t ms, uint32_t arg2, uint32_t arg3) {
+    (void) arg2;
+    (void) arg3;
+    thread__sleep(ms);
+    return 0;
+}
+
+int32_t syscall__dispatch(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    if (number >= SYSCALLS_NUMBER) {
+        return -1;
+    }
+    return syscalls[number](arg1, arg2, arg3);
+}
@@ -0,0 +1,252 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/timer.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/spinlock.h"
+#include "drivers/pit.h"
+
+/*
+ * Hierarchical timing wheel: the first level has one slot per tick for the
+ * next 256 ticks, each of the 4 next levels covers 64 times the range of
+ * the previous one. Timers are inserted in O(1) in the level matching
+ * their distance, and move down one level ("cascade") each time the lower
+ * level wraps around, so expiring a tick only looks at a single slot.
+ */
+#define ROOT_BITS 8
+#define LEVEL_BITS 6
+#define ROOT_SIZE (1 << ROOT_BITS)
+#define LEVEL_SIZE (1 << LEVEL_BITS)
+#define ROOT_MASK (ROOT_SIZE - 1)
+#define LEVEL_MASK (LEVEL_SIZE - 1)
+#define LEVELS 4
+#define BITMAP_WORDS (ROOT_SIZE / 32)
+
+static int_result_t timer_irq_handler(registers_t* regs);
+static void enqueue(timer_t* timer);
+static void dequeue(timer_t* timer);
+static void cascade(size_t level, size_t index);
+static void run_tick(void);
+static void request_next_event(void);
+static void add(timer_t* timer, uint32_t deadline, timer_callback_t callback, void* data);
+
+static timer_t* root[ROOT_SIZE];
+static timer_t* levels[LEVELS][LEVEL_SIZE];
+// Non-empty slots of the first level, to find the next expiry quickly
+static uint32_t root_bitmap[BITMAP_WORDS];
+// Number of timers in the upper levels
+static uint32_t upper_count;
+// Next tick to be processed by the wheel
+static uint32_t wheel_tick;
+static spinlock_t wheel_lock = SPINLOCK_INIT;
+
+static void enqueue(timer_t* timer) {
+    uint32_t expires = timer->expires;
+    uint32_t delta = expires - wheel_tick;
+    timer_t** list;
+    if ((int32_t) delta < 0) {
+        // Already expired: run it with the next processed tick
+        list = &root[wheel_tick & ROOT_MASK];
+    }
+    else if (delta < ROOT_SIZE) {
+        list = &root[expires & ROOT_MASK];
+    }
+    else {
+        size_t level = 0;
+        while (level < LEVELS - 1 && delta >= (1U << (ROOT_BITS + (level + 1) * LEVEL_BITS))) {
+            level++;
+        }
+        size_t index = (expires >> (ROOT_BITS + level * LEVEL_BITS)) & LEVEL_MASK;
+        list = &levels[level][index];
+        upper_count++;
+    }
+
+    if (list >= &root[0] && list < &root[ROOT_SIZE]) {
+        size_t index = (size_t) (list - root);
+        root_bitmap[index / 32] |= 1U << (index % 32);
+    }
+    timer->list = list;
+    timer->next = *list;
+    if (timer->next) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = list;
+    *list = timer;
+    timer->pending = true;
+}
+
+static void dequeue(timer_t* timer) {
+    *timer->pprev = timer->next;
+    if (timer->next) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer_t** list = timer->list;
+    if (list >= &root[0] && list < &root[ROOT_SIZE]) {
+        if (*list == NULL) {
+            size_t index = (size_t) (list - root);
+            root_bitmap[index / 32] &= ~(1U << (index % 32));
+        }
+    }
+    else {
+        upper_count--;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->list = NULL;
+    timer->pending = false;
+}
+
+/**
+ * Move the timers of the given upper level slot to the lower levels
+ */
+static void cascade(size_t level, size_t index) {
+    timer_t* timer = levels[level][index];
+    while (timer) {
+        timer_t* next = timer->next;
+        dequeue(timer);
+        enqueue(timer);
+        timer = next;
+    }
+}
+
+static void run_tick() {
+    size_t index = wheel_tick & ROOT_MASK;
+    if (index == 0) {
+        // The first level wrapped around: bring down the upper levels
+        for (size_t level = 0; level < LEVELS; level++) {
+            size_t level_index = (wheel_tick >> (ROOT_BITS + level * LEVEL_BITS)) & LEVEL_MASK;
+            cascade(level, level_index);
+            if (level_index != 0) {
+                break;
+            }
+        }
+    }
+
+    timer_t* timer;
+    while ((timer = root[index]) != NULL) {
+        dequeue(timer);
+        // The callback may add or cancel timers
+        spinlock__unlock(&wheel_lock);
+        timer->callback(timer->data);
+        spinlock__lock(&wheel_lock);
+        // Periodic timers are re-armed unless the callback did it or
+        // cancelled them
+        if (timer->period != 0 && !timer->pending) {
+            timer->expires += timer->period;
+            enqueue(timer);
+        }
+    }
+    wheel_tick++;
+}
+
+/**
+ * Ask the PIT fast path to call us at the next expiry of the first level,
+ * or when it wraps around if only the upper levels have timers
+ */
+static void request_next_event() {
+    size_t start = wheel_tick & ROOT_MASK;
+    if (start == 0 && upper_count != 0) {
+        // The next tick cascades the upper levels
+        pit__request_event(wheel_tick);
+        return;
+    }
+    // Scan the bitmap from the current slot up to the wrap around
+    for (size_t word = start / 32; word < BITMAP_WORDS; word++) {
+        uint32_t bits = root_bitmap[word];
+        if (word == start / 32) {
+            bits &= ~0U << (start % 32);
+        }
+        if (bits != 0) {
+            uint32_t index = (uint32_t) (word * 32) + (uint32_t) __builtin_ctz(bits);
+            pit__request_event(wheel_tick + index - (uint32_t) start);
+            return;
+        }
+    }
+    // Remaining timers are either in the upper levels or in the first
+    // level slots after the wrap around
+    bool remaining = upper_count != 0;
+    for (size_t word = 0; word < BITMAP_WORDS && !remaining; word++) {
+        remaining = root_bitmap[word] != 0;
+    }
+    if (remaining) {
+        // Next tick whose first level index is 0
+        pit__request_event(wheel_tick + ((ROOT_SIZE - (uint32_t) start) & ROOT_MASK));
+    }
+}
+
+static int_result_t timer_irq_handler(registers_t* regs) {
+    (void) regs;
+    // Process every tick elapsed since the last run
+    uint32_t now = pit__get_ticks();
+    spinlock__lock(&wheel_lock);
+    while ((int32_t) (now - wheel_tick) >= 0) {
+        run_tick();
+    }
+    request_next_event();
+    spinlock__unlock(&wheel_lock);
+    return INT_HANDLED;
+}
+
+void timer__init() {
+    wheel_tick = pit__get_ticks();
+    interrupt_handlers__register(IRQ0, timer_irq_handler);
+}
+
+void timer__init_timer(timer_t* timer) {
+    timer->next = NULL;
+    timer->pprev = NULL;
+    timer->list = NULL;
+    timer->expires = 0;
+    timer->period = 0;
+    timer->callback = NULL;
+    timer->data = NULL;
+    timer->pending = false;
+}
+
+static void add(timer_t* timer, uint32_t deadline, timer_callback_t callback, void* data) {
+    if (timer->pending) {
+        dequeue(timer);
+    }
+    timer->expires = deadline;
+    timer->period = 0;
+    timer->callback = callback;
+    timer->data = data;
+    enqueue(timer);
+    pit__request_event(deadline);
+}
+
+void timer__add(timer_t* timer, uint32_t deadline, timer_callback_t callback, void* data) {
+    uint32_t flags = spinlock__lock_irqsave(&wheel_lock);
+    add(timer, deadline, callback, data);
+    spinlock__unlock_irqrestore(&wheel_lock, flags);
+}
+
+void timer__add_periodic(timer_t* timer, uint32_t period, timer_callback_t callback, void* data) {
+    uint32_t flags = spinlock__lock_irqsave(&wheel_lock);
+    add(timer, pit__get_ticks() + period, callback, data);
+    timer->period = period;
+    spinlock__unlock_irqrestore(&wheel_lock, flags);
+}
+
+bool timer__cancel(timer_t* timer) {
+    uint32_t flags = spinlock__lock_irqsave(&wheel_lock);
+    bool pending = timer->pending;
+    if (pending) {
+        dequeue(timer);
+    }
+    timer->period = 0;
+    spinlock__unlock_irqrestore(&wheel_lock, flags);
+    return pending;
+}
+
+uint32_t timer__now() {
+    return pit__get_ticks();
+}
+
+uint32_t timer__ms_to_ticks(uint32_t ms) {
+    uint32_t frequency = pit__get_frequency();
+    // ms * frequency does not fit in 32 bits for long durations
+    uint64_t ticks = ((uint64_t) ms * frequency + 999) / 1000;
+    return (ticks < INT32_MAX) ? (uint32_t) ticks : INT32_MAX;
+}
@@ -0,0 +1,354 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/tmpfs.h"
+#include "kernel/slab.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "libk/string.h"
+
+/*
+ * File data lives in PMM frames, reached through the direct map. They are
+ * indexed by a radix tree of frames of 1024 entries: a tree of height h
+ * covers 1024^h pages, and a tree of height 0 is a single data page, so
+ * that small files take a single frame. Entries of missing pages are 0,
+ * they read as zeros.
+ */
+#define ENTRIES_BITS 10
+#define ENTRIES_NUMBER (1 << ENTRIES_BITS)
+#define ENTRIES_MASK (ENTRIES_NUMBER - 1)
+// 1024^2 pages cover the 4 GiB of offsets
+#define MAX_HEIGHT 2
+// Frames left to the rest of the kernel when the files fill the memory
+#define RESERVED_FRAMES 512
+
+/*
+ * A file or directory. Its inode number is its address.
+ */
+typedef struct tmpfs_node {
+    char name[VFS_NAME_MAX]; // not terminated
+    uint32_t length;
+    vnode_type_t type;
+    uint32_t size;
+    uint32_t root; // physical address of the root frame of the tree, or 0
+    uint32_t height;
+    // Last leaf table walked to, so that sequential accesses and appends
+    // do not walk the tree
+    uint32_t* leaf;
+    uint32_t leaf_index; // page index >> ENTRIES_BITS of leaf
+    struct tmpfs_node* children;
+    struct tmpfs_node* next; // next entry of the parent directory
+} tmpfs_node_t;
+
+static uint32_t alloc_frame(void);
+static uint32_t find_page(tmpfs_node_t* node, uint32_t index, bool create);
+static void free_pages(uint32_t* entry, uint32_t level, uint32_t base, uint32_t first);
+static void resize(tmpfs_node_t* node, uint32_t size);
+static tmpfs_node_t* find_child(tmpfs_node_t* dir, const char* name, size_t length, tmpfs_node_t*** link);
+static int fs_mount(mount_t* mount, void* source);
+static int fs_read_inode(vnode_t* vnode);
+static int fs_lookup(vnode_t* dir, const char* name, size_t length, uint32_t* ino);
+static int32_t fs_read(vnode_t* vnode, uint32_t offset, void* buffer, uint32_t size);
+static int32_t fs_write(vnode_t* vnode, uint32_t offset, const void* buffer, uint32_t size);
+static int fs_readdir(vnode_t* dir, uint32_t index, char* name, size_t size);
+static int fs_create(vnode_t* dir, const char* name, size_t length, vnode_type_t type, uint32_t* ino);
+static int fs_unlink(vnode_t* dir, const char* name, size_t length);
+static int fs_truncate(vnode_t* vnode, uint32_t size);
+
+static const vnode_ops_t fs_ops = {
+    .lookup = fs_lookup,
+    .read = fs_read,
+    .write = fs_write,
+    .readdir = fs_readdir,
+    .create = fs_create,
+    .unlink = fs_unlink,
+    .truncate = fs_truncate,
+};
+
+const filesystem_t tmpfs__filesystem = {
+    .name = "tmpfs",
+    .mount = fs_mount,
+    .read_inode = fs_read_inode,
+    .evict_inode = NULL,
+};
+
+static slab_cache_t nodes;
+static bool nodes_ready;
+
+/**
+ * @returns the physical address of a zeroed frame, 0 if memory is low
+ */
+static uint32_t alloc_frame() {
+    if (pmm__available() < RESERVED_FRAMES) {
+        return 0;
+    }
+    uint32_t frame = pmm__alloc_frame();
+    void* data = vmm__direct(frame);
+    if (data == NULL) {
+        // Only the frames below the direct map end can be used
+        pmm__free_frame(frame);
+        return 0;
+    }
+    memset(data, 0, PAGE_SIZE);
+    return frame;
+}
+
+/**
+ * @returns the physical address of the index-th data page of node, 0 if
+ * it is missing and create is false or memory is low
+ */
+static uint32_t find_page(tmpfs_node_t* node, uint32_t index, bool create) {
+    if (node->leaf != NULL && (index >> ENTRIES_BITS) == node->leaf_index) {
+        uint32_t* entry = &node->leaf[index & ENTRIES_MASK];
+        if (*entry == 0 && create) {
+            *entry = alloc_frame();
+        }
+        return *entry;
+    }
+
+    // Grow the tree until it covers index, the old root becomes the first
+    // entry of the new one
+    while (node->height < MAX_HEIGHT && (index >> (node->height * ENTRIES_BITS)) != 0) {
+        if (!create) {
+            return 0;
+        }
+        if (node->root != 0) {
+            uint32_t root = alloc_frame();
+            if (root == 0) {
+                return 0;
+            }
+            ((uint32_t*) vmm__direct(root))[0] = node->root;
+            node->root = root;
+        }
+        node->height++;
+    }
+
+    uint32_t* entry = &node->root;
+    for (uint32_t level = node->height; level > 0; level--) {
+        if (*entry == 0) {
+            if (!create || (*entry = alloc_frame()) == 0) {
+                return 0;
+            }
+        }
+        uint32_t* table = vmm__direct(*entry);
+        if (level == 1) {
+            node->leaf = table;
+            node->leaf_index = index >> ENTRIES_BITS;
+        }
+        entry = &table[(index >> ((level - 1) * ENTRIES_BITS)) & ENTRIES_MASK];
+    }
+    if (*entry == 0 && create) {
+        *entry = alloc_frame();
+    }
+    return *entry;
+}
+
+/**
+ * Free the pages from the first-th one under entry, which covers the
+ * pages from base at the given level, and the tables left empty
+ */
+static void free_pages(uint32_t* entry, uint32_t level, uint32_t base, uint32_t first) {
+    if (*entry == 0) {
+        return;
+    }
+    if (level > 0) {
+        uint32_t* table = vmm__direct(*entry);
+        uint32_t span = 1U << ((level - 1) * ENTRIES_BITS);
+        for (uint32_t i = 0; i < ENTRIES_NUMBER; i++) {
+            uint32_t child_base = base + i * span;
+            if (child_base + span > first) {
+                free_pages(&table[i], level - 1, child_base, first);
+            }
+        }
+    }
+    if (base >= first) {
+        pmm__free_frame(*entry);
+        *entry = 0;
+    }
+}
+
+/**
+ * Set the size of node, the bytes after it must always be zeros
+ */
+static void resize(tmpfs_node_t* node, uint32_t size) {
+    if (size < node->size) {
+        uint32_t first = (size + PAGE_SIZE - 1) / PAGE_SIZE;
+        free_pages(&node->root, node->height, 0, first);
+        if (node->root == 0) {
+            node->height = 0;
+        }
+        // The cached leaf may have been freed
+        node->leaf = NULL;
+        if (size % PAGE_SIZE != 0) {
+            uint32_t page = find_page(node, size / PAGE_SIZE, false);
+            if (page != 0) {
+                char* data = vmm__direct(page);
+                memset(data + size % PAGE_SIZE, 0, PAGE_SIZE - size % PAGE_SIZE);
+            }
+        }
+    }
+    node->size = size;
+}
+
+/**
+ * @returns the entry name of dir, NULL if there is none. *link is set to
+ * the pointer to the entry, or to the end of the list.
+ */
+static tmpfs_node_t* find_child(tmpfs_node_t* dir, const char* name, size_t length, tmpfs_node_t*** link) {
+    tmpfs_node_t** child = &dir->children;
+    while (*child != NULL && ((*child)->length != length || memcmp((*child)->name, name, length) != 0)) {
+        child = &(*child)->next;
+    }
+    if (link != NULL) {
+        *link = child;
+    }
+    return *child;
+}
+
+static int fs_mount(mount_t* mount, void* source) {
+    (void) source;
+    // Mounts are serialized by the VFS lock
+    if (!nodes_ready) {
+        slab__init(&nodes, "tmpfs_node", sizeof(tmpfs_node_t));
+        nodes_ready = true;
+    }
+    tmpfs_node_t* root = slab__alloc(&nodes);
+    if (root == NULL) {
+        return -1;
+    }
+    memset(root, 0, sizeof(tmpfs_node_t));
+    root->type = VNODE_DIRECTORY;
+    mount->root_ino = (uint32_t) root;
+    mount->data = root;
+    return 0;
+}
+
+static int fs_read_inode(vnode_t* vnode) {
+    tmpfs_node_t* node = (tmpfs_node_t*) vnode->ino;
+    vnode->type = node->type;
+    vnode->size = node->size;
+    vnode->ops = &fs_ops;
+    vnode->data = node;
+    return 0;
+}
+
+static int fs_lookup(vnode_t* dir, const char* name, size_t length, uint32_t* ino) {
+    tmpfs_node_t* child = find_child(dir->data, name, length, NULL);
+    if (child == NULL) {
+        return -1;
+    }
+    *ino = (uint32_t) child;
+    return 0;
+}
+
+static int32_t fs_read(vnode_t* vnode, uint32_t offset, void* buffer, uint32_t size) {
+    tmpfs_node_t* node = vnode->data;
+    if (offset >= node->size) {
+        return 0;
+    }
+    if (size > node->size - offset) {
+        size = node->size - offset;
+    }
+    char* dest = buffer;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t position = offset + done;
+        uint32_t in_page = position % PAGE_SIZE;
+        uint32_t count = PAGE_SIZE - in_page;
+        if (count > size - done) {
+            count = size - done;
+        }
+        uint32_t page = find_page(node, position / PAGE_SIZE, false);
+        if (page != 0) {
+            memmove(dest + done, (char*) vmm__direct(page) + in_page, count);
+        }
+        else {
+            // Hole
+            memset(dest + done, 0, count);
+        }
+        done += count;
+    }
+    return (int32_t) size;
+}
+
+static int32_t fs_write(vnode_t* vnode, uint32_t offset, const void* buffer, uint32_t size) {
+    tmpfs_node_t* node = vnode->data;
+    if (offset + size < offset) {
+        return -1;
+    }
+    // Pages are zeroed when allocated and past the end by truncate, so
+    // writing past the end leaves a hole of zeros without touching it
+    const char* source = buffer;
+    uint32_t done = 0;
+    while (done < size) {
+        uint32_t position = offset + done;
+        uint32_t in_page = position % PAGE_SIZE;
+        uint32_t count = PAGE_SIZE - in_page;
+        if (count > size - done) {
+            count = size - done;
+        }
+        uint32_t page = find_page(node, position / PAGE_SIZE, true);
+        if (page == 0) {
+            break;
+        }
+        memmove((char*) vmm__direct(page) + in_page, source + done, count);
+        done += count;
+    }
+    if (done > 0 && offset + done > node->size) {
+        node->size = offset + done;
+        vnode->size = node->size;
+    }
+    return (done > 0 || size == 0) ? (int32_t) done : -1;
+}
+
+static int fs_readdir(vnode_t* dir, uint32_t index, char* name, size_t size) {
+    tmpfs_node_t* child = ((tmpfs_node_t*) dir->data)->children;
+    while (child != NULL && index-- > 0) {
+        child = child->next;
+    }
+    if (child == NULL || child->length >= size) {
+        return -1;
+    }
+    memmove(name, child->name, child->length);
+    name[child->length] = '\0';
+    return 0;
+}
+
+static int fs_create(vnode_t* dir, const char* name, size_t length, vnode_type_t type, uint32_t* ino) {
+    tmpfs_node_t** link;
+    if (find_child(dir->data, name, length, &link) != NULL) {
+        return -1;
+    }
+    tmpfs_node_t* node = slab__alloc(&nodes);
+    if (node == NULL) {
+        return -1;
+    }
+    memset(node, 0, sizeof(tmpfs_node_t));
+    memmove(node->name, name, length);
+    node->length = (uint32_t) length;
+    node->type = type;
+    // Appended: readdir keeps the creation order
+    *link = node;
+    *ino = (uint32_t) node;
+    return 0;
+}
+
+static int fs_unlink(vnode_t* dir, const char* name, size_t length) {
+    tmpfs_node_t** link;
+    tmpfs_node_t* node = find_child(dir->data, name, length, &link);
+    if (node == NULL || node->children != NULL) {
+        return -1;
+    }
+    *link = node->next;
+    resize(node, 0);
+    slab__free(&nodes, node);
+    return 0;
+}
+
+static int fs_truncate(vnode_t* vnode, uint32_t size) {
+    tmpfs_node_t* node = vnode->data;
+    resize(node, size);
+    vnode->size = size;
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/trace.h"
+#include "kernel/percpu.h"
+#include "kernel/kmem.h"
+#include "kernel/cpu.h"
+#include "kernel/clock.h"
+#include "drivers/serial.h"
+#include "libk/stdio.h"
+
+/*
+ * Records of a CPU, written only by that CPU with interrupts disabled
+ */
+typedef struct {
+    uint32_t head; // number of records written since trace__start
+    trace_record_t records[TRACE_RING_SIZE];
+} ring_t;
+
+static void format_hex(char* str, uint64_t value, size_t digits);
+
+volatile uint32_t trace__mask;
+static ring_t* rings[MAX_CPUS];
+
+static const char* const event_names[TRACE_EVENTS] = {
+    [TRACE_KMEM_ALLOC] = "kmem_alloc",
+    [TRACE_KMEM_FREE] = "kmem_free",
+    [TRACE_PMM_ALLOC_FRAME] = "pmm_alloc_frame",
+    [TRACE_HEAP_EXTEND] = "heap_extend",
+    [TRACE_IRQ_ENTRY] = "irq_entry",
+    [TRACE_IRQ_EXIT] = "irq_exit",
+    [TRACE_PAGE_FAULT] = "page_fault",
+};
+
+void trace__record(trace_event_t event, uint32_t arg0, uint32_t arg1, uint32_t arg2) {
+    uint32_t flags = cpu__irq_save();
+    ring_t* ring = rings[percpu__id()];
+    if (ring != NULL) {
+        trace_record_t* record = &ring->records[ring->head % TRACE_RING_SIZE];
+        record->timestamp = cpu__rdtsc();
+        record->event = event;
+        record->args[0] = arg0;
+        record->args[1] = arg1;
+        record->args[2] = arg2;
+        ring->head++;
+    }
+    cpu__irq_restore(flags);
+}
+
+int trace__start(uint32_t mask) {
+    trace__mask = 0;
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (percpu__get(i)->online && rings[i] == NULL) {
+            rings[i] = kmem__alloc(sizeof(ring_t), 0);
+            if (rings[i] == NULL) {
+                return -1;
+            }
+        }
+        if (rings[i] != NULL) {
+            rings[i]->head = 0;
+        }
+    }
+    trace__mask = mask;
+    return 0;
+}
+
+void trace__stop() {
+    trace__mask = 0;
+}
+
+/**
+ * Write value as digits hexadecimal digits, with leading zeros
+ */
+static void format_hex(char* str, uint64_t value, size_t digits) {
+    static const char hex[] = "0123456789abcdef";
+    for (size_t i = 0; i < digits; i++) {
+        str[digits - 1 - i] = hex[value & 0xf];
+        value >>= 4;
+    }
+    str[digits] = '\0';
+}
+
+void trace__dump() {
+    char line[96];
+    snprintf(line, sizeof(line), "trace begin %u kHz\n", clock__tsc_khz());
+    serial__writestring(line);
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        ring_t* ring = rings[i];
+        if (ring == NULL) {
+            continue;
+        }
+        uint32_t first = (ring->head > TRACE_RING_SIZE) ? ring->head - TRACE_RING_SIZE : 0;
+        for (uint32_t index = first; index != ring->head; index++) {
+            trace_record_t* record = &ring->records[index % TRACE_RING_SIZE];
+            char timestamp[17];
+            format_hex(timestamp, record->timestamp, 16);
+            snprintf(line, sizeof(line), "trace %u %s %s 0x%x 0x%x 0x%x\n", i, timestamp,
+                    event_names[record->event], record->args[0], record->args[1], record->args[2]);
+            serial__writestring(line);
+        }
+    }
+    serial__writestring("trace end\n");
+}
@@ -1,8 +1,13 @@
 #include <stddef.h>
+#include <stdint.h>
 
 #include "kernel/utils.h"
 #include "drivers/vga.h"
 #include "drivers/pc_speaker.h"
+#include "kernel/ksym.h"
+#include "kernel/cmdline.h"
+#include "drivers/debug_exit.h"
+#include "libk/string.h"
 #include "libk/stdio.h"
 
 void debug(const char* str, ...) {
@@ -21,6 +26,15 @@ void debug(const char* str, ...) {
 void panic(const char* str, const char* filename, size_t line) {
     vga__setcolor(VGA_COLOR_RED);
     printf("\nKERNEL PANIC at %s line %u\nReason : %s\n", filename, (unsigned int) line, str);
+    // Start from the caller, its frame pointer is saved in our frame
+    uint32_t* frame = __builtin_frame_address(0);
+    ksym__backtrace((uint32_t) __builtin_return_address(0), frame[0]);
+
+    // Headless runs (see make test) stop QEMU with a failure status
+    char action[8];
+    if (cmdline__get("panic", action, sizeof(action)) == 0 && memcmp(action, "exit", 5) == 0) {
+        debug_exit__exit(DEBUG_EXIT_FAILURE);
+    }
     
     // Play a very (very) annoying sound
     pc_speaker__play(880);
@@ -0,0 +1,629 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/vfs.h"
+#include "kernel/slab.h"
+#include "kernel/mutex.h"
+#include "libk/string.h"
+#include "libk/stdio.h"
+#include "libk/hash.h"
+
+#define INODE_BUCKETS 64
+#define DENTRY_BUCKETS 256
+
+/*
+ * A cached result of a lookup: the inode number of name in the directory
+ * dir_ino, or the fact that there is no such entry (negative entry)
+ */
+typedef struct dentry_struct {
+    mount_t* mount;
+    uint32_t dir_ino;
+    uint32_t hash;
+    uint32_t length;
+    char name[VFS_NAME_MAX]; // not terminated
+    bool negative;
+    uint32_t ino;
+    struct dentry_struct* hash_next;
+    // Least recently used first
+    struct dentry_struct* lru_prev;
+    struct dentry_struct* lru_next;
+} dentry_t;
+
+typedef struct {
+    vnode_t* vnode; // NULL if the slot is free
+    uint32_t offset;
+    uint32_t flags;
+} file_t;
+
+static uint32_t inode_hash(mount_t* mount, uint32_t ino);
+static void inode_lru_remove(vnode_t* vnode);
+static void inode_lru_append(vnode_t* vnode);
+static vnode_t* find_vnode(mount_t* mount, uint32_t ino);
+static void drop_vnode(vnode_t* vnode);
+static vnode_t* get_vnode(mount_t* mount, uint32_t ino);
+static void put_vnode(vnode_t* vnode);
+static uint32_t dentry_hash(mount_t* mount, uint32_t dir_ino, const char* name, size_t length);
+static void dentry_lru_remove(dentry_t* dentry);
+static void dentry_lru_append(dentry_t* dentry);
+static dentry_t* dentry_find(mount_t* mount, uint32_t dir_ino, const char* name, size_t length, uint32_t hash);
+static void dentry_drop(dentry_t* dentry);
+static void dentry_set(vnode_t* dir, const char* name, size_t length, bool negative, uint32_t ino);
+static int lookup_child(vnode_t* dir, const char* name, size_t length, uint32_t* ino);
+static mount_t* mounted_on(mount_t* mount, uint32_t ino);
+static bool valid_name(const char* name, size_t length);
+static vnode_t* walk(const char* path, const char** last, size_t* last_length);
+static vnode_t* create(const char* path, vnode_type_t type);
+static file_t* get_file(int fd);
+
+// A single lock: the filesystems are in memory, operations are short
+static mutex_t vfs_lock = MUTEX_INIT;
+static mount_t mounts[VFS_MOUNTS_MAX];
+static mount_t* root_mount;
+static file_t files[VFS_FILES_MAX];
+
+// Inode cache: every vnode in use, and up to VFS_INODE_CACHE_SIZE unused
+static slab_cache_t vnode_slab;
+static vnode_t* inode_buckets[INODE_BUCKETS];
+static vnode_t* inode_lru_head;
+static vnode_t* inode_lru_tail;
+static uint32_t inodes_count;
+
+static slab_cache_t dentry_slab;
+static dentry_t* dentry_buckets[DENTRY_BUCKETS];
+static dentry_t* dentry_lru_head;
+static dentry_t* dentry_lru_tail;
+static uint32_t dentries_count;
+
+// Statistics
+static uint32_t inode_hits;
+static uint32_t inode_misses;
+static uint32_t inode_evictions;
+static uint32_t dentry_hits;
+static uint32_t dentry_negative_hits;
+static uint32_t dentry_misses;
+
+void vfs__init() {
+    slab__init(&vnode_slab, "vnode", sizeof(vnode_t));
+    slab__init(&dentry_slab, "dentry", sizeof(dentry_t));
+}
+
+/*
+ * Inode cache
+ */
+
+static uint32_t inode_hash(mount_t* mount, uint32_t ino) {
+    uint32_t key[2] = {(uint32_t) mount, ino};
+    return hash__fnv1a(FNV_OFFSET_BASIS, key, sizeof(key));
+}
+
+static void inode_lru_remove(vnode_t* vnode) {
+    if (vnode->lru_prev != NULL) {
+        vnode->lru_prev->lru_next = vnode->lru_next;
+    }
+    else {
+        inode_lru_head = vnode->lru_next;
+    }
+    if (vnode->lru_next != NULL) {
+        vnode->lru_next->lru_prev = vnode->lru_prev;
+    }
+    else {
+        inode_lru_tail = vnode->lru_prev;
+    }
+    vnode->lru_prev = NULL;
+    vnode->lru_next = NULL;
+}
+
+static void inode_lru_append(vnode_t* vnode) {
+    vnode->lru_prev = inode_lru_tail;
+    vnode->lru_next = NULL;
+    if (inode_lru_tail != NULL) {
+        inode_lru_tail->lru_next = vnode;
+    }
+    else {
+        inode_lru_head = vnode;
+    }
+    inode_lru_tail = vnode;
+}
+
+/**
+ * @returns the cached vnode, without taking a reference
+ */
+static vnode_t* find_vnode(mount_t* mount, uint32_t ino) {
+    vnode_t* vnode = inode_buckets[inode_hash(mount, ino) % INODE_BUCKETS];
+    while (vnode != NULL && (vnode->mount != mount || vnode->ino != ino)) {
+        vnode = vnode->hash_next;
+    }
+    return vnode;
+}
+
+/**
+ * Remove an unused vnode from the cache
+ */
+static void drop_vnode(vnode_t* vnode) {
+    vnode_t** link = &inode_buckets[inode_hash(vnode->mount, vnode->ino) % INODE_BUCKETS];
+    while (*link != vnode) {
+        link = &(*link)->hash_next;
+    }
+    *link = vnode->hash_next;
+    inode_lru_remove(vnode);
+    if (vnode->mount->fs->evict_inode != NULL) {
+        vnode->mount->fs->evict_inode(vnode);
+    }
+    slab__free(&vnode_slab, vnode);
+    inodes_count--;
+}
+
+/**
+ * @returns the vnode of the inode, with a reference, NULL if it does not
+ * exist
+ */
+static vnode_t* get_vnode(mount_t* mount, uint32_t ino) {
+    vnode_t* vnode = find_vnode(mount, ino);
+    if (vnode != NULL) {
+        if (vnode->refs == 0) {
+            inode_lru_remove(vnode);
+        }
+        vnode->refs++;
+        inode_hits++;
+        return vnode;
+    }
+
+    inode_misses++;
+    if (inodes_count >= VFS_INODE_CACHE_SIZE && inode_lru_head != NULL) {
+        inode_evictions++;
+        drop_vnode(inode_lru_head);
+    }
+    vnode = slab__alloc(&vnode_slab);
+    if (vnode == NULL) {
+        return NULL;
+    }
+    vnode->mount = mount;
+    vnode->ino = ino;
+    vnode->type = VNODE_FILE;
+    vnode->size = 0;
+    vnode->ops = NULL;
+    vnode->data = NULL;
+    if (mount->fs->read_inode(vnode) != 0) {
+        slab__free(&vnode_slab, vnode);
+        return NULL;
+    }
+    vnode->refs = 1;
+    vnode->lru_prev = NULL;
+    vnode->lru_next = NULL;
+    vnode_t** bucket = &inode_buckets[inode_hash(mount, ino) % INODE_BUCKETS];
+    vnode->hash_next = *bucket;
+    *bucket = vnode;
+    inodes_count++;
+    return vnode;
+}
+
+static void put_vnode(vnode_t* vnode) {
+    if (--vnode->refs == 0) {
+        inode_lru_append(vnode);
+    }
+}
+
+/*
+ * Dentry cache
+ */
+
+static uint32_t dentry_hash(mount_t* mount, uint32_t dir_ino, const char* name, size_t length) {
+    uint32_t key[2] = {(uint32_t) mount, dir_ino};
+    return hash__fnv1a(hash__fnv1a(FNV_OFFSET_BASIS, key, sizeof(key)), name, length);
+}
+
+static void dentry_lru_remove(dentry_t* dentry) {
+    if (dentry->lru_prev != NULL) {
+        dentry->lru_prev->lru_next = dentry->lru_next;
+    }
+    else {
+        dentry_lru_head = dentry->lru_next;
+    }
+    if (dentry->lru_next != NULL) {
+        dentry->lru_next->lru_prev = dentry->lru_prev;
+    }
+    else {
+        dentry_lru_tail = dentry->lru_prev;
+    }
+}
+
+static void dentry_lru_append(dentry_t* dentry) {
+    dentry->lru_prev = dentry_lru_tail;
+    dentry->lru_next = NULL;
+    if (dentry_lru_tail != NULL) {
+        dentry_lru_tail->lru_next = dentry;
+    }
+    else {
+        dentry_lru_head = dentry;
+    }
+    dentry_lru_tail = dentry;
+}
+
+static dentry_t* dentry_find(mount_t* mount, uint32_t dir_ino, const char* name, size_t length, uint32_t hash) {
+    dentry_t* dentry = dentry_buckets[hash % DENTRY_BUCKETS];
+    while (dentry != NULL) {
+        if (dentry->hash == hash && dentry->mount == mount && dentry->dir_ino == dir_ino
+                && dentry->length == length && memcmp(dentry->name, name, length) == 0) {
+            return dentry;
+        }
+        dentry = dentry->hash_next;
+    }
+    return NULL;
+}
+
+static void dentry_drop(dentry_t* dentry) {
+    dentry_t** link = &dentry_buckets[dentry->hash % DENTRY_BUCKETS];
+    while (*link != dentry) {
+        link = &(*link)->hash_next;
+    }
+    *link = dentry->hash_next;
+    dentry_lru_remove(dentry);
+    slab__free(&dentry_slab, dentry);
+    dentries_count--;
+}
+
+/**
+ * Record the result of a lookup of name in dir, replacing the previous one
+ */
+static void dentry_set(vnode_t* dir, const char* name, size_t length, bool negative, uint32_t ino) {
+    uint32_t hash = dentry_hash(dir->mount, dir->ino, name, length);
+    dentry_t* dentry = dentry_find(dir->mount, dir->ino, name, length, hash);
+    if (dentry != NULL) {
+        dentry_lru_remove(dentry);
+    }
+    else {
+        if (dentries_count >= VFS_DENTRY_CACHE_SIZE) {
+            dentry_drop(dentry_lru_head);
+        }
+        dentry = slab__alloc(&dentry_slab);
+        if (dentry == NULL) {
+            return;
+        }
+        dentry->mount = dir->mount;
+        dentry->dir_ino = dir->ino;
+        dentry->hash = hash;
+        dentry->length = (uint32_t) length;
+        memmove(dentry->name, name, length);
+        dentry_t** bucket = &dentry_buckets[hash % DENTRY_BUCKETS];
+        dentry->hash_next = *bucket;
+        *bucket = dentry;
+        dentries_count++;
+    }
+    dentry->negative = negative;
+    dentry->ino = ino;
+    dentry_lru_append(dentry);
+}
+
+/**
+ * Find name in dir through the dentry cache
+ * @returns 0 and the inode number in *ino, -1 if there is no such entry
+ */
+static int lookup_child(vnode_t* dir, const char* name, size_t length, uint32_t* ino) {
+    uint32_t hash = dentry_hash(dir->mount, dir->ino, name, length);
+    dentry_t* dentry = dentry_find(dir->mount, dir->ino, name, length, hash);
+    if (dentry != NULL) {
+        dentry_lru_remove(dentry);
+        dentry_lru_append(dentry);
+        if (dentry->negative) {
+            dentry_negative_hits++;
+            return -1;
+        }
+        dentry_hits++;
+        *ino = dentry->ino;
+        return 0;
+    }
+
+    dentry_misses++;
+    uint32_t found = 0;
+    int result = dir->ops->lookup(dir, name, length, &found);
+    dentry_set(dir, name, length, result != 0, found);
+    *ino = found;
+    return result;
+}
+
+/*
+ * Path resolution
+ */
+
+/**
+ * @returns the filesystem mounted on the inode, NULL if there is none
+ */
+static mount_t* mounted_on(mount_t* mount, uint32_t ino) {
+    for (size_t i = 0; i < VFS_MOUNTS_MAX; i++) {
+        if (mounts[i].used && mounts[i].parent == mount && mounts[i].covered_ino == ino) {
+            return &mounts[i];
+        }
+    }
+    return NULL;
+}
+
+static bool valid_name(const char* name, size_t length) {
+    if (length == 0 || length > VFS_NAME_MAX) {
+        return false;
+    }
+    return !(name[0] == '.' && (length == 1 || (length == 2 && name[1] == '.')));
+}
+
+/**
+ * Resolve an absolute path ("." is allowed, ".." is not)
+ * @returns the vnode, with a reference, NULL if it does not exist. If
+ * last is not NULL, the last component is not resolved: it is returned in
+ * *last and the vnode is its directory.
+ */
+static vnode_t* walk(const char* path, const char** last, size_t* last_length) {
+    if (root_mount == NULL || path[0] != '/') {
+        return NULL;
+    }
+    vnode_t* vnode = get_vnode(root_mount, root_mount->root_ino);
+    while (vnode != NULL) {
+        while (*path == '/') {
+            path++;
+        }
+        size_t length = 0;
+        while (path[length] != '\0' && path[length] != '/') {
+            length++;
+        }
+        if (length == 0) {
+            if (last != NULL) {
+                // No last component: "/"
+                put_vnode(vnode);
+                return NULL;
+            }
+            return vnode;
+        }
+        const char* next = path + length;
+        while (*next == '/') {
+            next++;
+        }
+        if (last != NULL && *next == '\0') {
+            *last = path;
+            *last_length = length;
+            return vnode;
+        }
+        if (length == 1 && path[0] == '.') {
+            path = next;
+            continue;
+        }
+
+        uint32_t ino;
+        if (!valid_name(path, length) || vnode->type != VNODE_DIRECTORY
+                || lookup_child(vnode, path, length, &ino) != 0) {
+            put_vnode(vnode);
+            return NULL;
+        }
+        vnode_t* child = get_vnode(vnode->mount, ino);
+        put_vnode(vnode);
+        // Go to the root of the filesystems mounted on the child
+        mount_t* mount;
+        while (child != NULL && (mount = mounted_on(child->mount, child->ino)) != NULL) {
+            put_vnode(child);
+            child = get_vnode(mount, mount->root_ino);
+        }
+        vnode = child;
+        path = next;
+    }
+    return NULL;
+}
+
+/**
+ * Create the file or directory at path, which must not exist
+ * @returns its vnode, with a reference, NULL on error
+ */
+static vnode_t* create(const char* path, vnode_type_t type) {
+    const char* name;
+    size_t length;
+    vnode_t* dir = walk(path, &name, &length);
+    if (dir == NULL) {
+        return NULL;
+    }
+    vnode_t* vnode = NULL;
+    uint32_t ino;
+    if (valid_name(name, length) && dir->type == VNODE_DIRECTORY && dir->ops->create != NULL
+            && lookup_child(dir, name, length, &ino) != 0
+            && dir->ops->create(dir, name, length, type, &ino) == 0) {
+        dentry_set(dir, name, length, false, ino);
+        vnode = get_vnode(dir->mount, ino);
+    }
+    put_vnode(dir);
+    return vnode;
+}
+
+/*
+ * Mounts and files
+ */
+
+int vfs__mount(const char* path, const filesystem_t* fs, void* source) {
+    if (strlen(path) >= VFS_PATH_MAX) {
+        return -1;
+    }
+    mutex__lock(&vfs_lock);
+    mount_t* mount = NULL;
+    for (size_t i = 0; i < VFS_MOUNTS_MAX && mount == NULL; i++) {
+        if (!mounts[i].used) {
+            mount = &mounts[i];
+        }
+    }
+    int result = -1;
+    if (mount != NULL) {
+        if (root_mount == NULL) {
+            // The root covers nothing
+            result = (path[0] == '/' && path[1] == '\0') ? 0 : -1;
+            mount->parent = NULL;
+            mount->covered_ino = 0;
+        }
+        else {
+            vnode_t* dir = walk(path, NULL, NULL);
+            if (dir != NULL) {
+                if (dir->type == VNODE_DIRECTORY) {
+                    mount->parent = dir->mount;
+                    mount->covered_ino = dir->ino;
+                    result = 0;
+                }
+                put_vnode(dir);
+            }
+        }
+    }
+    if (result == 0) {
+        memmove(mount->path, path, strlen(path) + 1);
+        mount->fs = fs;
+        mount->data = NULL;
+        result = fs->mount(mount, source);
+    }
+    if (result == 0) {
+        mount->used = true;
+        if (root_mount == NULL) {
+            root_mount = mount;
+        }
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+static file_t* get_file(int fd) {
+    if (fd < 0 || fd >= VFS_FILES_MAX || files[fd].vnode == NULL) {
+        return NULL;
+    }
+    return &files[fd];
+}
+
+int vfs__open(const char* path, uint32_t flags) {
+    mutex__lock(&vfs_lock);
+    vnode_t* vnode = walk(path, NULL, NULL);
+    if (vnode == NULL && (flags & VFS_O_CREATE)) {
+        vnode = create(path, VNODE_FILE);
+    }
+    int fd = -1;
+    if (vnode != NULL && !(vnode->type == VNODE_DIRECTORY && (flags & VFS_O_WRITE))) {
+        for (int i = 0; i < VFS_FILES_MAX && fd == -1; i++) {
+            if (files[i].vnode == NULL) {
+                files[i].vnode = vnode;
+                files[i].offset = 0;
+                files[i].flags = flags;
+                fd = i;
+            }
+        }
+    }
+    if (fd == -1 && vnode != NULL) {
+        put_vnode(vnode);
+    }
+    mutex__unlock(&vfs_lock);
+    return fd;
+}
+
+int32_t vfs__read(int fd, void* buffer, uint32_t size) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    int32_t result = -1;
+    if (file != NULL && (file->flags & VFS_O_READ) && file->vnode->type == VNODE_FILE) {
+        result = file->vnode->ops->read(file->vnode, file->offset, buffer, size);
+        if (result > 0) {
+            file->offset += (uint32_t) result;
+        }
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+int32_t vfs__write(int fd, const void* buffer, uint32_t size) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    int32_t result = -1;
+    if (file != NULL && (file->flags & VFS_O_WRITE) && file->vnode->ops->write != NULL) {
+        result = file->vnode->ops->write(file->vnode, file->offset, buffer, size);
+        if (result > 0) {
+            file->offset += (uint32_t) result;
+        }
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+int vfs__seek(int fd, uint32_t offset) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    if (file != NULL) {
+        file->offset = offset;
+    }
+    mutex__unlock(&vfs_lock);
+    return (file != NULL) ? 0 : -1;
+}
+
+int vfs__truncate(int fd, uint32_t size) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    int result = -1;
+    if (file != NULL && (file->flags & VFS_O_WRITE) && file->vnode->type == VNODE_FILE
+            && file->vnode->ops->truncate != NULL) {
+        result = file->vnode->ops->truncate(file->vnode, size);
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+int vfs__readdir(int fd, uint32_t index, char* name, size_t size) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    int result = -1;
+    if (file != NULL && file->vnode->type == VNODE_DIRECTORY) {
+        result = file->vnode->ops->readdir(file->vnode, index, name, size);
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+int vfs__close(int fd) {
+    mutex__lock(&vfs_lock);
+    file_t* file = get_file(fd);
+    if (file != NULL) {
+        put_vnode(file->vnode);
+        file->vnode = NULL;
+    }
+    mutex__unlock(&vfs_lock);
+    return (file != NULL) ? 0 : -1;
+}
+
+int vfs__mkdir(const char* path) {
+    mutex__lock(&vfs_lock);
+    vnode_t* vnode = create(path, VNODE_DIRECTORY);
+    if (vnode != NULL) {
+        put_vnode(vnode);
+    }
+    mutex__unlock(&vfs_lock);
+    return (vnode != NULL) ? 0 : -1;
+}
+
+int vfs__unlink(const char* path) {
+    mutex__lock(&vfs_lock);
+    const char* name;
+    size_t length;
+    vnode_t* dir = walk(path, &name, &length);
+    int result = -1;
+    uint32_t ino;
+    if (dir != NULL && valid_name(name, length) && dir->type == VNODE_DIRECTORY
+            && dir->ops->unlink != NULL && lookup_child(dir, name, length, &ino) == 0) {
+        vnode_t* vnode = find_vnode(dir->mount, ino);
+        bool busy = (vnode != NULL && vnode->refs > 0) || mounted_on(dir->mount, ino) != NULL;
+        if (!busy && dir->ops->unlink(dir, name, length) == 0) {
+            if (vnode != NULL) {
+                drop_vnode(vnode);
+            }
+            dentry_set(dir, name, length, true, 0);
+            result = 0;
+        }
+    }
+    if (dir != NULL) {
+        put_vnode(dir);
+    }
+    mutex__unlock(&vfs_lock);
+    return result;
+}
+
+void vfs__dump_stats() {
+    mutex__lock(&vfs_lock);
+    printf("dentry cache: %u entries, %u hits, %u negative hits, %u misses\n",
+            dentries_count, dentry_hits, dentry_negative_hits, dentry_misses);
+    printf("inode cache: %u inodes, %u hits, %u misses, %u evictions\n",
+            inodes_count, inode_hits, inode_misses, inode_evictions);
+    mutex__unlock(&vfs_lock);
+}
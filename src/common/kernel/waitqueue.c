@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/waitqueue.h"
+#include "kernel/sched.h"
+#include "kernel/spinlock.h"
+
+static waiter_t* pop(waitqueue_t* wq);
+
+static waiter_t* pop(waitqueue_t* wq) {
+    waiter_t* waiter = wq->head;
+    if (waiter) {
+        wq->head = waiter->next;
+        if (!wq->head) {
+            wq->tail = NULL;
+        }
+        waiter->next = NULL;
+        waiter->queued = false;
+    }
+    return waiter;
+}
+
+void waitqueue__init(waitqueue_t* wq) {
+    spinlock__init(&wq->lock);
+    wq->head = NULL;
+    wq->tail = NULL;
+}
+
+void waitqueue__prepare(waitqueue_t* wq, waiter_t* waiter) {
+    uint32_t flags = spinlock__lock_irqsave(&wq->lock);
+    if (!waiter->queued) {
+        waiter->thread = sched__current();
+        waiter->next = NULL;
+        waiter->queued = true;
+        if (wq->tail) {
+            wq->tail->next = waiter;
+        }
+        else {
+            wq->head = waiter;
+        }
+        wq->tail = waiter;
+    }
+    waiter->thread->state = THREAD_BLOCKED;
+    spinlock__unlock_irqrestore(&wq->lock, flags);
+}
+
+void waitqueue__finish(waitqueue_t* wq, waiter_t* waiter) {
+    uint32_t flags = spinlock__lock_irqsave(&wq->lock);
+    if (waiter->queued) {
+        waiter_t** link = &wq->head;
+        waiter_t* prev = NULL;
+        while (*link != waiter) {
+            prev = *link;
+            link = &(*link)->next;
+        }
+        *link = waiter->next;
+        if (wq->tail == waiter) {
+            wq->tail = prev;
+        }
+        waiter->next = NULL;
+        waiter->queued = false;
+    }
+    spinlock__unlock_irqrestore(&wq->lock, flags);
+    sched__cancel_block();
+}
+
+bool waitqueue__wake_one(waitqueue_t* wq) {
+    uint32_t flags = spinlock__lock_irqsave(&wq->lock);
+    waiter_t* waiter = pop(wq);
+    if (waiter) {
+        sched__wake_up(waiter->thread);
+    }
+    spinlock__unlock_irqrestore(&wq->lock, flags);
+    return waiter != NULL;
+}
+
+size_t waitqueue__wake_all(waitqueue_t* wq) {
+    size_t count = 0;
+    uint32_t flags = spinlock__lock_irqsave(&wq->lock);
+    waiter_t* waiter;
+    while ((waiter = pop(wq)) != NULL) {
+        sched__wake_up(waiter->thread);
+        count++;
+    }
+    spinlock__unlock_irqrestore(&wq->lock, flags);
+    return count;
+}
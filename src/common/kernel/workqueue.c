@@ -0,0 +1,105 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/workqueue.h"
+#include "kernel/cpu.h"
+#include "kernel/spinlock.h"
+#include "libk/stdio.h"
+
+static work_t* queue_head;
+static work_t* queue_tail;
+static work_t* all_works;
+static bool running;
+static spinlock_t queue_lock = SPINLOCK_INIT;
+
+void workqueue__init_work(work_t* work, const char* name, work_func_t func, void* data) {
+    work->next = NULL;
+    work->name = name;
+    work->func = func;
+    work->data = data;
+    work->pending = false;
+    work->queued_at = 0;
+    work->runs = 0;
+    work->total_wait = 0;
+    work->max_wait = 0;
+
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    work->all_next = all_works;
+    all_works = work;
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+}
+
+bool workqueue__schedule(work_t* work) {
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    if (work->pending) {
+        spinlock__unlock_irqrestore(&queue_lock, flags);
+        return false;
+    }
+    work->pending = true;
+    work->queued_at = cpu__rdtsc();
+    work->next = NULL;
+    if (queue_tail) {
+        queue_tail->next = work;
+    }
+    else {
+        queue_head = work;
+    }
+    queue_tail = work;
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+    return true;
+}
+
+bool workqueue__pending() {
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    bool pending = queue_head != NULL;
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+    return pending;
+}
+
+void workqueue__run() {
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    // An interrupt which occurs while the queue is being drained, or another
+    // CPU, must not drain it again: its work items are picked up by the
+    // running loop.
+    if (running) {
+        spinlock__unlock_irqrestore(&queue_lock, flags);
+        return;
+    }
+    running = true;
+
+    while (queue_head) {
+        work_t* work = queue_head;
+        queue_head = work->next;
+        if (!queue_head) {
+            queue_tail = NULL;
+        }
+        work->next = NULL;
+        work->pending = false;
+
+        uint64_t wait = cpu__rdtsc() - work->queued_at;
+        work->runs++;
+        work->total_wait += wait;
+        if (wait > work->max_wait) {
+            work->max_wait = wait;
+        }
+
+        // Run the work item with interrupts enabled
+        spinlock__unlock(&queue_lock);
+        cpu__sti();
+        work->func(work->data);
+        cpu__cli();
+        spinlock__lock(&queue_lock);
+    }
+
+    running = false;
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+}
+
+void workqueue__dump_stats() {
+    printf("work item\truns\tavg wait\tmax wait (cycles)\n");
+    for (work_t* work = all_works; work != NULL; work = work->all_next) {
+        uint32_t avg = work->runs ? (uint32_t) (work->total_wait / work->runs) : 0;
+        printf("%s\t%u\t%u\t%u\n", work->name, work->runs, avg, (uint32_t) work->max_wait);
+    }
+}
@@ -16,6 +16,7 @@ struct bitset__struct {
 
 static inline size_t get_index(size_t);
 static inline size_t get_offset(size_t);
+static inline size_t get_length(bitset_t*);
 
 static inline size_t get_index(size_t index) {
     return index / ENTRY_SIZE; // each uint32_t value contains ENTRY_SIZE values
@@ -25,12 +26,16 @@ static inline size_t get_offset(size_t index) {
     return index % ENTRY_SIZE;
 }
 
+static inline size_t get_length(bitset_t* bitset) {
+    return (bitset->size + ENTRY_SIZE - 1) / ENTRY_SIZE;
+}
+
 int bitset__set(size_t index, bitset_t* bitset) {
     if (index >= bitset->size) {
         return -1;
     }
 
-    bitset->set[get_index(index)] |= (1 << get_offset(index));
+    bitset->set[get_index(index)] |= (1u << get_offset(index));
     return 0;
 }
 
@@ -39,7 +44,7 @@ int bitset__clear(size_t index, bitset_t* bitset) {
         return -1;
     }
 
-    bitset->set[get_index(index)] &= (0 << get_offset(index));
+    bitset->set[get_index(index)] &= ~(1u << get_offset(index));
     return 0;
 }
 
@@ -48,38 +53,54 @@ int bitset__test(size_t index, bitset_t* bitset) {
         return -1;
     }
 
-    return (bitset->set[get_index(index)] & (1 << get_offset(index))) ? 1 : 0;
+    return (bitset->set[get_index(index)] & (1u << get_offset(index))) ? 1 : 0;
 }
 
 int bitset__set_first_clear(bitset_t* bitset) {
-    size_t length = bitset->size / ENTRY_SIZE;
-    if (bitset->size % ENTRY_SIZE == 0) {
-        length++;
-    }
+    size_t length = get_length(bitset);
     for (size_t i = 0; i < length; i++) {
         if (bitset->set[i] == 0xffffffff) {
             // Nothing free, continue
             continue;
         }
 
-        for (size_t j = 0; j < ENTRY_SIZE; j++) {
-            if (!(bitset->set[i] & (1 << j))) {
-                // offset is clear
-                // Seat the corresponding dex
-                bitset__set(i * ENTRY_SIZE + j, bitset);
-                return (int) (i * ENTRY_SIZE + j); 
-            }
+        // Index of the lowest clear bit (bsf)
+        size_t index = i * ENTRY_SIZE + (size_t) __builtin_ctz(~bitset->set[i]);
+        if (index >= bitset->size) {
+            break;
+        }
+        bitset->set[i] |= (1u << get_offset(index));
+        return (int) index;
+    }
+
+    return -1;
+}
+
+int bitset__find_first_set(bitset_t* bitset) {
+    size_t length = get_length(bitset);
+    for (size_t i = 0; i < length; i++) {
+        if (bitset->set[i] == 0) {
+            continue;
         }
+
+        // Index of the lowest set bit (bsf)
+        size_t index = i * ENTRY_SIZE + (size_t) __builtin_ctz(bitset->set[i]);
+        return (index < bitset->size) ? (int) index : -1;
     }
 
     return -1;
 }
 
+void bitset__init(bitset_t* bitset, uint32_t* set, size_t size) {
+    bitset->set = set;
+    bitset->size = size;
+    memset(bitset->set, 0, sizeof(uint32_t) * get_length(bitset));
+}
+
 bitset_t* bitset__new(size_t size) {
     bitset_t* bitset = kmem__alloc(sizeof(bitset_t), 0);
-    bitset->size = size / ENTRY_SIZE + 1;
-    bitset->set = kmem__alloc(sizeof(uint32_t) * bitset->size, 0);
-    memset(bitset->set, 0, sizeof(uint32_t) * bitset->size);
+    uint32_t* set = kmem__alloc(sizeof(uint32_t) * ((size + ENTRY_SIZE - 1) / ENTRY_SIZE), 0);
+    bitset__init(bitset, set, size);
     return bitset;
 }
 
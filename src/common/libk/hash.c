@@ -0,0 +1,16 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "libk/hash.h"
+
+#define FNV_PRIME 16777619u
+
+uint32_t hash__fnv1a(uint32_t seed, const void* data, size_t size) {
+    const uint8_t* bytes = data;
+    uint32_t hash = seed;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
@@ -37,3 +37,14 @@ void* memset(void* ptr, int value, size_t num) {
     }
     return ptr;
 }
+
+int memcmp(const void* ptr1, const void* ptr2, size_t num) {
+    const uint8_t* p1 = (const uint8_t*) ptr1;
+    const uint8_t* p2 = (const uint8_t*) ptr2;
+    for (size_t i = 0; i < num; i++) {
+        if (p1[i] != p2[i]) {
+            return p1[i] < p2[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
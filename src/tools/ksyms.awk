@@ -0,0 +1,37 @@
+# Turn the output of "nm -n" on the kernel into the symbol table searched
+# by ksym__lookup (see common/kernel/ksym.c): the functions sorted by
+# address, each with the offset of its name in a string blob, and a last
+# entry for the end of the code (_kernel_text_end).
+
+BEGIN {
+    count = 0
+}
+
+$2 ~ /^[tTwW]$/ && $1 >= "c0000000" {
+    addresses[count] = $1
+    names[count] = ($3 == "_kernel_text_end") ? "" : $3
+    count++
+    if ($3 == "_kernel_text_end") {
+        exit
+    }
+}
+
+END {
+    print "\t.section .rodata"
+    print "\t.align 4"
+    print "\t.global ksym__table"
+    print "ksym__table:"
+    offset = 0
+    for (i = 0; i < count; i++) {
+        printf "\t.long 0x%s, %d\n", addresses[i], offset
+        offset += length(names[i]) + 1
+    }
+    print "\t.global ksym__count"
+    print "ksym__count:"
+    printf "\t.long %d\n", count
+    print "\t.global ksym__names"
+    print "ksym__names:"
+    for (i = 0; i < count; i++) {
+        printf "\t.asciz \"%s\"\n", names[i]
+    }
+}
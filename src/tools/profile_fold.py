@@ -0,0 +1,61 @@
+#!/usr/bin/env python3
+"""
+Fold the samples dumped by profiler__dump into the "folded stacks" format
+of flame graph tools (one "caller;callee;... count" line per stack):
+
+    tools/profile_fold.py os.bin serial.log | flamegraph.pl > profile.svg
+
+Addresses are resolved with the symbols of the kernel binary, read by nm
+(set NM to use another one, e.g. i386-elf-nm).
+"""
+
+import bisect
+import collections
+import os
+import subprocess
+import sys
+
+
+def read_symbols(binary):
+    nm = os.environ.get("NM", "nm")
+    output = subprocess.run([nm, "-n", binary], check=True, capture_output=True, text=True).stdout
+    addresses = []
+    names = []
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[1] in "tTwW":
+            addresses.append(int(fields[0], 16))
+            names.append(fields[2])
+    return addresses, names
+
+
+def resolve(symbols, address):
+    addresses, names = symbols
+    if address < 0xC0000000:
+        return "[user]"
+    index = bisect.bisect_right(addresses, address) - 1
+    return names[index] if index >= 0 else hex(address)
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: %s <kernel binary> <serial log>" % sys.argv[0])
+    symbols = read_symbols(sys.argv[1])
+    stacks = collections.Counter()
+    with open(sys.argv[2], errors="replace") as log:
+        for line in log:
+            fields = line.split()
+            if len(fields) < 3 or fields[0] != "sample":
+                continue
+            eip = int(fields[2], 16)
+            # Return addresses point after the call: step back into it
+            callers = [int(field, 16) - 1 for field in fields[3:]]
+            frames = [resolve(symbols, address) for address in reversed(callers)]
+            frames.append(resolve(symbols, eip))
+            stacks["cpu%s;%s" % (fields[1], ";".join(frames))] += 1
+    for stack, count in sorted(stacks.items()):
+        print("%s %d" % (stack, count))
+
+
+if __name__ == "__main__":
+    main()
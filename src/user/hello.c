@@ -0,0 +1,27 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/syscall.h"
+
+void _start(void);
+
+// 64 KiB of bss: only the pages which are touched get a frame
+static volatile uint32_t scratch[16 * 1024];
+static char message[] = "Hello from user mode, scratch[0] = 0\n";
+
+static int32_t syscall(uint32_t number, uint32_t arg1, uint32_t arg2, uint32_t arg3) {
+    int32_t result;
+    __asm__ __volatile__ ("int $0x80" : "=a" (result)
+            : "a" (number), "b" (arg1), "S" (arg2), "D" (arg3) : "memory");
+    return result;
+}
+
+void _start() {
+    scratch[0] = 3;
+    scratch[16 * 1024 - 1] = 4;
+    message[sizeof(message) - 3] = (char) ('0' + scratch[0] + scratch[16 * 1024 - 1]);
+    syscall(SYS_WRITE, (uint32_t) message, sizeof(message) - 1, 0);
+    syscall(SYS_EXIT, 0, 0, 0);
+    for (;;) {
+    }
+}
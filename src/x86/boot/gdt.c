@@ -1,6 +1,8 @@
 #include <stdint.h>
 #include <stddef.h>
 #include "boot/gdt.h"
+#include "kernel/percpu.h"
+#include "kernel/tss.h"
 
 struct gdt_entry {
     uint16_t limit_low; // The lower 16 bits of the limit 
@@ -25,7 +27,8 @@ static void gdt__set_entry(size_t index, uint32_t base, uint32_t limit,
 extern void gdt__flush(uint32_t);
 
 // Set 5 gdt entries : Null, Kernel:code, Kernel:data, User:code User:data
-#define GDT_SIZE 5
+// followed by the per-CPU segments and the TSS of each CPU
+#define GDT_SIZE (GDT_TSS_FIRST + MAX_CPUS)
 
 static gdt_entry_t gdt_entries[GDT_SIZE];
 static gdt_ptr_t gdt;
@@ -42,8 +45,35 @@ void gdt__init() {
     gdt__set_entry(2, 0, 0xfffff, 0x92, 0xc); // kernel data segment
     gdt__set_entry(3, 0, 0xfffff, 0xfa, 0xc); // user code segment
     gdt__set_entry(4, 0, 0xfffff, 0xf2, 0xc); // user data segment
+
+    // per-CPU data segments, byte granularity
+    percpu__init();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        gdt__set_entry(GDT_PERCPU_FIRST + i, (uint32_t) percpu__get(i),
+                sizeof(cpu_t) - 1, 0x92, 0x4);
+    }
+
+    // 32-bit available TSS, byte granularity
+    tss__init();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        gdt__set_entry(GDT_TSS_FIRST + i, (uint32_t) tss__get(i),
+                sizeof(tss_t) - 1, 0x89, 0x0);
+    }
     
     gdt__flush((uint32_t)&gdt);
+    gdt__load_percpu(0);
+    tss__load(0);
+}
+
+void gdt__load(uint32_t cpu_index) {
+    gdt__flush((uint32_t)&gdt);
+    gdt__load_percpu(cpu_index);
+    tss__load(cpu_index);
+}
+
+void gdt__load_percpu(uint32_t cpu_index) {
+    uint16_t selector = (uint16_t) PERCPU_SEG(cpu_index);
+    __asm__ __volatile__ ("movw %0, %%gs" : : "r" (selector) : "memory");
 }
 
 /**
@@ -3,7 +3,8 @@
 #include "boot/idt.h"
 #include "boot/gdt.h"
 #include "libk/string.h"
-#include "drivers/io.h"
+#include "kernel/pic.h"
+#include "kernel/interrupt_handlers.h"
 
 struct idt_entry {
     uint16_t base_low; // the lower 16 bits to the address to jump to
@@ -24,31 +25,13 @@ typedef struct idt_ptr idt_ptr_t;
 
 static void idt__set_entry(size_t index, uint32_t base, uint16_t sel,
         uint8_t flags);
-static void idt__pic_remap(uint8_t offset1, uint8_t offset2); 
 
 extern void idt__flush(uint32_t);
 extern void idt__sti(void);
 
 #define IDT_SIZE 256
 #define IDT_FLAGS 0x8E
-
-#define PIC1		0x20		/* IO base address for master PIC */
-#define PIC2		0xA0		/* IO base address for slave PIC */
-#define PIC1_COMMAND	PIC1
-#define PIC1_DATA	(PIC1+1)
-#define PIC2_COMMAND	PIC2
-#define PIC2_DATA	(PIC2+1)
-#define ICW1_ICW4	0x01		/* ICW4 (not) needed */
-#define ICW1_SINGLE	0x02		/* Single (cascade) mode */
-#define ICW1_INTERVAL4	0x04		/* Call address interval 4 (8) */
-#define ICW1_LEVEL	0x08		/* Level triggered (edge) mode */
-#define ICW1_INIT	0x10		/* Initialization - required! */
- 
-#define ICW4_8086	0x01		/* 8086/88 (MCS-80/85) mode */
-#define ICW4_AUTO	0x02		/* Auto (normal) EOI */
-#define ICW4_BUF_SLAVE	0x08		/* Buffered mode/slave */
-#define ICW4_BUF_MASTER	0x0C		/* Buffered mode/master */
-#define ICW4_SFNM	0x10		/* Special fully nested (not) */
+#define IDT_FLAGS_USER 0xEE // DPL 3: the gate can be used by int in user mode
 
 static idt_entry_t idt_entries[IDT_SIZE];
 static idt_ptr_t idt;
@@ -106,6 +89,12 @@ extern void irq12(void);
 extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
+extern void irq_spurious(void);
+extern void irq_lapic_timer(void);
+extern void irq_reschedule(void);
+extern void isr_bench_legacy(void);
+extern void isr_bench_lean(void);
+extern void isr_syscall(void);
 
 /**
  * Initialize the IDT table
@@ -152,7 +141,7 @@ void idt__init() {
     idt__set_entry(31, (uint32_t) isr31, KERN_CODE_SEG, IDT_FLAGS);
 
     // Remap the PIC
-    idt__pic_remap(0x20, 0x28);
+    pic__remap(0x20, 0x28);
 
     // Add IRQ handlers
     idt__set_entry(32, (uint32_t) irq0, KERN_CODE_SEG, IDT_FLAGS);
@@ -171,6 +160,18 @@ void idt__init() {
     idt__set_entry(45, (uint32_t) irq13, KERN_CODE_SEG, IDT_FLAGS);
     idt__set_entry(46, (uint32_t) irq14, KERN_CODE_SEG, IDT_FLAGS);
     idt__set_entry(47, (uint32_t) irq15, KERN_CODE_SEG, IDT_FLAGS);
+
+    // Interrupt round-trip benchmark
+    idt__set_entry(INT_BENCH_LEGACY, (uint32_t) isr_bench_legacy, KERN_CODE_SEG, IDT_FLAGS);
+    idt__set_entry(INT_BENCH_LEAN, (uint32_t) isr_bench_lean, KERN_CODE_SEG, IDT_FLAGS);
+
+    // System calls
+    idt__set_entry(SYSCALL_VECTOR, (uint32_t) isr_syscall, KERN_CODE_SEG, IDT_FLAGS_USER);
+
+    // Local APIC interrupts
+    idt__set_entry(IRQ_LAPIC_TIMER, (uint32_t) irq_lapic_timer, KERN_CODE_SEG, IDT_FLAGS);
+    idt__set_entry(IRQ_RESCHEDULE, (uint32_t) irq_reschedule, KERN_CODE_SEG, IDT_FLAGS);
+    idt__set_entry(IRQ_SPURIOUS, (uint32_t) irq_spurious, KERN_CODE_SEG, IDT_FLAGS);
     
     // Flush the idt table
     idt__flush((uint32_t)&idt);
@@ -179,6 +180,10 @@ void idt__init() {
     idt__sti();
 }
 
+void idt__load() {
+    idt__flush((uint32_t)&idt);
+}
+
 /**
  * Set the idt entry at the given index
  */
@@ -190,29 +195,3 @@ static void idt__set_entry(size_t index, uint32_t base, uint16_t sel,
     idt_entries[index].sel = sel;
     idt_entries[index].flags = flags;
 }
-
-static void idt__pic_remap(uint8_t offset1, uint8_t offset2) {
-    uint8_t a1, a2;
-    a1 = inb(PIC1_DATA); // save masks
-    a2 = inb(PIC2_DATA);
-
-    // start the init sequence in cascade mode
-    outb(PIC1_COMMAND, ICW1_INIT | ICW1_ICW4);
-    outb(PIC2_COMMAND, ICW1_INIT | ICW1_ICW4);
-
-    // ICW2 : Master PIC vector offset
-    outb(PIC1_DATA, offset1);
-    outb(PIC2_DATA, offset2);
-
-    // ICW3: tell Master PIC that there is a slave PIC at IRQ2 (0000 0100)
-    outb(PIC1_DATA, 4);
-    // ICW3: tell Slave PIC its cascade identity (0000 0010)
-    outb(PIC2_DATA, 2);
-
-    outb(PIC1_DATA, ICW4_8086);
-    outb(PIC2_DATA, ICW4_8086);
-
-    // Restore masks
-    outb(PIC1_DATA, a1);
-    outb(PIC2_DATA, a2);
-}
@@ -0,0 +1,16 @@
+#include <stdint.h>
+
+#include "drivers/debug_exit.h"
+#include "drivers/io.h"
+#include "kernel/cpu.h"
+
+#define DEBUG_EXIT_PORT 0xF4
+
+void debug_exit__exit(uint8_t code) {
+    outb(DEBUG_EXIT_PORT, code);
+    // Not running in QEMU, or without the device
+    cpu__cli();
+    for (;;) {
+        cpu__hlt();
+    }
+}
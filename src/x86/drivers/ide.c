@@ -0,0 +1,557 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/ide.h"
+#include "drivers/pci.h"
+#include "drivers/io.h"
+#include "kernel/block.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/mutex.h"
+#include "kernel/semaphore.h"
+#include "kernel/spinlock.h"
+#include "kernel/timer.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+
+#define SECTOR_SIZE 512
+#define CHANNELS 2
+#define DRIVES_PER_CHANNEL 2
+// Sectors per command: 64 KiB, described by at most 17 PRD entries
+#define MAX_SECTORS 128
+#define POLL_LIMIT 1000000
+#define TIMEOUT_MS 2000
+#define LBA28_LIMIT 0x10000000
+
+// Legacy (compatibility mode) resources
+#define PRIMARY_BASE 0x1F0
+#define PRIMARY_CONTROL 0x3F6
+#define PRIMARY_IRQ 14
+#define SECONDARY_BASE 0x170
+#define SECONDARY_CONTROL 0x376
+#define SECONDARY_IRQ 15
+
+// Command block registers, from the channel base
+#define ATA_DATA 0
+#define ATA_ERROR 1
+#define ATA_SECTOR_COUNT 2
+#define ATA_LBA_LOW 3
+#define ATA_LBA_MID 4
+#define ATA_LBA_HIGH 5
+#define ATA_DRIVE 6
+#define ATA_STATUS 7
+#define ATA_COMMAND 7
+
+// Control block register: alternate status when read, device control
+// when written
+#define ATA_CONTROL 0
+#define CONTROL_SOFT_RESET 0x4
+
+#define STATUS_BUSY 0x80
+#define STATUS_DRIVE_FAULT 0x20
+#define STATUS_DATA_REQUEST 0x08
+#define STATUS_ERROR 0x01
+
+#define DRIVE_LBA 0x40
+#define DRIVE_LEGACY 0xA0 // obsolete bits, still set by most drivers
+
+#define CMD_READ_SECTORS 0x20
+#define CMD_READ_SECTORS_EXT 0x24
+#define CMD_READ_DMA 0xC8
+#define CMD_READ_DMA_EXT 0x25
+#define CMD_WRITE_SECTORS 0x30
+#define CMD_WRITE_SECTORS_EXT 0x34
+#define CMD_WRITE_DMA 0xCA
+#define CMD_WRITE_DMA_EXT 0x35
+#define CMD_FLUSH_CACHE 0xE7
+#define CMD_FLUSH_CACHE_EXT 0xEA
+#define CMD_IDENTIFY 0xEC
+
+// IDENTIFY words
+#define ID_MODEL 27
+#define ID_MODEL_WORDS 20
+#define ID_CAPABILITIES 49
+#define ID_CAPABILITIES_DMA 0x100
+#define ID_SECTORS 60
+#define ID_COMMAND_SETS 83
+#define ID_COMMAND_SETS_LBA48 0x400
+#define ID_SECTORS_LBA48 100
+
+// Bus master registers, from the bus master base of the channel
+#define BM_COMMAND 0
+#define BM_STATUS 2
+#define BM_PRDT 4
+#define BM_COMMAND_START 0x1
+#define BM_COMMAND_TO_MEMORY 0x8 // device to memory, i.e. a disk read
+#define BM_STATUS_ERROR 0x2
+#define BM_STATUS_IRQ 0x4
+#define BM_BAR 4
+#define BM_CHANNEL_STRIDE 8
+
+#define PRD_MAX_BYTES 0x10000
+#define PRD_END 0x8000
+#define PRDT_ENTRIES (PAGE_SIZE / sizeof(prd_t))
+
+/*
+ * Physical region descriptor: a physically contiguous chunk of the
+ * transfer, which must not cross a 64 KiB boundary
+ */
+typedef struct {
+    uint32_t address;
+    uint16_t size; // 0 for 64 KiB
+    uint16_t flags;
+} __attribute__((packed)) prd_t;
+
+typedef struct {
+    uint16_t base;
+    uint16_t control;
+    uint16_t bus_master; // 0 without bus master DMA
+    uint8_t irq;
+    // One command at a time per channel
+    mutex_t lock;
+    // DMA completion, signaled by the IRQ handler or the time-out
+    semaphore_t done;
+    spinlock_t completion_lock;
+    bool waiting;
+    bool timed_out;
+    uint8_t status;
+    uint8_t bm_status;
+    timer_t timeout;
+    prd_t* prdt;
+    uint32_t prdt_phys;
+} channel_t;
+
+typedef struct {
+    channel_t* channel;
+    uint8_t number; // 0 for master, 1 for slave
+    bool lba48;
+    bool dma;
+    block_device_t device;
+} drive_t;
+
+static void delay(channel_t* channel);
+static int wait_ready(channel_t* channel);
+static int wait_data(channel_t* channel);
+static void select_drive(drive_t* drive, uint32_t lba);
+static void issue(drive_t* drive, uint32_t lba, uint32_t count, uint8_t command, uint8_t command_ext);
+static int build_prdt(channel_t* channel, const void* buffer, uint32_t size);
+static void complete(channel_t* channel, bool timed_out);
+static void timeout_callback(void* data);
+static int_result_t irq_handler(registers_t* regs);
+static void reset(channel_t* channel);
+static int dma_transfer(drive_t* drive, uint32_t lba, uint32_t count, bool write);
+static int pio_transfer(drive_t* drive, uint32_t lba, uint32_t count, void* buffer, bool write);
+static int flush(drive_t* drive);
+static int transfer(drive_t* drive, uint32_t lba, uint32_t count, void* buffer, bool write);
+static int read_blocks(block_device_t* device, uint32_t block, uint32_t count, void* buffer);
+static int write_blocks(block_device_t* device, uint32_t block, uint32_t count, const void* buffer);
+static void identify(drive_t* drive);
+static void init_channel(channel_t* channel, pci_device_t* controller, size_t index);
+
+static channel_t channels[CHANNELS];
+static drive_t drives[CHANNELS * DRIVES_PER_CHANNEL];
+
+/**
+ * Give the drive 400ns to update its status, by reading the alternate
+ * status register
+ */
+static void delay(channel_t* channel) {
+    for (size_t i = 0; i < 4; i++) {
+        inb((uint16_t) (channel->control + ATA_CONTROL));
+    }
+}
+
+static int wait_ready(channel_t* channel) {
+    for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+        uint8_t status = inb((uint16_t) (channel->base + ATA_STATUS));
+        if ((status & STATUS_BUSY) == 0) {
+            return (status & (STATUS_ERROR | STATUS_DRIVE_FAULT)) ? -1 : 0;
+        }
+    }
+    return -1;
+}
+
+static int wait_data(channel_t* channel) {
+    for (uint32_t i = 0; i < POLL_LIMIT; i++) {
+        uint8_t status = inb((uint16_t) (channel->base + ATA_STATUS));
+        if ((status & STATUS_BUSY) == 0) {
+            if (status & (STATUS_ERROR | STATUS_DRIVE_FAULT)) {
+                return -1;
+            }
+            if (status & STATUS_DATA_REQUEST) {
+                return 0;
+            }
+        }
+    }
+    return -1;
+}
+
+static void select_drive(drive_t* drive, uint32_t lba) {
+    // LBA28 commands take the 4 high bits of the address in the drive
+    // register
+    outb((uint16_t) (drive->channel->base + ATA_DRIVE),
+            (uint8_t) (DRIVE_LEGACY | DRIVE_LBA | drive->number << 4 | ((lba >> 24) & 0xF)));
+    delay(drive->channel);
+}
+
+/**
+ * Send a read or write command, as LBA48 only when the range needs it
+ */
+static void issue(drive_t* drive, uint32_t lba, uint32_t count, uint8_t command, uint8_t command_ext) {
+    uint16_t base = drive->channel->base;
+    bool lba48 = drive->lba48 && lba + count > LBA28_LIMIT;
+    select_drive(drive, lba48 ? 0 : lba);
+    wait_ready(drive->channel);
+    if (lba48) {
+        // High order bytes first, the registers are two bytes deep
+        outb((uint16_t) (base + ATA_SECTOR_COUNT), (uint8_t) (count >> 8));
+        outb((uint16_t) (base + ATA_LBA_LOW), (uint8_t) (lba >> 24));
+        outb((uint16_t) (base + ATA_LBA_MID), 0);
+        outb((uint16_t) (base + ATA_LBA_HIGH), 0);
+    }
+    // A count of 0 means 256 sectors in LBA28
+    outb((uint16_t) (base + ATA_SECTOR_COUNT), (uint8_t) count);
+    outb((uint16_t) (base + ATA_LBA_LOW), (uint8_t) lba);
+    outb((uint16_t) (base + ATA_LBA_MID), (uint8_t) (lba >> 8));
+    outb((uint16_t) (base + ATA_LBA_HIGH), (uint8_t) (lba >> 16));
+    outb((uint16_t) (base + ATA_COMMAND), lba48 ? command_ext : command);
+}
+
+/**
+ * Describe buffer in the PRD table of the channel, merging the pages which
+ * are physically contiguous
+ * @returns 0 if success, -1 if the buffer cannot be used for DMA
+ */
+static int build_prdt(channel_t* channel, const void* buffer, uint32_t size) {
+    if ((uint32_t) buffer % 2 != 0) {
+        return -1;
+    }
+    size_t entries = 0;
+    uint32_t virt = (uint32_t) buffer;
+    uint32_t end = virt + size;
+    while (virt < end) {
+        uint32_t phys = vmm__get_physical((void*) virt);
+        if (phys == 0) {
+            return -1;
+        }
+        uint32_t length = PAGE_SIZE - virt % PAGE_SIZE;
+        if (length > end - virt) {
+            length = end - virt;
+        }
+        prd_t* last = (entries > 0) ? &channel->prdt[entries - 1] : NULL;
+        uint32_t last_size = (last != NULL && last->size == 0) ? PRD_MAX_BYTES : (last ? last->size : 0);
+        if (last != NULL && last->address + last_size == phys
+                && (last->address & ~(uint32_t) (PRD_MAX_BYTES - 1))
+                    == ((phys + length - 1) & ~(uint32_t) (PRD_MAX_BYTES - 1))) {
+            // Same 64 KiB window: at most 64 KiB, where 0 stands for 64 KiB
+            last->size = (uint16_t) (last_size + length);
+        }
+        else {
+            if (entries == PRDT_ENTRIES) {
+                return -1;
+            }
+            channel->prdt[entries].address = phys;
+            channel->prdt[entries].size = (uint16_t) length;
+            channel->prdt[entries].flags = 0;
+            entries++;
+        }
+        virt += length;
+    }
+    channel->prdt[entries - 1].flags = PRD_END;
+    return 0;
+}
+
+/**
+ * End the wait of the thread which started the DMA transfer
+ */
+static void complete(channel_t* channel, bool timed_out) {
+    uint32_t flags = spinlock__lock_irqsave(&channel->completion_lock);
+    if (channel->waiting) {
+        channel->waiting = false;
+        channel->timed_out = timed_out;
+        semaphore__up(&channel->done);
+    }
+    spinlock__unlock_irqrestore(&channel->completion_lock, flags);
+}
+
+static void timeout_callback(void* data) {
+    complete(data, true);
+}
+
+static int_result_t irq_handler(registers_t* regs) {
+    int_result_t result = INT_UNHANDLED;
+    // Both channels share the IRQ in native mode
+    for (size_t i = 0; i < CHANNELS; i++) {
+        channel_t* channel = &channels[i];
+        if (channel->base == 0 || (uint32_t) (IRQ0 + channel->irq) != regs->int_no) {
+            continue;
+        }
+        if (channel->bus_master != 0) {
+            uint8_t bm_status = inb((uint16_t) (channel->bus_master + BM_STATUS));
+            if ((bm_status & BM_STATUS_IRQ) == 0) {
+                continue;
+            }
+            // Writing 1 clears the interrupt and error bits
+            outb((uint16_t) (channel->bus_master + BM_STATUS), bm_status);
+            channel->bm_status = bm_status;
+        }
+        // Reading the status acknowledges the interrupt of the drive. PIO
+        // commands are polled: their interrupts only need this.
+        channel->status = inb((uint16_t) (channel->base + ATA_STATUS));
+        complete(channel, false);
+        result = INT_HANDLED;
+    }
+    return result;
+}
+
+/**
+ * Bring the drives of the channel back to a known state, after a command
+ * which never completed
+ */
+static void reset(channel_t* channel) {
+    outb((uint16_t) (channel->control + ATA_CONTROL), CONTROL_SOFT_RESET);
+    delay(channel);
+    outb((uint16_t) (channel->control + ATA_CONTROL), 0);
+    delay(channel);
+    wait_ready(channel);
+}
+
+/**
+ * Transfer count sectors through the PRD table, which has already been
+ * built, and sleep until the completion interrupt
+ */
+static int dma_transfer(drive_t* drive, uint32_t lba, uint32_t count, bool write) {
+    channel_t* channel = drive->channel;
+    uint16_t bm = channel->bus_master;
+    uint8_t direction = write ? 0 : BM_COMMAND_TO_MEMORY;
+    outb((uint16_t) (bm + BM_COMMAND), direction);
+    outl((uint16_t) (bm + BM_PRDT), channel->prdt_phys);
+    outb((uint16_t) (bm + BM_STATUS), inb((uint16_t) (bm + BM_STATUS)) | BM_STATUS_ERROR | BM_STATUS_IRQ);
+
+    uint32_t flags = spinlock__lock_irqsave(&channel->completion_lock);
+    channel->waiting = true;
+    channel->timed_out = false;
+    channel->status = 0;
+    channel->bm_status = 0;
+    spinlock__unlock_irqrestore(&channel->completion_lock, flags);
+    timer__add(&channel->timeout, timer__now() + timer__ms_to_ticks(TIMEOUT_MS), timeout_callback, channel);
+
+    issue(drive, lba, count, write ? CMD_WRITE_DMA : CMD_READ_DMA, write ? CMD_WRITE_DMA_EXT : CMD_READ_DMA_EXT);
+    outb((uint16_t) (bm + BM_COMMAND), direction | BM_COMMAND_START);
+
+    semaphore__down(&channel->done);
+    timer__cancel(&channel->timeout);
+    outb((uint16_t) (bm + BM_COMMAND), direction);
+
+    if (channel->timed_out) {
+        debug("IDE: %s DMA time-out at sector %u", drive->device.name, lba);
+        reset(channel);
+        return -1;
+    }
+    if ((channel->bm_status & BM_STATUS_ERROR) || (channel->status & (STATUS_ERROR | STATUS_DRIVE_FAULT))) {
+        debug("IDE: %s DMA error at sector %u, status 0x%x", drive->device.name, lba, channel->status);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Transfer count sectors by programmed I/O, polling the status. Each
+ * sector is moved by a single rep insw/outsw.
+ */
+static int pio_transfer(drive_t* drive, uint32_t lba, uint32_t count, void* buffer, bool write) {
+    channel_t* channel = drive->channel;
+    issue(drive, lba, count, write ? CMD_WRITE_SECTORS : CMD_READ_SECTORS,
+            write ? CMD_WRITE_SECTORS_EXT : CMD_READ_SECTORS_EXT);
+    uint16_t* words = buffer;
+    for (uint32_t i = 0; i < count; i++) {
+        if (wait_data(channel) != 0) {
+            debug("IDE: %s PIO error at sector %u", drive->device.name, lba + i);
+            return -1;
+        }
+        if (write) {
+            outsw((uint16_t) (channel->base + ATA_DATA), words, SECTOR_SIZE / 2);
+        }
+        else {
+            insw((uint16_t) (channel->base + ATA_DATA), words, SECTOR_SIZE / 2);
+        }
+        words += SECTOR_SIZE / 2;
+        delay(channel);
+    }
+    return write ? wait_ready(channel) : 0;
+}
+
+static int flush(drive_t* drive) {
+    select_drive(drive, 0);
+    outb((uint16_t) (drive->channel->base + ATA_COMMAND), drive->lba48 ? CMD_FLUSH_CACHE_EXT : CMD_FLUSH_CACHE);
+    delay(drive->channel);
+    return wait_ready(drive->channel);
+}
+
+static int transfer(drive_t* drive, uint32_t lba, uint32_t count, void* buffer, bool write) {
+    channel_t* channel = drive->channel;
+    int result = 0;
+    mutex__lock(&channel->lock);
+    while (count > 0 && result == 0) {
+        uint32_t sectors = (count < MAX_SECTORS) ? count : MAX_SECTORS;
+        if (drive->dma && build_prdt(channel, buffer, sectors * SECTOR_SIZE) == 0) {
+            result = dma_transfer(drive, lba, sectors, write);
+            if (result != 0 && channel->timed_out) {
+                // The completion interrupt is not delivered: stay with PIO
+                debug("IDE: %s falls back to PIO", drive->device.name);
+                drive->dma = false;
+                result = pio_transfer(drive, lba, sectors, buffer, write);
+            }
+        }
+        else {
+            result = pio_transfer(drive, lba, sectors, buffer, write);
+        }
+        lba += sectors;
+        count -= sectors;
+        buffer = (char*) buffer + sectors * SECTOR_SIZE;
+    }
+    if (write && result == 0) {
+        result = flush(drive);
+    }
+    mutex__unlock(&channel->lock);
+    return result;
+}
+
+static int read_blocks(block_device_t* device, uint32_t block, uint32_t count, void* buffer) {
+    return transfer(device->data, block, count, buffer, false);
+}
+
+static int write_blocks(block_device_t* device, uint32_t block, uint32_t count, const void* buffer) {
+    // The buffer is only read, even though transfer takes it mutable
+    return transfer(device->data, block, count, (void*) buffer, true);
+}
+
+/**
+ * Identify the drive, and register it if it is an ATA disk (ATAPI drives
+ * are ignored)
+ */
+static void identify(drive_t* drive) {
+    channel_t* channel = drive->channel;
+    uint16_t base = channel->base;
+    select_drive(drive, 0);
+    outb((uint16_t) (base + ATA_SECTOR_COUNT), 0);
+    outb((uint16_t) (base + ATA_LBA_LOW), 0);
+    outb((uint16_t) (base + ATA_LBA_MID), 0);
+    outb((uint16_t) (base + ATA_LBA_HIGH), 0);
+    outb((uint16_t) (base + ATA_COMMAND), CMD_IDENTIFY);
+    delay(channel);
+    uint8_t status = inb((uint16_t) (base + ATA_STATUS));
+    if (status == 0 || status == 0xFF) {
+        // No drive, or no channel at all (floating bus)
+        return;
+    }
+    for (uint32_t i = 0; i < POLL_LIMIT && (inb((uint16_t) (base + ATA_STATUS)) & STATUS_BUSY); i++) {
+    }
+    if (inb((uint16_t) (base + ATA_LBA_MID)) != 0 || inb((uint16_t) (base + ATA_LBA_HIGH)) != 0) {
+        // ATAPI or SATA signature
+        return;
+    }
+    if (wait_data(channel) != 0) {
+        return;
+    }
+    uint16_t id[256];
+    insw((uint16_t) (base + ATA_DATA), id, 256);
+
+    drive->lba48 = (id[ID_COMMAND_SETS] & ID_COMMAND_SETS_LBA48) != 0;
+    uint32_t sectors = id[ID_SECTORS] | (uint32_t) id[ID_SECTORS + 1] << 16;
+    if (drive->lba48) {
+        sectors = id[ID_SECTORS_LBA48] | (uint32_t) id[ID_SECTORS_LBA48 + 1] << 16;
+        if (id[ID_SECTORS_LBA48 + 2] != 0 || id[ID_SECTORS_LBA48 + 3] != 0) {
+            // Block numbers are 32 bits
+            sectors = 0xFFFFFFFF;
+        }
+    }
+    if (sectors == 0) {
+        return;
+    }
+    drive->dma = channel->bus_master != 0 && (id[ID_CAPABILITIES] & ID_CAPABILITIES_DMA) != 0;
+
+    // The model string is stored with the bytes of each word swapped
+    char model[ID_MODEL_WORDS * 2 + 1];
+    for (size_t i = 0; i < ID_MODEL_WORDS; i++) {
+        model[2 * i] = (char) (id[ID_MODEL + i] >> 8);
+        model[2 * i + 1] = (char) id[ID_MODEL + i];
+    }
+    size_t length = ID_MODEL_WORDS * 2;
+    while (length > 0 && model[length - 1] == ' ') {
+        length--;
+    }
+    model[length] = '\0';
+
+    size_t index = (size_t) (drive - drives);
+    block_device_t* device = &drive->device;
+    device->name[0] = 'h';
+    device->name[1] = 'd';
+    device->name[2] = (char) ('a' + index);
+    device->name[3] = '\0';
+    device->block_size = SECTOR_SIZE;
+    device->blocks = sectors;
+    device->read = read_blocks;
+    device->write = write_blocks;
+    device->data = drive;
+    debug("IDE: %s \"%s\", %u sectors, %s%s", device->name, model, sectors,
+            drive->dma ? "DMA" : "PIO", drive->lba48 ? ", LBA48" : "");
+    block__register(device);
+}
+
+static void init_channel(channel_t* channel, pci_device_t* controller, size_t index) {
+    // In native mode, the channel resources are PCI ones. prog_if bit 0
+    // is the mode of the primary channel, bit 2 of the secondary one.
+    if (controller != NULL && (controller->prog_if & (1 << (2 * index)))) {
+        channel->base = (uint16_t) pci__bar(controller, 2 * index);
+        channel->control = (uint16_t) (pci__bar(controller, 2 * index + 1) + 2);
+        channel->irq = controller->irq;
+    }
+    else {
+        channel->base = (index == 0) ? PRIMARY_BASE : SECONDARY_BASE;
+        channel->control = (index == 0) ? PRIMARY_CONTROL : SECONDARY_CONTROL;
+        channel->irq = (index == 0) ? PRIMARY_IRQ : SECONDARY_IRQ;
+    }
+    if (controller != NULL && pci__bar_is_io(controller, BM_BAR) && pci__bar(controller, BM_BAR) != 0) {
+        channel->bus_master = (uint16_t) (pci__bar(controller, BM_BAR) + BM_CHANNEL_STRIDE * index);
+        // A single frame holds the table: aligned, and within a 64 KiB
+        // window as the controller requires
+        channel->prdt_phys = pmm__alloc_frame();
+        channel->prdt = vmm__map_physical(channel->prdt_phys, PAGE_SIZE, PAGE_WRITABLE);
+    }
+    mutex__init(&channel->lock, false);
+    semaphore__init(&channel->done, 0);
+    spinlock__init(&channel->completion_lock);
+    timer__init_timer(&channel->timeout);
+
+    if (channel->irq >= 16) {
+        // Not an ISA IRQ: no completion interrupt, PIO only
+        channel->bus_master = 0;
+    }
+    else {
+        interrupt_handlers__register((uint8_t) (IRQ0 + channel->irq), irq_handler);
+    }
+    // Enable the interrupts of the drives (nIEN cleared)
+    outb((uint16_t) (channel->control + ATA_CONTROL), 0);
+
+    for (uint8_t number = 0; number < DRIVES_PER_CHANNEL; number++) {
+        drive_t* drive = &drives[index * DRIVES_PER_CHANNEL + number];
+        drive->channel = channel;
+        drive->number = number;
+        identify(drive);
+    }
+}
+
+void ide__init() {
+    pci_device_t* controller = pci__find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, NULL);
+    if (controller != NULL) {
+        pci__enable(controller, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    }
+    else {
+        debug("IDE: no PCI controller, probing the legacy ports without DMA");
+    }
+    for (size_t i = 0; i < CHANNELS; i++) {
+        init_channel(&channels[i], controller, i);
+    }
+}
@@ -10,3 +10,37 @@ uint8_t inb(uint16_t port) {
     __asm__ __volatile__ ("inb %1, %0" : "=a" (ret) : "dN" (port));
     return ret;
 }
+
+void outw(uint16_t port, uint16_t data) {
+    __asm__ __volatile__ ("outw %1, %0" : : "dN" (port), "a" (data));
+}
+
+uint16_t inw(uint16_t port) {
+    uint16_t ret;
+    __asm__ __volatile__ ("inw %1, %0" : "=a" (ret) : "dN" (port));
+    return ret;
+}
+
+void outl(uint16_t port, uint32_t data) {
+    __asm__ __volatile__ ("outl %1, %0" : : "dN" (port), "a" (data));
+}
+
+uint32_t inl(uint16_t port) {
+    uint32_t ret;
+    __asm__ __volatile__ ("inl %1, %0" : "=a" (ret) : "dN" (port));
+    return ret;
+}
+
+void insw(uint16_t port, void* buffer, size_t count) {
+    __asm__ __volatile__ ("rep insw"
+            : "+D" (buffer), "+c" (count)
+            : "d" (port)
+            : "memory");
+}
+
+void outsw(uint16_t port, const void* buffer, size_t count) {
+    __asm__ __volatile__ ("rep outsw"
+            : "+S" (buffer), "+c" (count)
+            : "d" (port)
+            : "memory");
+}
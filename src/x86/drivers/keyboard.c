@@ -7,6 +7,9 @@
 #include "kernel/interrupt_handlers.h"
 #include "drivers/io.h"
 #include "libk/stdio.h"
+#include "kernel/workqueue.h"
+#include "kernel/waitqueue.h"
+#include "kernel/sched.h"
 
 #define KEYBOARD_READ_PORT 0x60
 
@@ -16,14 +19,30 @@
 #define ALT_LEFT 0x38
 #define CAPS_LOCK 0x3A
 #define ENTER_ASCII_CODE 13
+#define SCANCODE_BUFFER_SIZE 64
+#define CHAR_BUFFER_SIZE 128
 
-void keyboard_callback(registers_t* regs);
+int_result_t keyboard_callback(registers_t* regs);
+static void keyboard_bottom_half(void* data);
+static void handle_scancode(uint8_t value);
 
 static bool shift = false;
 static bool alt = false;
 static bool caps_lock = false;
 static bool control = false;
 
+// Scancodes read by the IRQ handler, waiting to be decoded by the bottom half
+static uint8_t scancodes[SCANCODE_BUFFER_SIZE];
+static volatile uint8_t scancodes_head;
+static volatile uint8_t scancodes_tail;
+static work_t keyboard_work;
+
+// Decoded characters, waiting to be read by keyboard__getchar
+static char chars[CHAR_BUFFER_SIZE];
+static volatile uint32_t chars_head;
+static volatile uint32_t chars_tail;
+static waitqueue_t readers = WAITQUEUE_INIT;
+
 // TODO : keyboard layout should be initialized by higher level component
 char set1_to_ascii[] = {
     0, 27, // escape
@@ -35,10 +54,30 @@ char set1_to_ascii[] = {
 
 size_t set1_to_ascii_size = sizeof(set1_to_ascii);
 
-void keyboard_callback(registers_t* regs) {
+int_result_t keyboard_callback(registers_t* regs) {
+    // Only read the scancode here, decoding and echoing it is deferred
+    uint8_t value = inb(KEYBOARD_READ_PORT);
+    uint8_t next = (uint8_t) ((scancodes_head + 1) % SCANCODE_BUFFER_SIZE);
+    if (next != scancodes_tail) {
+        scancodes[scancodes_head] = value;
+        scancodes_head = next;
+    }
+    workqueue__schedule(&keyboard_work);
+    return INT_HANDLED;
+}
+
+static void keyboard_bottom_half(void* data) {
+    (void) data;
+    while (scancodes_tail != scancodes_head) {
+        uint8_t value = scancodes[scancodes_tail];
+        scancodes_tail = (uint8_t) ((scancodes_tail + 1) % SCANCODE_BUFFER_SIZE);
+        handle_scancode(value);
+    }
+}
+
+static void handle_scancode(uint8_t value) {
     // TODO : keyboard driver should take a higher level handler and gives
     // it a structure entry representing the key combination
-    uint8_t value = inb(KEYBOARD_READ_PORT);
     bool pressed = true;
     if (value & 0x80) {
         // The key has been released
@@ -81,12 +120,26 @@ void keyboard_callback(registers_t* regs) {
             // printable character
             if ((out >= 33 && out <= 126) || out == ' ' || out == '\n' || out == '\b' || out == '\t') {
                 putchar(out);
+                uint32_t next = (chars_head + 1) % CHAR_BUFFER_SIZE;
+                if (next != chars_tail) {
+                    chars[chars_head] = out;
+                    chars_head = next;
+                    waitqueue__wake_one(&readers);
+                }
             }
         }    
     }
     
 }
 
+char keyboard__getchar() {
+    WAITQUEUE_WAIT(&readers, chars_tail != chars_head);
+    char c = chars[chars_tail];
+    chars_tail = (chars_tail + 1) % CHAR_BUFFER_SIZE;
+    return c;
+}
+
 void keyboard__init() {
+    workqueue__init_work(&keyboard_work, "keyboard", keyboard_bottom_half, NULL);
     interrupt_handlers__register(IRQ1, keyboard_callback);
 }
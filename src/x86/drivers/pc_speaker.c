@@ -1,22 +1,96 @@
 #include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 #include "drivers/pc_speaker.h"
 #include "drivers/io.h"
 #include "drivers/pit.h"
+#include "kernel/timer.h"
+#include "kernel/spinlock.h"
 
 #define PC_SPEAKER_PORT 0x61
 
+typedef struct {
+    uint32_t frequency;
+    uint32_t ticks;
+} note_t;
+
+static void next_note(void* data);
+static void play_next(void* data);
+
+// Notes waiting to be played, as a ring buffer. The timer interrupt may
+// run on another CPU than pc_speaker__play_sequence.
+static spinlock_t queue_lock = SPINLOCK_INIT;
+static note_t notes_queue[PC_SPEAKER_MAX_NOTES];
+static size_t queue_head;
+static size_t queue_count;
+static bool playing;
+static timer_t note_timer;
+
 void pc_speaker__play(uint32_t frequency) {
+    uint32_t flags = pit__ch2_lock();
     pit__set_frequency(PIT_CH2, frequency);
     uint8_t tmp = inb(PC_SPEAKER_PORT);
     if (tmp != (tmp | 3)) {
         outb(PC_SPEAKER_PORT, tmp | 3);
     }
+    pit__ch2_unlock(flags);
 }
 
 void pc_speaker__stop() {
+    uint32_t flags = pit__ch2_lock();
     uint8_t tmp = inb(PC_SPEAKER_PORT) & 0xfc;
  
  	outb(PC_SPEAKER_PORT, tmp);
+    pit__ch2_unlock(flags);
+}
+
+// Called from the timer interrupt at the end of each note
+static void next_note(void* data) {
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    play_next(data);
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+}
+
+// Start the next note of the queue, with queue_lock held
+static void play_next(void* data) {
+    if (queue_count == 0) {
+        pc_speaker__stop();
+        playing = false;
+        return;
+    }
+
+    note_t* note = &notes_queue[queue_head];
+    queue_head = (queue_head + 1) % PC_SPEAKER_MAX_NOTES;
+    queue_count--;
+
+    if (note->frequency) {
+        pc_speaker__play(note->frequency);
+    }
+    else {
+        pc_speaker__stop();
+    }
+    timer__add(&note_timer, timer__now() + note->ticks, next_note, data);
 }
 
+size_t pc_speaker__play_sequence(const uint32_t* notes, const uint32_t* durations, size_t count) {
+    uint32_t flags = spinlock__lock_irqsave(&queue_lock);
+    size_t queued = 0;
+    while (queued < count && queue_count < PC_SPEAKER_MAX_NOTES) {
+        note_t* note = &notes_queue[(queue_head + queue_count) % PC_SPEAKER_MAX_NOTES];
+        note->frequency = notes[queued];
+        note->ticks = timer__ms_to_ticks(durations[queued]);
+        if (note->ticks == 0) {
+            note->ticks = 1;
+        }
+        queue_count++;
+        queued++;
+    }
+
+    if (!playing && queue_count) {
+        playing = true;
+        play_next(NULL);
+    }
+    spinlock__unlock_irqrestore(&queue_lock, flags);
+    return queued;
+}
@@ -0,0 +1,141 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/pci.h"
+#include "drivers/io.h"
+#include "kernel/spinlock.h"
+#include "kernel/utils.h"
+
+#define CONFIG_ADDRESS 0xCF8
+#define CONFIG_DATA 0xCFC
+#define CONFIG_ENABLE 0x80000000
+#define BUSES 256
+#define SLOTS 32
+#define FUNCTIONS 8
+#define HEADER_MULTIFUNCTION 0x80
+#define BAR_IO 0x1
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset);
+static void config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t value);
+static void probe(uint8_t bus, uint8_t slot, uint8_t function);
+
+static pci_device_t devices[PCI_DEVICES_MAX];
+static size_t devices_count;
+// The address and data ports are a pair: accesses must not interleave
+static spinlock_t config_lock = SPINLOCK_INIT;
+
+static uint32_t config_read(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset) {
+    uint32_t address = CONFIG_ENABLE | (uint32_t) bus << 16 | (uint32_t) slot << 11
+        | (uint32_t) function << 8 | (offset & 0xFC);
+    uint32_t flags = spinlock__lock_irqsave(&config_lock);
+    outl(CONFIG_ADDRESS, address);
+    uint32_t value = inl(CONFIG_DATA);
+    spinlock__unlock_irqrestore(&config_lock, flags);
+    return value;
+}
+
+static void config_write(uint8_t bus, uint8_t slot, uint8_t function, uint8_t offset, uint32_t value) {
+    uint32_t address = CONFIG_ENABLE | (uint32_t) bus << 16 | (uint32_t) slot << 11
+        | (uint32_t) function << 8 | (offset & 0xFC);
+    uint32_t flags = spinlock__lock_irqsave(&config_lock);
+    outl(CONFIG_ADDRESS, address);
+    outl(CONFIG_DATA, value);
+    spinlock__unlock_irqrestore(&config_lock, flags);
+}
+
+static void probe(uint8_t bus, uint8_t slot, uint8_t function) {
+    uint32_t id = config_read(bus, slot, function, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF) {
+        return;
+    }
+    if (devices_count == PCI_DEVICES_MAX) {
+        debug("PCI: too many devices, %u:%u.%u ignored", bus, slot, function);
+        return;
+    }
+    uint32_t class = config_read(bus, slot, function, PCI_CLASS);
+    pci_device_t* device = &devices[devices_count++];
+    device->bus = bus;
+    device->slot = slot;
+    device->function = function;
+    device->vendor_id = (uint16_t) id;
+    device->device_id = (uint16_t) (id >> 16);
+    device->class_code = (uint8_t) (class >> 24);
+    device->subclass = (uint8_t) (class >> 16);
+    device->prog_if = (uint8_t) (class >> 8);
+    device->irq = (uint8_t) config_read(bus, slot, function, PCI_INTERRUPT_LINE);
+    debug("PCI: %u:%u.%u %x:%x class %x.%x irq %u", bus, slot, function,
+            device->vendor_id, device->device_id, device->class_code, device->subclass, device->irq);
+}
+
+void pci__init() {
+    // Brute force scan: cheap enough, and it does not depend on bridges
+    // being numbered in order
+    for (uint32_t bus = 0; bus < BUSES; bus++) {
+        for (uint8_t slot = 0; slot < SLOTS; slot++) {
+            if ((config_read((uint8_t) bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) {
+                continue;
+            }
+            probe((uint8_t) bus, slot, 0);
+            uint32_t header = config_read((uint8_t) bus, slot, 0, PCI_HEADER_TYPE) >> 16;
+            if (header & HEADER_MULTIFUNCTION) {
+                for (uint8_t function = 1; function < FUNCTIONS; function++) {
+                    probe((uint8_t) bus, slot, function);
+                }
+            }
+        }
+    }
+    debug("PCI: %u devices", devices_count);
+}
+
+size_t pci__count() {
+    return devices_count;
+}
+
+pci_device_t* pci__get(size_t index) {
+    return (index < devices_count) ? &devices[index] : NULL;
+}
+
+pci_device_t* pci__find_class(uint8_t class_code, uint8_t subclass, pci_device_t* from) {
+    size_t start = (from == NULL) ? 0 : (size_t) (from - devices) + 1;
+    for (size_t i = start; i < devices_count; i++) {
+        if (devices[i].class_code == class_code && devices[i].subclass == subclass) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+pci_device_t* pci__find_device(uint16_t vendor_id, uint16_t device_id, pci_device_t* from) {
+    size_t start = (from == NULL) ? 0 : (size_t) (from - devices) + 1;
+    for (size_t i = start; i < devices_count; i++) {
+        if (devices[i].vendor_id == vendor_id && devices[i].device_id == device_id) {
+            return &devices[i];
+        }
+    }
+    return NULL;
+}
+
+uint32_t pci__read(pci_device_t* device, uint8_t offset) {
+    return config_read(device->bus, device->slot, device->function, offset);
+}
+
+void pci__write(pci_device_t* device, uint8_t offset, uint32_t value) {
+    config_write(device->bus, device->slot, device->function, offset, value);
+}
+
+uint32_t pci__bar(pci_device_t* device, size_t index) {
+    uint32_t bar = pci__read(device, (uint8_t) (PCI_BAR0 + 4 * index));
+    return (bar & BAR_IO) ? (bar & ~(uint32_t) 0x3) : (bar & ~(uint32_t) 0xF);
+}
+
+bool pci__bar_is_io(pci_device_t* device, size_t index) {
+    return (pci__read(device, (uint8_t) (PCI_BAR0 + 4 * index)) & BAR_IO) != 0;
+}
+
+void pci__enable(pci_device_t* device, uint16_t command) {
+    // The upper half is the status register, whose bits are cleared by
+    // writing 1: write it back as 0
+    uint32_t value = pci__read(device, PCI_COMMAND) & 0xFFFF;
+    pci__write(device, PCI_COMMAND, value | command);
+}
@@ -1,33 +1,74 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "drivers/pit.h"
 #include "drivers/io.h"
 #include "kernel/interrupt_handlers.h"
 #include "kernel/registers.h"
+#include "kernel/spinlock.h"
 #include "drivers/vga.h"
 
-#define PIT_DEFAULT_FREQUENCY 1193180
 #define PIT_COMMAND 0x43
 #define PIT_SQUARE_WAVE_MODE 0x36  // 0b00110110
+#define PIT_CH2_ONESHOT_MODE 0xB0  // 0b10110000: channel 2, lobyte/hibyte, mode 0
+#define PIT_CH0_ONESHOT_MODE 0x30  // 0b00110000: channel 0, lobyte/hibyte, mode 0
+#define PIT_CH0_LATCH_COUNT 0x00
+#define PIT_CH0_READ_STATUS 0xE2  // read-back command, latch the status of channel 0
+#define PIT_STATUS_OUTPUT 0x80
 
 #define PIT_CH0_PORT 0x40
 #define PIT_CH1_PORT 0x41
 #define PIT_CH2_PORT 0x42
 
-void timer_callback(registers_t* regs);
+// Channel 2 gate and output are wired to the PC speaker port
+#define PC_SPEAKER_PORT 0x61
+#define PIT_CH2_GATE 0x01
+#define PC_SPEAKER_DATA 0x02
+#define PIT_CH2_OUTPUT 0x20
+
+// Far enough in the future to mean "no pending event", while keeping
+// the signed comparisons of the ticks valid
+#define PIT_NO_EVENT 0x40000000
+
+int_result_t timer_callback(registers_t* regs);
+static void start_oneshot(uint16_t count);
 
 
 static uint8_t io_ports[] = {PIT_CH0_PORT, PIT_CH1_PORT, PIT_CH2_PORT};
-static uint32_t tick = 0;
+volatile uint32_t pit__ticks = 0;
+volatile uint32_t pit__next_event = 0;
+static uint32_t tick_frequency;
+static uint16_t tick_divisor;
+// Ticks covered by the programmed one-shot count, 0 in periodic mode
+static uint32_t oneshot_ticks;
+static spinlock_t ch2_lock = SPINLOCK_INIT;
+static uint32_t ch2_frequency; // square wave of channel 2, 0 if none
+
+int_result_t timer_callback(registers_t* regs) {
+    if (oneshot_ticks != 0) {
+        // End of a tickless idle period: the fast path only counted one
+        // tick, account for the others and go back to the periodic mode
+        pit__ticks += oneshot_ticks - 1;
+        oneshot_ticks = 0;
+        pit__set_frequency(PIT_CH0, tick_frequency);
+    }
+    // pit__ticks has already been incremented by the fast path.
+    // Users of the tick ask again for the next event they need.
+    pit__next_event = pit__ticks + PIT_NO_EVENT;
+    return INT_HANDLED;
+}
 
-void timer_callback(registers_t* regs) {
-    tick++;
-    // vga__writestring("Tick ");
-    // vga__writedec(tick);
-    // vga__putchar('\n');
+void pit__request_event(uint32_t tick) {
+    if ((int32_t) (tick - pit__next_event) < 0) {
+        pit__next_event = tick;
+    }
 }
 
 void pit__init(uint32_t frequency) {
+    tick_frequency = frequency;
+    tick_divisor = (uint16_t) (PIT_INPUT_FREQUENCY / frequency);
+    oneshot_ticks = 0;
+    pit__next_event = pit__ticks + PIT_NO_EVENT;
     interrupt_handlers__register(IRQ0, &timer_callback);
     
     pit__set_frequency(PIT_CH0, frequency);
@@ -35,10 +76,13 @@ void pit__init(uint32_t frequency) {
 
 void pit__set_frequency(pit__channel_t channel, uint32_t frequency) {
     // The value we send to the PIT is the value to divide it's input clock
-    // (PIT_DEFAULT_FREQUENCY Hz) by, to get our required frequency. Important 
+    // (PIT_INPUT_FREQUENCY Hz) by, to get our required frequency. Important 
     // to note is that the divisor must be small enough to fit into 16 bits
     
-    uint16_t divisor = (uint16_t) (PIT_DEFAULT_FREQUENCY / frequency);
+    uint16_t divisor = (uint16_t) (PIT_INPUT_FREQUENCY / frequency);
+    if (channel == PIT_CH2) {
+        ch2_frequency = frequency;
+    }
 
     // Send the command byte
     uint8_t cmd = (uint8_t) (PIT_SQUARE_WAVE_MODE) | (uint8_t) (channel << 6);
@@ -52,3 +96,111 @@ void pit__set_frequency(pit__channel_t channel, uint32_t frequency) {
     outb(io_ports[channel], low);
     outb(io_ports[channel], high);
 }
+
+uint32_t pit__get_ticks() {
+    return pit__ticks;
+}
+
+uint32_t pit__get_frequency() {
+    return tick_frequency;
+}
+
+uint32_t pit__ch2_lock() {
+    return spinlock__lock_irqsave(&ch2_lock);
+}
+
+void pit__ch2_unlock(uint32_t flags) {
+    spinlock__unlock_irqrestore(&ch2_lock, flags);
+}
+
+void pit__ch2_wait(uint16_t count) {
+    uint32_t flags = pit__ch2_lock();
+    // Disable the gate (stops the count) and the speaker
+    uint8_t speaker = inb(PC_SPEAKER_PORT);
+    outb(PC_SPEAKER_PORT, (uint8_t) (speaker & ~(PIT_CH2_GATE | PC_SPEAKER_DATA)));
+
+    // In mode 0, the output goes high once the count reaches 0
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT_MODE);
+    outb(PIT_CH2_PORT, (uint8_t) (count & 0xff));
+    outb(PIT_CH2_PORT, (uint8_t) (count >> 8));
+
+    // Start counting
+    outb(PC_SPEAKER_PORT, (uint8_t) ((speaker & ~PC_SPEAKER_DATA) | PIT_CH2_GATE));
+    while (!(inb(PC_SPEAKER_PORT) & PIT_CH2_OUTPUT));
+
+    // Give the speaker its tone back
+    if (ch2_frequency != 0) {
+        pit__set_frequency(PIT_CH2, ch2_frequency);
+    }
+    outb(PC_SPEAKER_PORT, speaker);
+    pit__ch2_unlock(flags);
+}
+
+/**
+ * Make channel 0 raise IRQ0 once, count periods of its input clock from now
+ */
+static void start_oneshot(uint16_t count) {
+    // In mode 0, channel 0 raises IRQ0 once, when the count reaches 0
+    outb(PIT_COMMAND, PIT_CH0_ONESHOT_MODE);
+    outb(PIT_CH0_PORT, (uint8_t) (count & 0xff));
+    outb(PIT_CH0_PORT, (uint8_t) (count >> 8));
+}
+
+bool pit__tickless_enter() {
+    if (oneshot_ticks != 0) {
+        // The end of the tick cut by the last tickless period is still
+        // running, the next ticks would not be aligned on it
+        return false;
+    }
+    uint32_t delta = pit__next_event - pit__ticks;
+    if ((int32_t) delta <= 1) {
+        // The next tick is needed anyway
+        return false;
+    }
+    // The one-shot count is 16 bits wide
+    uint32_t max_ticks = 0xffff / tick_divisor;
+    oneshot_ticks = (delta < max_ticks) ? delta : max_ticks;
+    if (oneshot_ticks <= 1) {
+        oneshot_ticks = 0;
+        return false;
+    }
+
+    start_oneshot((uint16_t) (oneshot_ticks * tick_divisor));
+
+    // Make the IRQ0 fast path call timer_callback for the accounting
+    pit__next_event = pit__ticks;
+    return true;
+}
+
+void pit__tickless_exit() {
+    if (oneshot_ticks <= 1) {
+        // IRQ0 already ended the tickless period, or only the end of the
+        // current tick is left
+        return;
+    }
+
+    outb(PIT_COMMAND, PIT_CH0_READ_STATUS);
+    if (inb(PIT_CH0_PORT) & PIT_STATUS_OUTPUT) {
+        // The count has expired and IRQ0 is pending: its handler does the
+        // accounting as soon as interrupts are enabled again
+        return;
+    }
+
+    // Woken up early by another interrupt: account for the elapsed ticks
+    outb(PIT_COMMAND, PIT_CH0_LATCH_COUNT);
+    uint16_t low = inb(PIT_CH0_PORT);
+    uint16_t high = inb(PIT_CH0_PORT);
+    uint32_t remaining = (uint32_t) ((high << 8) | low);
+    uint32_t elapsed = oneshot_ticks * tick_divisor - remaining;
+    pit__ticks += elapsed / tick_divisor;
+    uint32_t partial = elapsed % tick_divisor;
+    if (partial == 0) {
+        oneshot_ticks = 0;
+        pit__set_frequency(PIT_CH0, tick_frequency);
+        return;
+    }
+    // The current tick is partly elapsed: a one-shot count of what is left
+    // ends it, then timer_callback goes back to the periodic mode
+    oneshot_ticks = 1;
+    start_oneshot((uint16_t) (tick_divisor - partial));
+}
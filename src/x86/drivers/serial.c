@@ -0,0 +1,76 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/serial.h"
+#include "drivers/io.h"
+#include "kernel/spinlock.h"
+#include "libk/string.h"
+
+#define COM1_PORT 0x3F8
+
+// Registers, offsets from the base port
+#define DATA 0 // divisor low byte when DLAB is set
+#define INTERRUPT_ENABLE 1 // divisor high byte when DLAB is set
+#define FIFO_CONTROL 2
+#define LINE_CONTROL 3
+#define MODEM_CONTROL 4
+#define LINE_STATUS 5
+
+#define LINE_DLAB 0x80
+#define LINE_8N1 0x03
+#define FIFO_ENABLE_CLEAR_14 0xC7 // enable and clear, 14 bytes threshold
+#define MODEM_DTR_RTS_OUT2 0x0B
+#define MODEM_LOOPBACK 0x1E
+#define STATUS_TRANSMIT_EMPTY 0x20
+
+#define BAUD_DIVISOR 1 // 115200 bauds
+#define LOOPBACK_TEST_BYTE 0xAE
+
+static void send(char c);
+
+static bool present;
+static spinlock_t serial_lock = SPINLOCK_INIT;
+
+bool serial__init() {
+    outb(COM1_PORT + INTERRUPT_ENABLE, 0);
+    outb(COM1_PORT + LINE_CONTROL, LINE_DLAB);
+    outb(COM1_PORT + DATA, BAUD_DIVISOR & 0xff);
+    outb(COM1_PORT + INTERRUPT_ENABLE, BAUD_DIVISOR >> 8);
+    outb(COM1_PORT + LINE_CONTROL, LINE_8N1);
+    outb(COM1_PORT + FIFO_CONTROL, FIFO_ENABLE_CLEAR_14);
+
+    // A missing port does not echo in loopback mode
+    outb(COM1_PORT + MODEM_CONTROL, MODEM_LOOPBACK);
+    outb(COM1_PORT + DATA, LOOPBACK_TEST_BYTE);
+    present = inb(COM1_PORT + DATA) == LOOPBACK_TEST_BYTE;
+    outb(COM1_PORT + MODEM_CONTROL, MODEM_DTR_RTS_OUT2);
+    return present;
+}
+
+static void send(char c) {
+    while ((inb(COM1_PORT + LINE_STATUS) & STATUS_TRANSMIT_EMPTY) == 0);
+    outb(COM1_PORT + DATA, (uint8_t) c);
+}
+
+void serial__putchar(char c) {
+    serial__write(&c, 1);
+}
+
+void serial__write(const char* data, size_t size) {
+    if (!present) {
+        return;
+    }
+    uint32_t flags = spinlock__lock_irqsave(&serial_lock);
+    for (size_t i = 0; i < size; i++) {
+        if (data[i] == '\n') {
+            send('\r');
+        }
+        send(data[i]);
+    }
+    spinlock__unlock_irqrestore(&serial_lock, flags);
+}
+
+void serial__writestring(const char* data) {
+    serial__write(data, strlen(data));
+}
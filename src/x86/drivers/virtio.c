@@ -0,0 +1,204 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/virtio.h"
+#include "drivers/io.h"
+#include "kernel/kmem.h"
+#include "kernel/pmm.h"
+#include "kernel/vmm.h"
+#include "kernel/cpu.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+// Legacy PCI transport registers, from the I/O base
+#define REG_DEVICE_FEATURES 0
+#define REG_DRIVER_FEATURES 4
+#define REG_QUEUE_ADDRESS 8 // frame number of the queue
+#define REG_QUEUE_SIZE 12
+#define REG_QUEUE_SELECT 14
+#define REG_QUEUE_NOTIFY 16
+#define REG_STATUS 18
+#define REG_ISR 19
+#define REG_CONFIG 20 // without MSI-X
+
+// The legacy transport places the used ring on the next page boundary
+#define QUEUE_ALIGN 4096
+
+static uint32_t align(uint32_t value, uint32_t alignment);
+static void free_chain(virtqueue_t* queue, uint16_t head);
+
+static uint32_t align(uint32_t value, uint32_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+int virtio__init(virtio_device_t* device, pci_device_t* pci) {
+    if (!pci__bar_is_io(pci, 0)) {
+        return -1;
+    }
+    device->pci = pci;
+    device->io = (uint16_t) pci__bar(pci, 0);
+    device->features = 0;
+    pci__enable(pci, PCI_COMMAND_IO | PCI_COMMAND_BUS_MASTER);
+    outb((uint16_t) (device->io + REG_STATUS), 0);
+    outb((uint16_t) (device->io + REG_STATUS), VIRTIO_STATUS_ACKNOWLEDGE);
+    outb((uint16_t) (device->io + REG_STATUS), VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return 0;
+}
+
+uint32_t virtio__negotiate(virtio_device_t* device, uint32_t supported) {
+    device->features = inl((uint16_t) (device->io + REG_DEVICE_FEATURES)) & supported;
+    outl((uint16_t) (device->io + REG_DRIVER_FEATURES), device->features);
+    return device->features;
+}
+
+int virtio__setup_queue(virtio_device_t* device, virtqueue_t* queue, uint16_t index, virtq_complete_t complete) {
+    outw((uint16_t) (device->io + REG_QUEUE_SELECT), index);
+    uint16_t size = inw((uint16_t) (device->io + REG_QUEUE_SIZE));
+    if (size == 0) {
+        return -1;
+    }
+    uint32_t used_offset = align(sizeof(virtq_desc_t) * size + sizeof(virtq_avail_t)
+            + sizeof(uint16_t) * (size + 1u), QUEUE_ALIGN);
+    uint32_t bytes = used_offset + align(sizeof(virtq_used_t) + sizeof(virtq_used_elem_t) * size
+            + sizeof(uint16_t), QUEUE_ALIGN);
+    uint32_t phys = pmm__alloc_frames(bytes / PAGE_SIZE);
+    if (phys == 0) {
+        debug("virtio: no %u contiguous frames for queue %u", bytes / PAGE_SIZE, index);
+        return -1;
+    }
+    char* ring = vmm__map_physical(phys, bytes, PAGE_WRITABLE);
+    memset(ring, 0, bytes);
+
+    queue->device = device;
+    queue->index = index;
+    queue->size = size;
+    queue->descriptors = (volatile virtq_desc_t*) ring;
+    queue->avail = (volatile virtq_avail_t*) (ring + sizeof(virtq_desc_t) * size);
+    queue->used = (volatile virtq_used_t*) (ring + used_offset);
+    queue->tokens = kmem__alloc(sizeof(void*) * size, 0);
+    for (uint16_t i = 0; i + 1 < size; i++) {
+        queue->descriptors[i].next = (uint16_t) (i + 1);
+    }
+    queue->free_head = 0;
+    queue->free_count = size;
+    queue->avail_index = 0;
+    queue->last_used = 0;
+    queue->in_flight = 0;
+    spinlock__init(&queue->lock);
+    waitqueue__init(&queue->waiters);
+    queue->complete = complete;
+
+    outl((uint16_t) (device->io + REG_QUEUE_ADDRESS), phys / QUEUE_ALIGN);
+    return 0;
+}
+
+void virtio__set_ready(virtio_device_t* device, bool ok) {
+    uint8_t status = inb((uint16_t) (device->io + REG_STATUS));
+    status |= ok ? VIRTIO_STATUS_DRIVER_OK : VIRTIO_STATUS_FAILED;
+    outb((uint16_t) (device->io + REG_STATUS), status);
+}
+
+uint8_t virtio__config_read8(virtio_device_t* device, uint16_t offset) {
+    return inb((uint16_t) (device->io + REG_CONFIG + offset));
+}
+
+uint32_t virtio__config_read32(virtio_device_t* device, uint16_t offset) {
+    return inl((uint16_t) (device->io + REG_CONFIG + offset));
+}
+
+uint8_t virtio__isr(virtio_device_t* device) {
+    return inb((uint16_t) (device->io + REG_ISR));
+}
+
+int virtqueue__add(virtqueue_t* queue, const virtq_buffer_t* buffers, size_t count, void* token) {
+    uint32_t flags = spinlock__lock_irqsave(&queue->lock);
+    if (count == 0 || count > queue->free_count) {
+        spinlock__unlock_irqrestore(&queue->lock, flags);
+        return -1;
+    }
+    uint16_t head = queue->free_head;
+    uint16_t index = head;
+    for (size_t i = 0; i < count; i++) {
+        volatile virtq_desc_t* descriptor = &queue->descriptors[index];
+        descriptor->address = buffers[i].address;
+        descriptor->length = buffers[i].length;
+        descriptor->flags = (uint16_t) ((buffers[i].device_writes ? VIRTQ_DESC_F_WRITE : 0)
+                | (i + 1 < count ? VIRTQ_DESC_F_NEXT : 0));
+        if (i + 1 < count) {
+            index = descriptor->next;
+        }
+    }
+    queue->free_head = queue->descriptors[index].next;
+    queue->free_count = (uint16_t) (queue->free_count - count);
+    queue->tokens[head] = token;
+    queue->avail->ring[queue->avail_index % queue->size] = head;
+    queue->avail_index++;
+    queue->in_flight++;
+    spinlock__unlock_irqrestore(&queue->lock, flags);
+    return 0;
+}
+
+void virtqueue__kick(virtqueue_t* queue) {
+    uint32_t flags = spinlock__lock_irqsave(&queue->lock);
+    if (queue->avail->index == queue->avail_index) {
+        spinlock__unlock_irqrestore(&queue->lock, flags);
+        return;
+    }
+    // The ring entries must be visible before the new index
+    __asm__ __volatile__ ("" : : : "memory");
+    queue->avail->index = queue->avail_index;
+    // ... and the index before the flags of the device are read
+    cpu__mb();
+    bool notify = (queue->used->flags & VIRTQ_USED_F_NO_NOTIFY) == 0;
+    spinlock__unlock_irqrestore(&queue->lock, flags);
+    if (notify) {
+        // Each notification is a VM exit: one per batch, not per request
+        outw((uint16_t) (queue->device->io + REG_QUEUE_NOTIFY), queue->index);
+    }
+}
+
+static void free_chain(virtqueue_t* queue, uint16_t head) {
+    uint16_t index = head;
+    uint16_t count = 1;
+    while (queue->descriptors[index].flags & VIRTQ_DESC_F_NEXT) {
+        index = queue->descriptors[index].next;
+        count++;
+    }
+    queue->descriptors[index].next = queue->free_head;
+    queue->free_head = head;
+    queue->free_count = (uint16_t) (queue->free_count + count);
+}
+
+size_t virtqueue__drain(virtqueue_t* queue) {
+    size_t completed = 0;
+    uint32_t flags = spinlock__lock_irqsave(&queue->lock);
+    for (;;) {
+        // No interrupt for the entries used while the ring is drained
+        queue->avail->flags = VIRTQ_AVAIL_F_NO_INTERRUPT;
+        while (queue->last_used != queue->used->index) {
+            // Read the entry only once the index says it is written
+            __asm__ __volatile__ ("" : : : "memory");
+            volatile virtq_used_elem_t* element = &queue->used->ring[queue->last_used % queue->size];
+            uint16_t head = (uint16_t) element->id;
+            uint32_t length = element->length;
+            queue->last_used++;
+            queue->in_flight--;
+            free_chain(queue, head);
+            queue->complete(queue, queue->tokens[head], length);
+            completed++;
+        }
+        queue->avail->flags = 0;
+        // An entry used between the last check and the flag update would
+        // not raise an interrupt: check again
+        cpu__mb();
+        if (queue->last_used == queue->used->index) {
+            break;
+        }
+    }
+    spinlock__unlock_irqrestore(&queue->lock, flags);
+    if (completed > 0) {
+        waitqueue__wake_all(&queue->waiters);
+    }
+    return completed;
+}
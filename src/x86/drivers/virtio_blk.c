@@ -0,0 +1,396 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "drivers/virtio_blk.h"
+#include "drivers/virtio.h"
+#include "drivers/pci.h"
+#include "kernel/block.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/waitqueue.h"
+#include "kernel/sched.h"
+#include "kernel/timer.h"
+#include "kernel/pmm.h"
+#include "kernel/kmem.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+#define VIRTIO_BLK_DEVICE_ID 0x1001 // transitional device, legacy interface
+#define DISKS_MAX 4
+#define SECTOR_SIZE 512
+
+#define FEATURE_SEG_MAX (1 << 2)
+#define FEATURE_RO (1 << 5)
+#define FEATURE_FLUSH (1 << 9)
+
+// Device configuration
+#define CONFIG_CAPACITY 0 // 64 bits, in sectors
+#define CONFIG_SEG_MAX 12
+
+#define REQUEST_IN 0
+#define REQUEST_OUT 1
+#define REQUEST_FLUSH 4
+#define STATUS_OK 0
+
+// Data descriptors of a request, besides the header and the status:
+// 64 KiB, possibly not page aligned
+#define SEGMENTS_MAX 17
+// Completion is also polled, in case the interrupt is never delivered
+#define POLL_MS 10
+
+/*
+ * Header and status of a request, read and written by the device
+ */
+typedef struct {
+    uint32_t type;
+    uint32_t reserved;
+    uint64_t sector;
+} __attribute__((packed)) request_header_t;
+
+typedef struct {
+    request_header_t header;
+    volatile uint8_t status;
+    uint8_t padding[15];
+} __attribute__((packed)) request_dma_t;
+
+/*
+ * Requests given together to submit: the submitting thread sleeps until
+ * none is left
+ */
+typedef struct {
+    volatile uint32_t remaining; // protected by the queue lock
+} batch_t;
+
+/*
+ * A request in the queue. The block requests larger than a chunk are split
+ * in several of these.
+ */
+typedef struct slot_struct {
+    block_request_t* request;
+    batch_t* batch;
+    request_dma_t* dma; // its header and status
+    uint32_t dma_phys;
+    struct slot_struct* next_free;
+} slot_t;
+
+typedef struct {
+    virtio_device_t device;
+    virtqueue_t queue;
+    uint32_t chunk_sectors;
+    slot_t* slots; // as many as descriptors
+    slot_t* free_slots; // protected by the queue lock
+    waitqueue_t done; // woken up when a batch is over
+    timer_t poll_timer;
+    block_device_t block;
+} disk_t;
+
+static void complete(virtqueue_t* queue, void* token, uint32_t length);
+static int_result_t irq_handler(registers_t* regs);
+static void poll_callback(void* data);
+static void kick(disk_t* disk);
+static slot_t* get_slot(disk_t* disk, block_request_t* request, batch_t* batch);
+static size_t segments(const void* buffer, uint32_t size, virtq_buffer_t* buffers);
+static void add_request(disk_t* disk, slot_t* slot, uint32_t type, uint32_t sector,
+        void* buffer, uint32_t size);
+static int submit(block_device_t* device, block_request_t* requests, size_t count);
+static int read_blocks(block_device_t* device, uint32_t block, uint32_t count, void* buffer);
+static int write_blocks(block_device_t* device, uint32_t block, uint32_t count, const void* buffer);
+static void init_disk(disk_t* disk, pci_device_t* pci, size_t index);
+
+static disk_t disks[DISKS_MAX];
+static size_t disks_count;
+
+static void complete(virtqueue_t* queue, void* token, uint32_t length) {
+    (void) length;
+    disk_t* disk = (disk_t*) ((char*) queue - offsetof(disk_t, queue));
+    slot_t* slot = token;
+    if (slot->dma->status != STATUS_OK) {
+        slot->request->result = -1;
+    }
+    batch_t* batch = slot->batch;
+    slot->next_free = disk->free_slots;
+    disk->free_slots = slot;
+    // The batch lives on the stack of its thread, which may return as
+    // soon as remaining is 0: the disk wait queue is woken up instead
+    if (--batch->remaining == 0) {
+        waitqueue__wake_all(&disk->done);
+    }
+}
+
+static int_result_t irq_handler(registers_t* regs) {
+    int_result_t result = INT_UNHANDLED;
+    for (size_t i = 0; i < disks_count; i++) {
+        disk_t* disk = &disks[i];
+        if ((uint32_t) (IRQ0 + disk->device.pci->irq) != regs->int_no) {
+            continue;
+        }
+        // The IRQ line may be shared: the ISR status tells if it is ours
+        uint8_t isr = virtio__isr(&disk->device);
+        if (isr & VIRTIO_ISR_QUEUE) {
+            virtqueue__drain(&disk->queue);
+        }
+        if (isr != 0) {
+            result = INT_HANDLED;
+        }
+    }
+    return result;
+}
+
+static void poll_callback(void* data) {
+    disk_t* disk = data;
+    virtqueue__drain(&disk->queue);
+    if (disk->queue.in_flight != 0) {
+        timer__add(&disk->poll_timer, timer__now() + timer__ms_to_ticks(POLL_MS), poll_callback, disk);
+    }
+}
+
+/**
+ * Notify the device, and poll its completions in case the interrupt is
+ * not delivered
+ */
+static void kick(disk_t* disk) {
+    virtqueue__kick(&disk->queue);
+    timer__add(&disk->poll_timer, timer__now() + timer__ms_to_ticks(POLL_MS), poll_callback, disk);
+}
+
+/**
+ * Take a free slot for a request of the batch
+ */
+static slot_t* get_slot(disk_t* disk, block_request_t* request, batch_t* batch) {
+    for (;;) {
+        uint32_t flags = spinlock__lock_irqsave(&disk->queue.lock);
+        slot_t* slot = disk->free_slots;
+        if (slot != NULL) {
+            disk->free_slots = slot->next_free;
+            slot->request = request;
+            slot->batch = batch;
+            batch->remaining++;
+        }
+        spinlock__unlock_irqrestore(&disk->queue.lock, flags);
+        if (slot != NULL) {
+            return slot;
+        }
+        kick(disk);
+        WAITQUEUE_WAIT(&disk->queue.waiters, disk->free_slots != NULL);
+    }
+}
+
+/**
+ * Describe the physical pages of buffer, merging the contiguous ones
+ * @returns the number of buffers used, 0 if a page is not mapped
+ */
+static size_t segments(const void* buffer, uint32_t size, virtq_buffer_t* buffers) {
+    size_t count = 0;
+    uint32_t virt = (uint32_t) buffer;
+    uint32_t end = virt + size;
+    while (virt < end) {
+        uint32_t phys = vmm__get_physical((void*) virt);
+        if (phys == 0) {
+            return 0;
+        }
+        uint32_t length = PAGE_SIZE - virt % PAGE_SIZE;
+        if (length > end - virt) {
+            length = end - virt;
+        }
+        if (count > 0 && buffers[count - 1].address + buffers[count - 1].length == phys) {
+            buffers[count - 1].length += length;
+        }
+        else {
+            buffers[count].address = phys;
+            buffers[count].length = length;
+            count++;
+        }
+        virt += length;
+    }
+    return count;
+}
+
+/**
+ * Queue a request, pointing straight at the pages of buffer, waiting for
+ * free descriptors if needed. The device is notified by the caller.
+ */
+static void add_request(disk_t* disk, slot_t* slot, uint32_t type, uint32_t sector,
+        void* buffer, uint32_t size) {
+    virtq_buffer_t buffers[SEGMENTS_MAX + 2];
+    slot->dma->header.type = type;
+    slot->dma->header.reserved = 0;
+    slot->dma->header.sector = sector;
+    slot->dma->status = 0xFF;
+    buffers[0].address = slot->dma_phys;
+    buffers[0].length = sizeof(request_header_t);
+    buffers[0].device_writes = false;
+    size_t count = 1;
+    if (size > 0) {
+        size_t data = segments(buffer, size, &buffers[1]);
+        for (size_t i = 1; i <= data; i++) {
+            buffers[i].device_writes = (type == REQUEST_IN);
+        }
+        count += data;
+    }
+    buffers[count].address = slot->dma_phys + offsetof(request_dma_t, status);
+    buffers[count].length = 1;
+    buffers[count].device_writes = true;
+    count++;
+    while (virtqueue__add(&disk->queue, buffers, count, slot) != 0) {
+        // Let the device work on what is queued, and free descriptors
+        kick(disk);
+        WAITQUEUE_WAIT(&disk->queue.waiters, disk->queue.free_count >= count);
+    }
+}
+
+static int submit(block_device_t* device, block_request_t* requests, size_t count) {
+    disk_t* disk = device->data;
+    batch_t batch = {0};
+    bool writes = false;
+    int result = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        block_request_t* request = &requests[i];
+        if (request->result != 0) {
+            result = -1;
+            continue;
+        }
+        if (request->write && (disk->device.features & FEATURE_RO)) {
+            request->result = -1;
+            result = -1;
+            continue;
+        }
+        writes |= request->write;
+        // Large requests are split in chunks the descriptors can describe
+        for (uint32_t done = 0; done < request->count; done += disk->chunk_sectors) {
+            uint32_t sectors = request->count - done;
+            if (sectors > disk->chunk_sectors) {
+                sectors = disk->chunk_sectors;
+            }
+            void* buffer = (char*) request->buffer + done * SECTOR_SIZE;
+            if ((uint32_t) buffer % 2 != 0 || vmm__get_physical(buffer) == 0) {
+                request->result = -1;
+                break;
+            }
+            slot_t* slot = get_slot(disk, request, &batch);
+            add_request(disk, slot, request->write ? REQUEST_OUT : REQUEST_IN,
+                    request->block + done, buffer, sectors * SECTOR_SIZE);
+        }
+    }
+    // A single notification for the whole batch
+    kick(disk);
+    WAITQUEUE_WAIT(&disk->done, batch.remaining == 0);
+
+    if (writes && (disk->device.features & FEATURE_FLUSH)) {
+        // The writes are done: make them durable
+        block_request_t flush = {0, 0, NULL, false, 0};
+        add_request(disk, get_slot(disk, &flush, &batch), REQUEST_FLUSH, 0, NULL, 0);
+        kick(disk);
+        WAITQUEUE_WAIT(&disk->done, batch.remaining == 0);
+        if (flush.result != 0) {
+            result = -1;
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        if (requests[i].result != 0) {
+            result = -1;
+        }
+    }
+    return result;
+}
+
+static int read_blocks(block_device_t* device, uint32_t block, uint32_t count, void* buffer) {
+    block_request_t request = {block, count, buffer, false, 0};
+    return submit(device, &request, 1);
+}
+
+static int write_blocks(block_device_t* device, uint32_t block, uint32_t count, const void* buffer) {
+    // The buffer is only read by the device
+    block_request_t request = {block, count, (void*) buffer, true, 0};
+    return submit(device, &request, 1);
+}
+
+static void init_disk(disk_t* disk, pci_device_t* pci, size_t index) {
+    virtio_device_t* device = &disk->device;
+    if (virtio__init(device, pci) != 0) {
+        debug("virtio-blk: BAR0 of %u:%u.%u is not an I/O BAR", pci->bus, pci->slot, pci->function);
+        return;
+    }
+    virtio__negotiate(device, FEATURE_SEG_MAX | FEATURE_RO | FEATURE_FLUSH);
+    if (virtio__setup_queue(device, &disk->queue, 0, complete) != 0) {
+        virtio__set_ready(device, false);
+        return;
+    }
+
+    // Header and status of every possible request, one per descriptor
+    uint32_t size = disk->queue.size;
+    uint32_t bytes = (uint32_t) sizeof(request_dma_t) * size;
+    uint32_t pages = (bytes + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t phys = pmm__alloc_frames(pages);
+    if (phys == 0) {
+        virtio__set_ready(device, false);
+        return;
+    }
+    request_dma_t* dma = vmm__map_physical(phys, pages * PAGE_SIZE, PAGE_WRITABLE);
+    disk->slots = kmem__alloc(sizeof(slot_t) * size, 0);
+    disk->free_slots = NULL;
+    for (uint32_t i = 0; i < size; i++) {
+        disk->slots[i].dma = &dma[i];
+        disk->slots[i].dma_phys = phys + i * (uint32_t) sizeof(request_dma_t);
+        disk->slots[i].next_free = disk->free_slots;
+        disk->free_slots = &disk->slots[i];
+    }
+    waitqueue__init(&disk->done);
+    timer__init_timer(&disk->poll_timer);
+
+    // Data descriptors per request: at most SEGMENTS_MAX, seg_max and what
+    // the queue can hold besides the header and the status
+    uint32_t segments_max = SEGMENTS_MAX;
+    if (device->features & FEATURE_SEG_MAX) {
+        uint32_t seg_max = virtio__config_read32(device, CONFIG_SEG_MAX);
+        if (seg_max >= 2 && seg_max < segments_max) {
+            segments_max = seg_max;
+        }
+    }
+    if (size - 2 < segments_max) {
+        segments_max = size - 2;
+    }
+    // A buffer which is not page aligned uses one more segment
+    disk->chunk_sectors = (segments_max - 1) * PAGE_SIZE / SECTOR_SIZE;
+
+    uint32_t capacity_low = virtio__config_read32(device, CONFIG_CAPACITY);
+    uint32_t capacity_high = virtio__config_read32(device, CONFIG_CAPACITY + 4);
+
+    block_device_t* block = &disk->block;
+    block->name[0] = 'v';
+    block->name[1] = 'd';
+    block->name[2] = (char) ('a' + index);
+    block->name[3] = '\0';
+    block->block_size = SECTOR_SIZE;
+    // Block numbers are 32 bits
+    block->blocks = (capacity_high != 0) ? 0xFFFFFFFF : capacity_low;
+    block->read = read_blocks;
+    block->write = write_blocks;
+    block->submit = submit;
+    block->data = disk;
+
+    if (pci->irq < 16) {
+        interrupt_handlers__register((uint8_t) (IRQ0 + pci->irq), irq_handler);
+    }
+    else {
+        debug("virtio-blk: %s has no IRQ, completions are polled", block->name);
+    }
+    virtio__set_ready(device, true);
+    debug("virtio-blk: %s, %u sectors, queue of %u, %u sectors per request%s", block->name,
+            block->blocks, size, disk->chunk_sectors, (device->features & FEATURE_RO) ? ", read-only" : "");
+    block__register(block);
+}
+
+void virtio_blk__init() {
+    pci_device_t* pci = NULL;
+    while ((pci = pci__find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_DEVICE_ID, pci)) != NULL
+            && disks_count < DISKS_MAX) {
+        disk_t* disk = &disks[disks_count];
+        init_disk(disk, pci, disks_count);
+        if (disk->block.read != NULL) {
+            disks_count++;
+        }
+    }
+}
@@ -1,11 +1,33 @@
 #ifndef GDT_H
 #define GDT_H
 
+#include <stdint.h>
+#include "kernel/percpu.h"
+
 #define KERN_CODE_SEG 0x08
 #define KERN_DATA_SEG 0x10
 #define USER_CODE_SEG 0x18
 #define USER_DATA_SEG 0x20
 
+// One data segment per CPU, covering its cpu_t (see percpu.h)
+#define GDT_PERCPU_FIRST 5
+#define PERCPU_SEG(index) ((GDT_PERCPU_FIRST + (index)) * 8)
+
+// One task state segment per CPU (see tss.h)
+#define GDT_TSS_FIRST (GDT_PERCPU_FIRST + MAX_CPUS)
+#define TSS_SEG(index) ((GDT_TSS_FIRST + (index)) * 8)
+
 void gdt__init(void);
 
+/**
+ * Load the GDT on an application processor, with its per-CPU segment and
+ * its TSS
+ */
+void gdt__load(uint32_t cpu_index);
+
+/**
+ * Load the per-CPU segment of the given CPU in %gs
+ */
+void gdt__load_percpu(uint32_t cpu_index);
+
 #endif
@@ -3,4 +3,9 @@
 
 void idt__init(void);
 
+/**
+ * Load the IDT built by idt__init on an application processor
+ */
+void idt__load(void);
+
 #endif
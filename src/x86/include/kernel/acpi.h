@@ -0,0 +1,44 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define ACPI_MAX_CPUS 16
+#define ACPI_MAX_IOAPICS 4
+#define ACPI_ISA_IRQS 16
+
+// MPS INTI flags of the interrupt source overrides
+#define ACPI_INTI_POLARITY_MASK 0x3
+#define ACPI_INTI_POLARITY_LOW 0x3
+#define ACPI_INTI_TRIGGER_MASK 0xc
+#define ACPI_INTI_TRIGGER_LEVEL 0xc
+
+typedef struct {
+    uint8_t id;
+    uint32_t addr; // physical address of the registers
+    uint32_t gsi_base; // first global system interrupt handled
+} acpi_ioapic_t;
+
+/*
+ * Interrupt controllers description, as found in the MADT
+ */
+typedef struct {
+    uint32_t lapic_addr; // physical address of the local APICs registers
+    size_t cpus_count;
+    uint8_t cpu_apic_ids[ACPI_MAX_CPUS]; // local APIC id of each enabled CPU
+    size_t ioapics_count;
+    acpi_ioapic_t ioapics[ACPI_MAX_IOAPICS];
+    uint32_t isa_irq_gsi[ACPI_ISA_IRQS]; // GSI each ISA IRQ is connected to
+    uint16_t isa_irq_flags[ACPI_ISA_IRQS]; // MPS INTI flags of each ISA IRQ
+} acpi_madt_info_t;
+
+/**
+ * Look for the ACPI MADT (Multiple APIC Description Table) and fill info
+ * with the interrupt controllers it describes.
+ * @returns false if there is no RSDP or no MADT
+ */
+bool acpi__parse_madt(acpi_madt_info_t* info);
+
+#endif
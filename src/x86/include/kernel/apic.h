@@ -0,0 +1,69 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/acpi.h"
+
+// Address of the local APIC EOI register, NULL when the APIC is not used.
+// The IRQ0 fast path (interrupt.S) writes it directly.
+extern volatile uint32_t* apic__eoi_register;
+
+/**
+ * Enable the local APIC of the boot CPU and route the ISA IRQs through the
+ * IO-APIC(s) described by the ACPI MADT. When there is no MADT, the default
+ * QEMU layout is used.
+ * The 8259 PICs are masked on success.
+ * @returns false if the CPU has no local APIC
+ */
+bool apic__init(void);
+
+/**
+ * Enable the local APIC of an application processor
+ */
+void apic__init_ap(void);
+
+/**
+ * Send the interrupt vector to the CPU whose local APIC id is apic_id
+ */
+void apic__send_ipi(uint8_t apic_id, uint8_t vector);
+
+/**
+ * Send an INIT IPI, which resets the target CPU
+ */
+void apic__send_init(uint8_t apic_id);
+
+/**
+ * Send a STARTUP IPI: the target CPU starts in real mode at the given
+ * physical address (page aligned, below 1 MiB)
+ */
+void apic__send_startup(uint8_t apic_id, uint32_t trampoline);
+
+/**
+ * Measure the local timer against the PIT, for apic__timer_start to
+ * interrupt at the given frequency
+ */
+void apic__timer_calibrate(uint32_t frequency);
+
+/**
+ * Start the periodic local timer of the current CPU (vector IRQ_LAPIC_TIMER)
+ */
+void apic__timer_start(void);
+
+/**
+ * Send an EOI (End Of Interrupt) to the local APIC
+ */
+void apic__eoi(void);
+
+/**
+ * @returns the local APIC id of the current CPU
+ */
+uint8_t apic__id(void);
+
+/**
+ * @returns the interrupt controllers description used by apic__init
+ */
+const acpi_madt_info_t* apic__info(void);
+
+#endif
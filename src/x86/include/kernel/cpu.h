@@ -0,0 +1,147 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <stdint.h>
+
+#define EFLAGS_IF 0x200 // Interrupt enable flag
+
+// cpuid leaf 1, edx feature bits
+#define CPUID_FEAT_EDX_TSC (1 << 4)
+#define CPUID_FEAT_EDX_MSR (1 << 5)
+#define CPUID_FEAT_EDX_APIC (1 << 9)
+#define CPUID_FEAT_EDX_SEP (1 << 11) // sysenter/sysexit
+
+// cpuid leaf 0x80000001, edx feature bits
+#define CPUID_EXT_FEAT_EDX_RDTSCP (1 << 27)
+
+// sysenter/sysexit MSRs
+#define MSR_SYSENTER_CS 0x174
+#define MSR_SYSENTER_ESP 0x175
+#define MSR_SYSENTER_EIP 0x176
+
+/**
+ * Read the time stamp counter
+ */
+static inline uint64_t cpu__rdtsc(void) {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtsc" : "=a" (low), "=d" (high));
+    return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * Read the time stamp counter once the previous instructions are done,
+ * cpuid keeping them from running after rdtsc: start of a timed section
+ */
+static inline uint64_t cpu__rdtsc_begin(void) {
+    uint32_t low, high;
+    __asm__ __volatile__ ("cpuid; rdtsc" : "=a" (low), "=d" (high) : "a" (0) : "ebx", "ecx", "memory");
+    return ((uint64_t) high << 32) | low;
+}
+
+/**
+ * Read the time stamp counter with rdtscp, which waits for the previous
+ * instructions, cpuid keeping the next ones from starting before: end of a
+ * timed section. Needs CPUID_EXT_FEAT_EDX_RDTSCP, cpu__rdtsc_begin can be
+ * used instead.
+ */
+static inline uint64_t cpu__rdtscp_end(void) {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdtscp; movl %%eax, %0; movl %%edx, %1; xorl %%eax, %%eax; cpuid"
+            : "=r" (low), "=r" (high) : : "eax", "ebx", "ecx", "edx", "memory");
+    return ((uint64_t) high << 32) | low;
+}
+
+static inline void cpu__cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx,
+        uint32_t* ecx, uint32_t* edx) {
+    __asm__ __volatile__ ("cpuid"
+            : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+            : "a" (leaf), "c" (0));
+}
+
+static inline uint64_t cpu__rdmsr(uint32_t msr) {
+    uint32_t low, high;
+    __asm__ __volatile__ ("rdmsr" : "=a" (low), "=d" (high) : "c" (msr));
+    return ((uint64_t) high << 32) | low;
+}
+
+static inline void cpu__wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ __volatile__ ("wrmsr" : : "c" (msr), "a" ((uint32_t) value),
+            "d" ((uint32_t) (value >> 32)));
+}
+
+/**
+ * Invalidate the TLB entry of the page containing addr
+ */
+static inline void cpu__invlpg(void* addr) {
+    __asm__ __volatile__ ("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
+static inline void cpu__cli(void) {
+    __asm__ __volatile__ ("cli" : : : "memory");
+}
+
+static inline void cpu__sti(void) {
+    __asm__ __volatile__ ("sti" : : : "memory");
+}
+
+static inline void cpu__hlt(void) {
+    __asm__ __volatile__ ("hlt" : : : "memory");
+}
+
+/**
+ * Spin-wait hint: saves power and avoids a pipeline flush when the waited
+ * memory location changes
+ */
+static inline void cpu__pause(void) {
+    __asm__ __volatile__ ("pause" : : : "memory");
+}
+
+/**
+ * Full memory barrier: the stores before it are visible to other CPUs and
+ * devices before the loads after it are done. x86 only reorders a store
+ * after a later load, a locked instruction prevents it without SSE2.
+ */
+static inline void cpu__mb(void) {
+    __asm__ __volatile__ ("lock addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+/**
+ * Atomically replace *ptr by desired if it is equal to expected
+ * @returns the previous value of *ptr (expected on success)
+ */
+static inline uint32_t cpu__cmpxchg(volatile uint32_t* ptr, uint32_t expected, uint32_t desired) {
+    uint32_t previous;
+    __asm__ __volatile__ ("lock cmpxchgl %2, %1"
+            : "=a" (previous), "+m" (*ptr) : "r" (desired), "0" (expected) : "memory");
+    return previous;
+}
+
+/**
+ * @returns the physical address of the current page directory
+ */
+static inline uint32_t cpu__read_cr3(void) {
+    uint32_t cr3;
+    __asm__ __volatile__ ("movl %%cr3, %0" : "=r" (cr3));
+    return cr3;
+}
+
+/**
+ * Disable interrupts
+ * @returns the previous eflags, to be given to cpu__irq_restore
+ */
+static inline uint32_t cpu__irq_save(void) {
+    uint32_t flags;
+    __asm__ __volatile__ ("pushfl; popl %0; cli" : "=r" (flags) : : "memory");
+    return flags;
+}
+
+/**
+ * Enable interrupts again if they were enabled when cpu__irq_save was called
+ */
+static inline void cpu__irq_restore(uint32_t flags) {
+    if (flags & EFLAGS_IF) {
+        cpu__sti();
+    }
+}
+
+#endif
@@ -20,9 +20,61 @@
 #define IRQ13 45
 #define IRQ14 46
 #define IRQ15 47
+#define IRQ_LAPIC_TIMER 0xF0 // local timer of the application processors
+#define IRQ_RESCHEDULE 0xF1 // inter-processor interrupt: run the scheduler
+#define IRQ_SPURIOUS 0xFF
 
-typedef void (*int_handler_t)(registers_t*);
-void interrupt_handlers__register(uint8_t num, int_handler_t handler);
-int_handler_t interrupt_handlers__get(uint8_t num);
+// System call gate, the only one user mode can use
+#define SYSCALL_VECTOR 0x80
+
+// Vectors of the interrupt round-trip benchmark
+#define INT_BENCH_LEGACY 0x30
+#define INT_BENCH_LEAN 0x31
+
+typedef enum {
+    INT_UNHANDLED = 0, // the interrupt did not come from the handler's device
+    INT_HANDLED = 1
+} int_result_t;
+
+typedef int_result_t (*int_handler_t)(registers_t*);
+
+/*
+ * Dispatch statistics of an interrupt vector
+ */
+typedef struct {
+    uint32_t count; // number of dispatches
+    uint32_t unhandled; // dispatches no handler claimed
+    uint64_t total_cycles; // cycles spent in the handlers
+    uint32_t max_cycles;
+} int_stats_t;
+
+/**
+ * Add a handler to the chain of the given vector. Vectors can be shared:
+ * every handler of the chain is called, in registration order.
+ * @return 0 if success, -1 if the vector already has too many handlers
+ */
+int interrupt_handlers__register(uint8_t num, int_handler_t handler);
+
+/**
+ * Remove a handler from the chain of the given vector
+ * @return 0 if success, -1 if the handler was not registered
+ */
+int interrupt_handlers__unregister(uint8_t num, int_handler_t handler);
+
+/**
+ * Call the handlers of regs->int_no and account the time spent in them
+ * @return INT_HANDLED if at least one handler claimed the interrupt
+ */
+int_result_t interrupt_handlers__dispatch(registers_t* regs);
+
+/**
+ * @return the dispatch statistics of the given vector
+ */
+const int_stats_t* interrupt_handlers__stats(uint8_t num);
+
+/**
+ * Print the statistics of every vector which has been dispatched
+ */
+void interrupt_handlers__dump_stats(void);
 
 #endif
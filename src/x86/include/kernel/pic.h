@@ -0,0 +1,21 @@
+#ifndef PIC_H
+#define PIC_H
+
+#include <stdint.h>
+
+/**
+ * Remap the master and slave PICs interrupts to the given vector offsets
+ */
+void pic__remap(uint8_t offset1, uint8_t offset2);
+
+/**
+ * Send an EOI (End Of Interrupt) for the given interrupt vector
+ */
+void pic__eoi(uint32_t int_no);
+
+/**
+ * Mask every interrupt line of both PICs
+ */
+void pic__disable(void);
+
+#endif
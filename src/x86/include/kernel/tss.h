@@ -0,0 +1,41 @@
+#ifndef TSS_H
+#define TSS_H
+
+#include <stdint.h>
+
+/*
+ * Task state segment. Hardware task switching is not used: the TSS only
+ * gives the stack the CPU switches to when entering the kernel from user
+ * mode.
+ */
+typedef struct {
+    uint32_t prev_tss;
+    uint32_t esp0; // kernel stack of the running thread
+    uint32_t ss0;
+    uint32_t esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags, eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap;
+    uint16_t iomap_base; // past the limit: no I/O port for user mode
+} __attribute__((packed)) tss_t;
+
+/**
+ * Initialize the TSS of every CPU. Called by gdt__init, before the TSS
+ * descriptors are built.
+ */
+void tss__init(void);
+
+tss_t* tss__get(uint32_t cpu_index);
+
+/**
+ * Load the TSS of the given CPU in the task register
+ */
+void tss__load(uint32_t cpu_index);
+
+/**
+ * Set the stack used by the current CPU when it enters the kernel from
+ * user mode
+ */
+void tss__set_kernel_stack(uint32_t esp0);
+
+#endif
@@ -0,0 +1,234 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/acpi.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+#include "libk/string.h"
+
+#define KERNEL_OFFSET 0xC0000000
+#define EBDA_SEGMENT_PTR 0x40E
+#define BIOS_AREA_START 0xE0000
+#define BIOS_AREA_END 0x100000
+#define RSDP_SIGNATURE "RSD PTR "
+#define MADT_SIGNATURE "APIC"
+
+#define MADT_LAPIC 0
+#define MADT_IOAPIC 1
+#define MADT_ISO 2
+#define MADT_LAPIC_ADDR_OVERRIDE 5
+#define MADT_LAPIC_ENABLED 1
+
+struct acpi_rsdp {
+    char signature[8];
+    uint8_t checksum;
+    char oem_id[6];
+    uint8_t revision;
+    uint32_t rsdt_addr;
+} __attribute__((packed));
+
+typedef struct acpi_rsdp acpi_rsdp_t;
+
+struct acpi_sdt_header {
+    char signature[4];
+    uint32_t length;
+    uint8_t revision;
+    uint8_t checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    uint32_t oem_revision;
+    uint32_t creator_id;
+    uint32_t creator_revision;
+} __attribute__((packed));
+
+typedef struct acpi_sdt_header acpi_sdt_header_t;
+
+struct acpi_madt {
+    acpi_sdt_header_t header;
+    uint32_t lapic_addr;
+    uint32_t flags;
+} __attribute__((packed));
+
+typedef struct acpi_madt acpi_madt_t;
+
+struct madt_entry {
+    uint8_t type;
+    uint8_t length;
+} __attribute__((packed));
+
+struct madt_lapic {
+    struct madt_entry entry;
+    uint8_t acpi_id;
+    uint8_t apic_id;
+    uint32_t flags;
+} __attribute__((packed));
+
+struct madt_ioapic {
+    struct madt_entry entry;
+    uint8_t id;
+    uint8_t reserved;
+    uint32_t addr;
+    uint32_t gsi_base;
+} __attribute__((packed));
+
+struct madt_iso {
+    struct madt_entry entry;
+    uint8_t bus;
+    uint8_t source; // ISA IRQ
+    uint32_t gsi;
+    uint16_t flags;
+} __attribute__((packed));
+
+struct madt_lapic_addr_override {
+    struct madt_entry entry;
+    uint16_t reserved;
+    uint32_t addr_low;
+    uint32_t addr_high;
+} __attribute__((packed));
+
+static bool checksum_ok(const void* table, size_t length);
+static acpi_rsdp_t* find_rsdp_in(uint32_t start, uint32_t end);
+static acpi_rsdp_t* find_rsdp(void);
+static acpi_sdt_header_t* map_table(uint32_t phys);
+static void parse_madt_entries(acpi_madt_t* madt, acpi_madt_info_t* info);
+
+static bool checksum_ok(const void* table, size_t length) {
+    const uint8_t* bytes = (const uint8_t*) table;
+    uint8_t sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum = (uint8_t) (sum + bytes[i]);
+    }
+    return sum == 0;
+}
+
+static acpi_rsdp_t* find_rsdp_in(uint32_t start, uint32_t end) {
+    // The RSDP is always aligned on 16 bytes
+    for (uint32_t addr = start; addr < end; addr += 16) {
+        acpi_rsdp_t* rsdp = (acpi_rsdp_t*) (addr + KERNEL_OFFSET);
+        if (memcmp(rsdp->signature, RSDP_SIGNATURE, 8) == 0
+                && checksum_ok(rsdp, sizeof(acpi_rsdp_t))) {
+            return rsdp;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * The RSDP is either in the first KiB of the EBDA or in the BIOS read-only
+ * area, both are in the first MiB which is mapped at boot
+ */
+static acpi_rsdp_t* find_rsdp() {
+    uint32_t ebda = (uint32_t) (*(uint16_t*) (EBDA_SEGMENT_PTR + KERNEL_OFFSET)) << 4;
+    acpi_rsdp_t* rsdp = NULL;
+    if (ebda != 0 && ebda < BIOS_AREA_START) {
+        rsdp = find_rsdp_in(ebda, ebda + 1024);
+    }
+    if (rsdp == NULL) {
+        rsdp = find_rsdp_in(BIOS_AREA_START, BIOS_AREA_END);
+    }
+    return rsdp;
+}
+
+static acpi_sdt_header_t* map_table(uint32_t phys) {
+    acpi_sdt_header_t* header = vmm__map_physical(phys, sizeof(acpi_sdt_header_t), 0);
+    if (header->length <= PAGE_SIZE - phys % PAGE_SIZE) {
+        // The whole table is in the page which has just been mapped
+        return header;
+    }
+    return vmm__map_physical(phys, header->length, 0);
+}
+
+static void parse_madt_entries(acpi_madt_t* madt, acpi_madt_info_t* info) {
+    char* entries = (char*) madt + sizeof(acpi_madt_t);
+    char* end = (char*) madt + madt->header.length;
+    while (entries < end) {
+        struct madt_entry* entry = (struct madt_entry*) entries;
+        if (entry->length == 0) {
+            break;
+        }
+        switch (entry->type) {
+            case MADT_LAPIC:
+                {
+                    struct madt_lapic* lapic = (struct madt_lapic*) entry;
+                    if ((lapic->flags & MADT_LAPIC_ENABLED) && info->cpus_count < ACPI_MAX_CPUS) {
+                        info->cpu_apic_ids[info->cpus_count++] = lapic->apic_id;
+                    }
+                    break;
+                }
+            case MADT_IOAPIC:
+                {
+                    struct madt_ioapic* ioapic = (struct madt_ioapic*) entry;
+                    if (info->ioapics_count < ACPI_MAX_IOAPICS) {
+                        acpi_ioapic_t* dst = &info->ioapics[info->ioapics_count++];
+                        dst->id = ioapic->id;
+                        dst->addr = ioapic->addr;
+                        dst->gsi_base = ioapic->gsi_base;
+                    }
+                    break;
+                }
+            case MADT_ISO:
+                {
+                    struct madt_iso* iso = (struct madt_iso*) entry;
+                    if (iso->bus == 0 && iso->source < ACPI_ISA_IRQS) {
+                        info->isa_irq_gsi[iso->source] = iso->gsi;
+                        info->isa_irq_flags[iso->source] = iso->flags;
+                    }
+                    break;
+                }
+            case MADT_LAPIC_ADDR_OVERRIDE:
+                {
+                    struct madt_lapic_addr_override* override = (struct madt_lapic_addr_override*) entry;
+                    if (override->addr_high == 0) {
+                        info->lapic_addr = override->addr_low;
+                    }
+                    break;
+                }
+            default:
+                break;
+        }
+        entries += entry->length;
+    }
+}
+
+bool acpi__parse_madt(acpi_madt_info_t* info) {
+    acpi_rsdp_t* rsdp = find_rsdp();
+    if (rsdp == NULL) {
+        debug("ACPI: no RSDP found");
+        return false;
+    }
+    acpi_sdt_header_t* rsdt = map_table(rsdp->rsdt_addr);
+    if (memcmp(rsdt->signature, "RSDT", 4) != 0 || !checksum_ok(rsdt, rsdt->length)) {
+        debug("ACPI: invalid RSDT at 0x%x", rsdp->rsdt_addr);
+        return false;
+    }
+
+    uint32_t* tables = (uint32_t*) ((char*) rsdt + sizeof(acpi_sdt_header_t));
+    size_t tables_count = (rsdt->length - sizeof(acpi_sdt_header_t)) / sizeof(uint32_t);
+    for (size_t i = 0; i < tables_count; i++) {
+        acpi_sdt_header_t* table = map_table(tables[i]);
+        if (memcmp(table->signature, MADT_SIGNATURE, 4) != 0) {
+            continue;
+        }
+        if (!checksum_ok(table, table->length)) {
+            debug("ACPI: invalid MADT checksum");
+            return false;
+        }
+
+        acpi_madt_t* madt = (acpi_madt_t*) table;
+        info->lapic_addr = madt->lapic_addr;
+        info->cpus_count = 0;
+        info->ioapics_count = 0;
+        // ISA IRQs are identity mapped unless overridden
+        for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+            info->isa_irq_gsi[irq] = irq;
+            info->isa_irq_flags[irq] = 0;
+        }
+        parse_madt_entries(madt, info);
+        debug("ACPI: MADT found, %u CPUs, %u IO-APICs, LAPIC at 0x%x",
+                info->cpus_count, info->ioapics_count, info->lapic_addr);
+        return info->ioapics_count > 0;
+    }
+    debug("ACPI: no MADT found");
+    return false;
+}
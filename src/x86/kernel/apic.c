@@ -0,0 +1,240 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/apic.h"
+#include "kernel/acpi.h"
+#include "kernel/pic.h"
+#include "kernel/cpu.h"
+#include "kernel/clock.h"
+#include "kernel/vmm.h"
+#include "kernel/utils.h"
+#include "kernel/interrupt_handlers.h"
+
+#define IA32_APIC_BASE_MSR 0x1B
+#define IA32_APIC_BASE_ENABLE 0x800
+
+// Local APIC registers (byte offsets)
+#define LAPIC_ID 0x20
+#define LAPIC_TPR 0x80
+#define LAPIC_EOI 0xB0
+#define LAPIC_SVR 0xF0
+#define LAPIC_SVR_ENABLE 0x100
+#define LAPIC_ICR_LOW 0x300
+#define LAPIC_ICR_HIGH 0x310
+#define LAPIC_LVT_TIMER 0x320
+#define LAPIC_TIMER_INITIAL 0x380
+#define LAPIC_TIMER_CURRENT 0x390
+#define LAPIC_TIMER_DIVIDE 0x3E0
+
+// Interrupt command register flags
+#define ICR_INIT 0x500
+#define ICR_STARTUP 0x600
+#define ICR_ASSERT 0x4000
+#define ICR_DELIVERY_PENDING 0x1000
+
+// Local timer
+#define LVT_MASKED (1 << 16)
+#define LVT_TIMER_PERIODIC (1 << 17)
+#define TIMER_DIVIDE_16 0x3
+#define TIMER_CALIBRATION_MS 10
+
+// IO-APIC registers
+#define IOAPIC_REGSEL 0x00
+#define IOAPIC_WINDOW 0x10
+#define IOAPIC_VERSION 0x01
+#define IOAPIC_REDIRECTION_TABLE 0x10
+
+// IO-APIC redirection entry flags
+#define IOAPIC_POLARITY_LOW (1 << 13)
+#define IOAPIC_TRIGGER_LEVEL (1 << 15)
+#define IOAPIC_MASKED (1 << 16)
+
+// Default QEMU (-machine pc) layout, used when there is no MADT
+#define DEFAULT_LAPIC_ADDR 0xFEE00000
+#define DEFAULT_IOAPIC_ADDR 0xFEC00000
+#define DEFAULT_TIMER_GSI 2
+
+#define ISA_CASCADE_IRQ 2
+
+static void default_info(acpi_madt_info_t* madt);
+static uint32_t ioapic__read(size_t index, uint32_t reg);
+static void ioapic__write(size_t index, uint32_t reg, uint32_t value);
+static void ioapic__route(uint32_t gsi, uint8_t vector, uint16_t flags, uint8_t dest);
+static void enable_lapic(void);
+static void send_icr(uint8_t apic_id, uint32_t command);
+
+volatile uint32_t* apic__eoi_register = NULL;
+
+static acpi_madt_info_t info;
+static volatile uint32_t* lapic;
+static volatile uint32_t* ioapics[ACPI_MAX_IOAPICS];
+static uint32_t ioapics_entries[ACPI_MAX_IOAPICS];
+// Local timer count per period, measured by apic__timer_calibrate
+static uint32_t timer_count;
+
+static void default_info(acpi_madt_info_t* madt) {
+    madt->lapic_addr = DEFAULT_LAPIC_ADDR;
+    madt->cpus_count = 0;
+    madt->ioapics_count = 1;
+    madt->ioapics[0].id = 0;
+    madt->ioapics[0].addr = DEFAULT_IOAPIC_ADDR;
+    madt->ioapics[0].gsi_base = 0;
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        madt->isa_irq_gsi[irq] = irq;
+        madt->isa_irq_flags[irq] = 0;
+    }
+    // The PIT is connected to the pin 2 of the IO-APIC
+    madt->isa_irq_gsi[0] = DEFAULT_TIMER_GSI;
+}
+
+static uint32_t ioapic__read(size_t index, uint32_t reg) {
+    ioapics[index][IOAPIC_REGSEL / 4] = reg;
+    return ioapics[index][IOAPIC_WINDOW / 4];
+}
+
+static void ioapic__write(size_t index, uint32_t reg, uint32_t value) {
+    ioapics[index][IOAPIC_REGSEL / 4] = reg;
+    ioapics[index][IOAPIC_WINDOW / 4] = value;
+}
+
+/**
+ * Deliver the global system interrupt gsi to the CPU whose local APIC id
+ * is dest, with the given vector
+ */
+static void ioapic__route(uint32_t gsi, uint8_t vector, uint16_t flags, uint8_t dest) {
+    for (size_t i = 0; i < info.ioapics_count; i++) {
+        uint32_t base = info.ioapics[i].gsi_base;
+        if (gsi < base || gsi >= base + ioapics_entries[i]) {
+            continue;
+        }
+        uint32_t low = vector;
+        if ((flags & ACPI_INTI_POLARITY_MASK) == ACPI_INTI_POLARITY_LOW) {
+            low |= IOAPIC_POLARITY_LOW;
+        }
+        if ((flags & ACPI_INTI_TRIGGER_MASK) == ACPI_INTI_TRIGGER_LEVEL) {
+            low |= IOAPIC_TRIGGER_LEVEL;
+        }
+        uint32_t reg = IOAPIC_REDIRECTION_TABLE + 2 * (gsi - base);
+        ioapic__write(i, reg + 1, (uint32_t) dest << 24);
+        ioapic__write(i, reg, low);
+        return;
+    }
+    debug("APIC: no IO-APIC handles GSI %u", gsi);
+}
+
+bool apic__init() {
+    uint32_t eax, ebx, ecx, edx;
+    cpu__cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_APIC) || !(edx & CPUID_FEAT_EDX_MSR)) {
+        return false;
+    }
+
+    if (!acpi__parse_madt(&info)) {
+        debug("APIC: using the default QEMU interrupt routing");
+        default_info(&info);
+    }
+
+    uint32_t flags = cpu__irq_save();
+
+    lapic = vmm__map_physical(info.lapic_addr, PAGE_SIZE,
+            PAGE_WRITABLE | PAGE_WRITE_THROUGH | PAGE_CACHE_DISABLE);
+    for (size_t i = 0; i < info.ioapics_count; i++) {
+        ioapics[i] = vmm__map_physical(info.ioapics[i].addr, PAGE_SIZE,
+                PAGE_WRITABLE | PAGE_WRITE_THROUGH | PAGE_CACHE_DISABLE);
+        ioapics_entries[i] = ((ioapic__read(i, IOAPIC_VERSION) >> 16) & 0xff) + 1;
+        // Mask every pin until it is routed
+        for (uint32_t pin = 0; pin < ioapics_entries[i]; pin++) {
+            ioapic__write(i, IOAPIC_REDIRECTION_TABLE + 2 * pin, IOAPIC_MASKED);
+        }
+    }
+
+    // From now on, the PICs must not deliver anything
+    pic__disable();
+
+    enable_lapic();
+    apic__eoi_register = &lapic[LAPIC_EOI / 4];
+
+    if (info.cpus_count == 0) {
+        info.cpu_apic_ids[0] = apic__id();
+        info.cpus_count = 1;
+    }
+
+    // Route the ISA IRQs to the same vectors as with the PICs
+    uint8_t bsp = apic__id();
+    for (uint32_t irq = 0; irq < ACPI_ISA_IRQS; irq++) {
+        if (irq == ISA_CASCADE_IRQ) {
+            continue;
+        }
+        ioapic__route(info.isa_irq_gsi[irq], (uint8_t) (IRQ0 + irq), info.isa_irq_flags[irq], bsp);
+    }
+
+    cpu__irq_restore(flags);
+    debug("APIC: local APIC 0x%x enabled, %u IO-APICs", info.lapic_addr, info.ioapics_count);
+    return true;
+}
+
+static void enable_lapic() {
+    uint64_t apic_base = cpu__rdmsr(IA32_APIC_BASE_MSR);
+    cpu__wrmsr(IA32_APIC_BASE_MSR, apic_base | IA32_APIC_BASE_ENABLE);
+    lapic[LAPIC_SVR / 4] = LAPIC_SVR_ENABLE | IRQ_SPURIOUS;
+    lapic[LAPIC_TPR / 4] = 0;
+}
+
+static void send_icr(uint8_t apic_id, uint32_t command) {
+    lapic[LAPIC_ICR_HIGH / 4] = (uint32_t) apic_id << 24;
+    // Writing the low half sends the IPI
+    lapic[LAPIC_ICR_LOW / 4] = command;
+    while (lapic[LAPIC_ICR_LOW / 4] & ICR_DELIVERY_PENDING) {
+        cpu__pause();
+    }
+}
+
+void apic__init_ap() {
+    enable_lapic();
+}
+
+void apic__send_ipi(uint8_t apic_id, uint8_t vector) {
+    uint32_t flags = cpu__irq_save();
+    send_icr(apic_id, ICR_ASSERT | vector);
+    cpu__irq_restore(flags);
+}
+
+void apic__send_init(uint8_t apic_id) {
+    send_icr(apic_id, ICR_ASSERT | ICR_INIT);
+}
+
+void apic__send_startup(uint8_t apic_id, uint32_t trampoline) {
+    send_icr(apic_id, ICR_ASSERT | ICR_STARTUP | (trampoline >> 12));
+}
+
+void apic__timer_calibrate(uint32_t frequency) {
+    // Count the local timer decrements during a measured delay
+    lapic[LAPIC_TIMER_DIVIDE / 4] = TIMER_DIVIDE_16;
+    lapic[LAPIC_LVT_TIMER / 4] = LVT_MASKED;
+    lapic[LAPIC_TIMER_INITIAL / 4] = 0xffffffff;
+    clock__delay_us(TIMER_CALIBRATION_MS * 1000);
+    uint32_t elapsed = 0xffffffff - lapic[LAPIC_TIMER_CURRENT / 4];
+    lapic[LAPIC_TIMER_INITIAL / 4] = 0;
+
+    timer_count = elapsed * (1000 / TIMER_CALIBRATION_MS) / frequency;
+    debug("APIC: local timer count %u for %u Hz", timer_count, frequency);
+}
+
+void apic__timer_start() {
+    lapic[LAPIC_TIMER_DIVIDE / 4] = TIMER_DIVIDE_16;
+    lapic[LAPIC_LVT_TIMER / 4] = LVT_TIMER_PERIODIC | IRQ_LAPIC_TIMER;
+    lapic[LAPIC_TIMER_INITIAL / 4] = timer_count;
+}
+
+void apic__eoi() {
+    *apic__eoi_register = 0;
+}
+
+uint8_t apic__id() {
+    return (uint8_t) (lapic[LAPIC_ID / 4] >> 24);
+}
+
+const acpi_madt_info_t* apic__info() {
+    return &info;
+}
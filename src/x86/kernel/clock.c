@@ -0,0 +1,125 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/clock.h"
+#include "kernel/cpu.h"
+#include "kernel/utils.h"
+#include "drivers/pit.h"
+
+#define CALIBRATION_RUNS 5
+#define CALIBRATION_MS 10
+#define CALIBRATION_COUNT (PIT_INPUT_FREQUENCY * CALIBRATION_MS / 1000)
+// Runs differing by more than 1/TOLERANCE are considered unstable
+#define CALIBRATION_TOLERANCE 100
+
+// ns = cycles * mult >> MULT_SHIFT
+#define MULT_SHIFT 24
+#define NS_PER_SECOND 1000000000ULL
+
+#define CPUID_EXT_MAX 0x80000000
+#define CPUID_EXT_POWER 0x80000007
+#define CPUID_INVARIANT_TSC (1 << 8)
+
+static bool tsc_usable(void);
+static uint64_t calibrate(void);
+
+static bool use_tsc;
+static uint64_t tsc_base;
+static uint32_t mult;
+static uint32_t tsc_khz;
+static uint32_t ns_per_tick;
+static uint32_t tick_base;
+
+static bool tsc_usable() {
+    uint32_t eax, ebx, ecx, edx;
+    cpu__cpuid(1, &eax, &ebx, &ecx, &edx);
+    if (!(edx & CPUID_FEAT_EDX_TSC)) {
+        return false;
+    }
+    cpu__cpuid(CPUID_EXT_MAX, &eax, &ebx, &ecx, &edx);
+    if (eax >= CPUID_EXT_POWER) {
+        cpu__cpuid(CPUID_EXT_POWER, &eax, &ebx, &ecx, &edx);
+        if (!(edx & CPUID_INVARIANT_TSC)) {
+            debug("clock: the TSC is not invariant");
+        }
+    }
+    return true;
+}
+
+/**
+ * Count the TSC cycles elapsed during CALIBRATION_MS, several times
+ * @returns the smallest count, or 0 if the runs disagree
+ */
+static uint64_t calibrate() {
+    uint64_t min = UINT64_MAX;
+    uint64_t max = 0;
+    for (int i = 0; i < CALIBRATION_RUNS; i++) {
+        uint64_t start = cpu__rdtsc();
+        pit__ch2_wait(CALIBRATION_COUNT);
+        uint64_t cycles = cpu__rdtsc() - start;
+        if (cycles < min) {
+            min = cycles;
+        }
+        if (cycles > max) {
+            max = cycles;
+        }
+    }
+    if (max - min > min / CALIBRATION_TOLERANCE) {
+        debug("clock: TSC calibration unstable (min %u, max %u cycles)", (uint32_t) min, (uint32_t) max);
+        return 0;
+    }
+    return min;
+}
+
+void clock__init() {
+    ns_per_tick = (uint32_t) (NS_PER_SECOND / pit__get_frequency());
+    tick_base = pit__get_ticks();
+    use_tsc = false;
+
+    uint64_t cycles = tsc_usable() ? calibrate() : 0;
+    if (cycles == 0) {
+        debug("clock: falling back to the PIT ticks (%u ns resolution)", ns_per_tick);
+        return;
+    }
+
+    uint64_t hz = cycles * PIT_INPUT_FREQUENCY / CALIBRATION_COUNT;
+    tsc_khz = (uint32_t) (hz / 1000);
+    mult = (uint32_t) ((NS_PER_SECOND << MULT_SHIFT) / hz);
+    tsc_base = cpu__rdtsc();
+    use_tsc = true;
+    debug("clock: TSC calibrated at %u kHz", tsc_khz);
+}
+
+void clock__delay_us(uint32_t us) {
+    if (!use_tsc) {
+        // The count of channel 2 is 16 bits wide: at most about 54 ms
+        while (us > 0) {
+            uint32_t step = (us < 50000) ? us : 50000;
+            pit__ch2_wait((uint16_t) ((uint64_t) PIT_INPUT_FREQUENCY * step / 1000000));
+            us -= step;
+        }
+        return;
+    }
+    uint64_t end = cpu__rdtsc() + (uint64_t) us * tsc_khz / 1000;
+    while (cpu__rdtsc() < end) {
+        cpu__pause();
+    }
+}
+
+uint64_t clock__cycles_to_ns(uint64_t cycles) {
+    // 64 bits x 32 bits multiplication, without overflowing
+    uint32_t high = (uint32_t) (cycles >> 32);
+    uint32_t low = (uint32_t) cycles;
+    return (((uint64_t) high * mult) << (32 - MULT_SHIFT)) + (((uint64_t) low * mult) >> MULT_SHIFT);
+}
+
+uint64_t clock__now_ns() {
+    if (use_tsc) {
+        return clock__cycles_to_ns(cpu__rdtsc() - tsc_base);
+    }
+    return (uint64_t) (pit__get_ticks() - tick_base) * ns_per_tick;
+}
+
+uint32_t clock__tsc_khz() {
+    return use_tsc ? tsc_khz : 0;
+}
@@ -0,0 +1,44 @@
+#include <stdint.h>
+
+#include "kernel/interrupt_handlers.h"
+#include "kernel/bench.h"
+
+// Round-trip cost (int + iret) of a software interrupt through the original
+// entry stub and through the lean one
+
+static int_result_t bench_handler(registers_t* regs);
+static void trigger_legacy(void);
+static void trigger_lean(void);
+static void register_handlers(void);
+static void unregister_handlers(void);
+
+static int_result_t bench_handler(registers_t* regs) {
+    (void) regs;
+    return INT_HANDLED;
+}
+
+static void trigger_legacy() {
+    __asm__ __volatile__ ("int %0" : : "i" (INT_BENCH_LEGACY) : "memory");
+}
+
+static void trigger_lean() {
+    __asm__ __volatile__ ("int %0" : : "i" (INT_BENCH_LEAN) : "memory");
+}
+
+static void register_handlers() {
+    interrupt_handlers__register(INT_BENCH_LEGACY, bench_handler);
+    interrupt_handlers__register(INT_BENCH_LEAN, bench_handler);
+}
+
+static void unregister_handlers() {
+    interrupt_handlers__unregister(INT_BENCH_LEGACY, bench_handler);
+    interrupt_handlers__unregister(INT_BENCH_LEAN, bench_handler);
+}
+
+BENCH_FIXTURE(interrupt_round_trip_legacy, register_handlers, unregister_handlers) {
+    trigger_legacy();
+}
+
+BENCH_FIXTURE(interrupt_round_trip_lean, register_handlers, unregister_handlers) {
+    trigger_lean();
+}
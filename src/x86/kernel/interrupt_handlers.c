@@ -1,13 +1,87 @@
 #include <stdint.h>
+#include <stddef.h>
+
 #include "kernel/interrupt_handlers.h"
+#include "kernel/cpu.h"
+#include "libk/stdio.h"
+
+#define VECTORS_NUMBER 256
+#define MAX_SHARED_HANDLERS 4
 
-static int_handler_t interrupt_handlers[256];
+// Handlers of each vector, NULL terminated. The table is updated when a
+// handler is (un)registered so that dispatching an interrupt is a walk
+// over a small array, without any lookup.
+static int_handler_t handlers[VECTORS_NUMBER][MAX_SHARED_HANDLERS + 1];
+static int_stats_t stats[VECTORS_NUMBER];
 
-void interrupt_handlers__register(uint8_t num, int_handler_t handler) {
-    interrupt_handlers[num] = handler;
+int interrupt_handlers__register(uint8_t num, int_handler_t handler) {
+    uint32_t flags = cpu__irq_save();
+    size_t count = 0;
+    while (handlers[num][count] != NULL) {
+        count++;
+    }
+    if (count == MAX_SHARED_HANDLERS) {
+        cpu__irq_restore(flags);
+        return -1;
+    }
+    // Append at the end of the chain to keep the registration order
+    handlers[num][count] = handler;
+    cpu__irq_restore(flags);
+    return 0;
 }
 
-int_handler_t interrupt_handlers__get(uint8_t num) {
-    return interrupt_handlers[num];
+int interrupt_handlers__unregister(uint8_t num, int_handler_t handler) {
+    uint32_t flags = cpu__irq_save();
+    for (size_t i = 0; handlers[num][i] != NULL; i++) {
+        if (handlers[num][i] == handler) {
+            for (; handlers[num][i] != NULL; i++) {
+                handlers[num][i] = handlers[num][i + 1];
+            }
+            cpu__irq_restore(flags);
+            return 0;
+        }
+    }
+    cpu__irq_restore(flags);
+    return -1;
 }
 
+int_result_t interrupt_handlers__dispatch(registers_t* regs) {
+    uint8_t num = (uint8_t) regs->int_no;
+    int_result_t result = INT_UNHANDLED;
+
+    uint64_t start = cpu__rdtsc();
+    for (int_handler_t* handler = handlers[num]; *handler != NULL; handler++) {
+        if ((*handler)(regs) == INT_HANDLED) {
+            result = INT_HANDLED;
+        }
+    }
+    uint32_t cycles = (uint32_t) (cpu__rdtsc() - start);
+
+    int_stats_t* vector_stats = &stats[num];
+    vector_stats->count++;
+    vector_stats->total_cycles += cycles;
+    if (cycles > vector_stats->max_cycles) {
+        vector_stats->max_cycles = cycles;
+    }
+    if (result == INT_UNHANDLED) {
+        vector_stats->unhandled++;
+    }
+    return result;
+}
+
+const int_stats_t* interrupt_handlers__stats(uint8_t num) {
+    return &stats[num];
+}
+
+void interrupt_handlers__dump_stats() {
+    printf("vector\tcount\tunhandled\tavg cycles\tmax cycles\n");
+    for (size_t num = 0; num < VECTORS_NUMBER; num++) {
+        int_stats_t* vector_stats = &stats[num];
+        if (vector_stats->count == 0) {
+            continue;
+        }
+        uint32_t avg = (uint32_t) (vector_stats->total_cycles / vector_stats->count);
+        printf("%u\t%u\t%u\t%u\t%u\n", num, vector_stats->count,
+                vector_stats->unhandled, avg, vector_stats->max_cycles);
+    }
+}
@@ -1,28 +1,65 @@
 #include <stdint.h>
 #include <stddef.h>
+#include <stdbool.h>
 
 #include "kernel/registers.h"
-#include "drivers/io.h"
 #include "kernel/interrupt_handlers.h"
-
-#define PIC1_COMMAND 0x20
-#define PIC2_COMMAND 0xA0
-#define PIC_EOI 0x20
+#include "kernel/workqueue.h"
+#include "kernel/irq.h"
+#include "kernel/apic.h"
+#include "kernel/pic.h"
+#include "kernel/utils.h"
+#include "kernel/sched.h"
+#include "kernel/percpu.h"
+#include "kernel/cpu.h"
+#include "kernel/trace.h"
 
 void irq__handler(registers_t*);
 
+static bool apic_enabled = false;
+// Number of IRQs being handled by each CPU: only the outermost one may
+// switch threads
+static uint32_t nesting[MAX_CPUS];
+
+void irq__init() {
+    apic_enabled = apic__init();
+    if (apic_enabled) {
+        debug("IRQs are delivered by the IO-APIC");
+    }
+    else {
+        debug("No local APIC, IRQs are delivered by the 8259 PICs");
+    }
+}
+
+bool irq__in_interrupt() {
+    uint32_t flags = cpu__irq_save();
+    bool in_interrupt = nesting[percpu__id()] != 0;
+    cpu__irq_restore(flags);
+    return in_interrupt;
+}
+
 void irq__handler(registers_t* regs) {
-    // Send an EOI (End Of Interrupt) signal to the PICs.
-    
-    // Send reset signal to master
-    outb(PIC1_COMMAND, PIC_EOI);
-    
-    // If this inrrupt involved the slave
-    if (regs->int_no >= 40) {
-        outb(PIC2_COMMAND, PIC_EOI);
+    // Send an EOI (End Of Interrupt) signal to the interrupt controller.
+    // With the APIC this is a single memory write instead of port I/O.
+    if (apic_enabled) {
+        apic__eoi();
+    }
+    else {
+        pic__eoi(regs->int_no);
     }
-    int_handler_t handler = interrupt_handlers__get((uint8_t) regs->int_no); 
-    if (handler != NULL) {
-        handler(regs);
+
+    uint32_t* cpu_nesting = &nesting[percpu__id()];
+    (*cpu_nesting)++;
+    TRACE(TRACE_IRQ_ENTRY, regs->int_no, regs->eip, 0);
+    interrupt_handlers__dispatch(regs);
+    TRACE(TRACE_IRQ_EXIT, regs->int_no, 0, 0);
+
+    // The interrupt has been acknowledged: run the bottom halves scheduled by the
+    // handlers with interrupts enabled
+    workqueue__run();
+    (*cpu_nesting)--;
+
+    if (*cpu_nesting == 0) {
+        sched__preempt();
     }
 }
@@ -6,8 +6,5 @@
 void isr__handler(registers_t* regs);
 
 void isr__handler(registers_t* regs) {
-    int_handler_t handler = interrupt_handlers__get((uint8_t) regs->int_no);
-   if (handler != NULL) {
-       handler(regs);
-   }
+    interrupt_handlers__dispatch(regs);
 }
@@ -0,0 +1,46 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/percpu.h"
+#include "kernel/apic.h"
+#include "boot/gdt.h"
+
+static cpu_t cpus[MAX_CPUS];
+// Local APIC id to CPU index
+static uint8_t apic_to_index[256];
+static volatile uint32_t online_count;
+
+void percpu__init() {
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        cpus[i].self = &cpus[i];
+        cpus[i].index = i;
+        cpus[i].apic_id = 0;
+        cpus[i].online = false;
+    }
+    cpus[0].online = true;
+    online_count = 1;
+}
+
+cpu_t* percpu__get(uint32_t index) {
+    return &cpus[index];
+}
+
+void percpu__set_online(uint32_t index, uint8_t apic_id) {
+    cpus[index].apic_id = apic_id;
+    apic_to_index[apic_id] = (uint8_t) index;
+    if (!cpus[index].online) {
+        cpus[index].online = true;
+        __asm__ __volatile__ ("lock incl %0" : "+m" (online_count) : : "memory");
+    }
+}
+
+uint32_t percpu__online_count() {
+    return online_count;
+}
+
+void percpu__reload_gs() {
+    // Without APs, there is no need to ask the local APIC
+    uint32_t index = (online_count > 1) ? apic_to_index[apic__id()] : 0;
+    gdt__load_percpu(index);
+}
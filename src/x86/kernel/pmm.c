@@ -5,6 +5,8 @@
 #include "boot/multiboot.h"
 #include "libk/bitset.h"
 #include "kernel/utils.h"
+#include "kernel/spinlock.h"
+#include "kernel/trace.h"
 
 #define FRAME_SIZE 4096 // 0x1000
 
@@ -14,6 +16,10 @@ static void clear_available_frames(multiboot_memory_map_t* mmap,
         multiboot_uint32_t length);
 
 static bitset_t* frames_bitset;
+// Index of the frame following the last available one
+static size_t available_end;
+static volatile size_t frames_available;
+static spinlock_t frames_lock = SPINLOCK_INIT;
 
 static size_t compute_frames_number(multiboot_memory_map_t* mmap, 
         multiboot_uint32_t length) {
@@ -51,7 +57,13 @@ static void clear_available_frames(multiboot_memory_map_t* mmap,
             }
             size_t index_end = index_start + mmap->len_low / FRAME_SIZE;
             index_start = (index_start < 1024) ? 1024 : index_start; 
+            if (index_end > available_end) {
+                available_end = index_end;
+            }
             for (size_t i = index_start; i < index_end; i++) {
+                if (bitset__test(i, frames_bitset) == 1) {
+                    frames_available++;
+                }
                 bitset__clear(i, frames_bitset);            
             }
         }
@@ -85,13 +97,84 @@ void pmm__init(multiboot_memory_map_t* mmap, multiboot_uint32_t length) {
  * @returns the physical address of the allocated frame 
  */
 uint32_t pmm__alloc_frame() {
+    uint32_t flags = spinlock__lock_irqsave(&frames_lock);
     int frame_index = bitset__set_first_clear(frames_bitset);
+    if (frame_index != -1) {
+        frames_available--;
+    }
+    spinlock__unlock_irqrestore(&frames_lock, flags);
     if (frame_index == -1) {
         PANIC("No available frames");
     }
+    TRACE(TRACE_PMM_ALLOC_FRAME, (uint32_t) frame_index * FRAME_SIZE, 0, 0);
     return (size_t) frame_index * FRAME_SIZE;
 }
 
-void pmm__free_frame(size_t frame) {
-    bitset__clear(frame, frames_bitset);
+void pmm__free_frame(uint32_t frame_addr) {
+    uint32_t flags = spinlock__lock_irqsave(&frames_lock);
+    if (bitset__test(frame_addr / FRAME_SIZE, frames_bitset) == 1) {
+        frames_available++;
+    }
+    bitset__clear(frame_addr / FRAME_SIZE, frames_bitset);
+    spinlock__unlock_irqrestore(&frames_lock, flags);
+}
+
+uint32_t pmm__alloc_frames(size_t count) {
+    uint32_t flags = spinlock__lock_irqsave(&frames_lock);
+    size_t size = bitset__size(frames_bitset);
+    size_t start = 0;
+    size_t length = 0;
+    for (size_t i = 0; i < size && length < count; i++) {
+        if (bitset__test(i, frames_bitset) == 0) {
+            if (length == 0) {
+                start = i;
+            }
+            length++;
+        }
+        else {
+            length = 0;
+        }
+    }
+    if (length < count) {
+        spinlock__unlock_irqrestore(&frames_lock, flags);
+        return 0;
+    }
+    for (size_t i = start; i < start + count; i++) {
+        bitset__set(i, frames_bitset);
+    }
+    frames_available -= count;
+    spinlock__unlock_irqrestore(&frames_lock, flags);
+    return (uint32_t) start * FRAME_SIZE;
+}
+
+void pmm__free_frames(uint32_t frame_addr, size_t count) {
+    uint32_t flags = spinlock__lock_irqsave(&frames_lock);
+    for (size_t i = 0; i < count; i++) {
+        if (bitset__test(frame_addr / FRAME_SIZE + i, frames_bitset) == 1) {
+            frames_available++;
+        }
+        bitset__clear(frame_addr / FRAME_SIZE + i, frames_bitset);
+    }
+    spinlock__unlock_irqrestore(&frames_lock, flags);
+}
+
+void pmm__reserve(uint32_t start, uint32_t end) {
+    uint32_t flags = spinlock__lock_irqsave(&frames_lock);
+    for (uint32_t frame = start / FRAME_SIZE; frame < (end + FRAME_SIZE - 1) / FRAME_SIZE
+            && frame < bitset__size(frames_bitset); frame++) {
+        if (bitset__test(frame, frames_bitset) == 0) {
+            frames_available--;
+        }
+        bitset__set(frame, frames_bitset);
+    }
+    spinlock__unlock_irqrestore(&frames_lock, flags);
+}
+
+size_t pmm__available() {
+    return frames_available;
+}
+
+uint32_t pmm__memory_end() {
+    // The last frame of the 32-bit space ends at 4 GiB, which does not fit
+    return (available_end >= 0x100000) ? 0xFFFFF000 : (uint32_t) available_end * FRAME_SIZE;
 }
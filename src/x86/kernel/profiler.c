@@ -0,0 +1,222 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "kernel/profiler.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/percpu.h"
+#include "kernel/thread.h"
+#include "kernel/sched.h"
+#include "kernel/kmem.h"
+#include "kernel/cpu.h"
+#include "kernel/ksym.h"
+#include "drivers/pit.h"
+#include "drivers/serial.h"
+#include "libk/stdio.h"
+
+#define KERNEL_OFFSET 0xC0000000
+#define REPORT_MAX_FUNCTIONS 64
+
+typedef struct {
+    const char* name;
+    uint32_t samples;
+} report_entry_t;
+
+typedef struct {
+    uint32_t eip;
+    uint32_t depth;
+    uint32_t callers[PROFILER_MAX_DEPTH];
+} sample_t;
+
+/*
+ * Samples of a CPU. The CPU is the only producer, moving head from its
+ * timer interrupt; profiler__dump is the only consumer, moving tail.
+ */
+typedef struct {
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint32_t next_tick; // tick of the next sample
+    uint32_t dropped; // samples lost because the ring was full
+    sample_t samples[PROFILER_RING_SIZE];
+} ring_t;
+
+static int_result_t sample_handler(registers_t* regs);
+static uint32_t walk_frames(registers_t* regs, uint32_t* callers, uint32_t max);
+
+static ring_t* rings[MAX_CPUS];
+static volatile bool running;
+static uint32_t period; // ticks between two samples
+static uint32_t max_depth;
+
+/**
+ * Follow the chain of saved %ebp of the interrupted kernel code
+ * @returns the number of return addresses stored in callers
+ */
+static uint32_t walk_frames(registers_t* regs, uint32_t* callers, uint32_t max) {
+    // The interrupted frames are above regs, on the stack of the current
+    // thread. The current thread can change before the stacks are switched.
+    thread_t* current = sched__current();
+    uint32_t low = (uint32_t) regs;
+    if (current == NULL || low < current->stack_bottom || low >= current->stack_top) {
+        return 0;
+    }
+    return ksym__walk_frames(regs->ebp, low, current->stack_top, callers, max);
+}
+
+static int_result_t sample_handler(registers_t* regs) {
+    ring_t* ring = rings[percpu__id()];
+    if (!running || ring == NULL) {
+        return INT_UNHANDLED;
+    }
+    uint32_t now = pit__get_ticks();
+    int_result_t result = INT_UNHANDLED;
+    if ((int32_t) (now - ring->next_tick) >= 0) {
+        ring->next_tick = now + period;
+        uint32_t head = ring->head;
+        if (head - ring->tail < PROFILER_RING_SIZE) {
+            sample_t* sample = &ring->samples[head % PROFILER_RING_SIZE];
+            sample->eip = regs->eip;
+            // Only kernel frames can be walked
+            sample->depth = (regs->cs & 3) ? 0 : walk_frames(regs, sample->callers, max_depth);
+            cpu__mb();
+            ring->head = head + 1;
+        }
+        else {
+            ring->dropped++;
+        }
+        result = INT_HANDLED;
+    }
+    if (regs->int_no == IRQ0) {
+        // The IRQ0 fast path skips the handlers until asked otherwise
+        pit__request_event(ring->next_tick);
+    }
+    return result;
+}
+
+int profiler__start(uint32_t frequency, uint32_t depth) {
+    if (running) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (percpu__get(i)->online && rings[i] == NULL) {
+            rings[i] = kmem__alloc(sizeof(ring_t), 0);
+            if (rings[i] == NULL) {
+                return -1;
+            }
+            rings[i]->head = 0;
+            rings[i]->tail = 0;
+            rings[i]->dropped = 0;
+        }
+    }
+    uint32_t tick_frequency = pit__get_frequency();
+    period = (frequency == 0 || frequency >= tick_frequency) ? 1 : tick_frequency / frequency;
+    max_depth = (depth < PROFILER_MAX_DEPTH) ? depth : PROFILER_MAX_DEPTH;
+    uint32_t now = pit__get_ticks();
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        if (rings[i] != NULL) {
+            rings[i]->next_tick = now + period;
+        }
+    }
+
+    running = true;
+    if (interrupt_handlers__register(IRQ0, sample_handler) != 0
+            || interrupt_handlers__register(IRQ_LAPIC_TIMER, sample_handler) != 0) {
+        profiler__stop();
+        return -1;
+    }
+    pit__request_event(now + period);
+    return 0;
+}
+
+void profiler__stop() {
+    running = false;
+    interrupt_handlers__unregister(IRQ0, sample_handler);
+    interrupt_handlers__unregister(IRQ_LAPIC_TIMER, sample_handler);
+}
+
+void profiler__dump() {
+    char line[32];
+    serial__writestring("profile begin\n");
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        ring_t* ring = rings[i];
+        if (ring == NULL) {
+            continue;
+        }
+        uint32_t head = ring->head;
+        cpu__mb();
+        for (uint32_t tail = ring->tail; tail != head; tail++) {
+            sample_t* sample = &ring->samples[tail % PROFILER_RING_SIZE];
+            snprintf(line, sizeof(line), "sample %u 0x%x", i, sample->eip);
+            serial__writestring(line);
+            for (uint32_t j = 0; j < sample->depth; j++) {
+                snprintf(line, sizeof(line), " 0x%x", sample->callers[j]);
+                serial__writestring(line);
+            }
+            serial__writestring("\n");
+        }
+        // The slots are given back once read
+        ring->tail = head;
+        if (ring->dropped != 0) {
+            snprintf(line, sizeof(line), "dropped %u %u\n", i, ring->dropped);
+            serial__writestring(line);
+            ring->dropped = 0;
+        }
+    }
+    serial__writestring("profile end\n");
+}
+
+void profiler__report(uint32_t count) {
+    static report_entry_t functions[REPORT_MAX_FUNCTIONS];
+    size_t used = 0;
+    uint32_t total = 0;
+    uint32_t others = 0; // samples of the functions which did not fit
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        ring_t* ring = rings[i];
+        if (ring == NULL) {
+            continue;
+        }
+        uint32_t head = ring->head;
+        cpu__mb();
+        for (uint32_t tail = ring->tail; tail != head; tail++) {
+            uint32_t eip = ring->samples[tail % PROFILER_RING_SIZE].eip;
+            const char* name = ksym__lookup(eip, NULL);
+            if (name == NULL) {
+                name = (eip < KERNEL_OFFSET) ? "[user]" : "?";
+            }
+            size_t j = 0;
+            while (j < used && functions[j].name != name) {
+                j++;
+            }
+            if (j == used && used < REPORT_MAX_FUNCTIONS) {
+                functions[used].name = name;
+                functions[used].samples = 0;
+                used++;
+            }
+            if (j < used) {
+                functions[j].samples++;
+            }
+            else {
+                others++;
+            }
+            total++;
+        }
+    }
+
+    // Few entries: insertion sort, most sampled first
+    for (size_t j = 1; j < used; j++) {
+        report_entry_t entry = functions[j];
+        size_t k = j;
+        while (k > 0 && functions[k - 1].samples < entry.samples) {
+            functions[k] = functions[k - 1];
+            k--;
+        }
+        functions[k] = entry;
+    }
+    printf("profile: %u samples\n", total);
+    for (size_t j = 0; j < used && j < count; j++) {
+        printf("%u%%\t%u\t%s\n", functions[j].samples * 100 / total, functions[j].samples, functions[j].name);
+    }
+    if (others != 0) {
+        printf("%u samples in other functions\n", others);
+    }
+}
@@ -0,0 +1,131 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "kernel/smp.h"
+#include "kernel/apic.h"
+#include "kernel/acpi.h"
+#include "kernel/percpu.h"
+#include "kernel/sched.h"
+#include "kernel/thread.h"
+#include "kernel/kmem.h"
+#include "kernel/vmm.h"
+#include "kernel/cpu.h"
+#include "kernel/clock.h"
+#include "kernel/utils.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/syscall.h"
+#include "boot/gdt.h"
+#include "boot/idt.h"
+#include "drivers/pit.h"
+#include "libk/string.h"
+
+#define KERNEL_OFFSET 0xC0000000
+// Physical address of the real mode trampoline (see ap_trampoline.S)
+#define AP_TRAMPOLINE 0x8000
+#define INIT_DELAY_MS 10
+#define STARTUP_DELAY_US 200
+#define STARTUP_TIMEOUT_MS 100
+
+extern char ap_trampoline_start[];
+extern char ap_trampoline_end[];
+extern uint32_t ap_trampoline_cr3;
+extern uint32_t ap_trampoline_stack;
+extern uint32_t ap_trampoline_entry;
+extern uint32_t ap_trampoline_cpu;
+
+void smp__ap_main(uint32_t index);
+static void set_parameter(uint32_t* parameter, uint32_t value);
+static bool start_ap(uint8_t apic_id, uint32_t index);
+
+static volatile bool ap_started;
+static void* ap_stack; // stack of the idle thread of the starting AP
+
+/**
+ * Set a parameter in the copy of the trampoline
+ */
+static void set_parameter(uint32_t* parameter, uint32_t value) {
+    uint32_t offset = (uint32_t) ((char*) parameter - ap_trampoline_start);
+    *(volatile uint32_t*) (KERNEL_OFFSET + AP_TRAMPOLINE + offset) = value;
+}
+
+/**
+ * First C code run by an application processor, on the stack of its idle
+ * thread
+ */
+void smp__ap_main(uint32_t index) {
+    gdt__load(index);
+    idt__load();
+    syscall__init_ap();
+    apic__init_ap();
+    percpu__set_online(index, apic__id());
+    apic__timer_start();
+    ap_started = true;
+    sched__start_ap((uint32_t) ap_stack, (uint32_t) ap_stack + THREAD_STACK_SIZE);
+}
+
+static bool start_ap(uint8_t apic_id, uint32_t index) {
+    void* stack = kmem__alloc(THREAD_STACK_SIZE, 0);
+    if (stack == NULL) {
+        return false;
+    }
+    set_parameter(&ap_trampoline_stack, ((uint32_t) stack + THREAD_STACK_SIZE) & ~0xfu);
+    ap_stack = stack;
+    set_parameter(&ap_trampoline_cpu, index);
+    ap_started = false;
+
+    // INIT-SIPI-SIPI sequence from the Intel MultiProcessor Specification
+    apic__send_init(apic_id);
+    clock__delay_us(INIT_DELAY_MS * 1000);
+    for (uint32_t i = 0; i < 2 && !ap_started; i++) {
+        apic__send_startup(apic_id, AP_TRAMPOLINE);
+        clock__delay_us(STARTUP_DELAY_US);
+    }
+    for (uint32_t ms = 0; ms < STARTUP_TIMEOUT_MS && !ap_started; ms++) {
+        clock__delay_us(1000);
+    }
+
+    if (!ap_started) {
+        // The stack is not freed: the CPU could still start using it
+        debug("SMP: CPU with APIC id %u did not start", apic_id);
+        return false;
+    }
+    return true;
+}
+
+void smp__init() {
+    const acpi_madt_info_t* info = apic__info();
+    if (info->cpus_count <= 1) {
+        return;
+    }
+
+    uint8_t bsp = apic__id();
+    percpu__set_online(0, bsp);
+
+    // The local timers of the APs give their scheduler ticks
+    apic__timer_calibrate(pit__get_frequency());
+
+    memmove((void*) (KERNEL_OFFSET + AP_TRAMPOLINE), ap_trampoline_start,
+            (size_t) (ap_trampoline_end - ap_trampoline_start));
+    set_parameter(&ap_trampoline_cr3, cpu__read_cr3());
+    set_parameter(&ap_trampoline_entry, (uint32_t) smp__ap_main);
+
+    vmm__identity_map_low(true);
+    uint32_t index = 1;
+    for (uint32_t i = 0; i < info->cpus_count && index < MAX_CPUS; i++) {
+        uint8_t apic_id = info->cpu_apic_ids[i];
+        if (apic_id == bsp) {
+            continue;
+        }
+        if (start_ap(apic_id, index)) {
+            index++;
+        }
+    }
+    vmm__identity_map_low(false);
+
+    debug("SMP: %u CPUs online", percpu__online_count());
+}
+
+void smp__send_reschedule(uint32_t cpu_index) {
+    apic__send_ipi(percpu__get(cpu_index)->apic_id, IRQ_RESCHEDULE);
+}
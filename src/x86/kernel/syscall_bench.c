@@ -0,0 +1,90 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/syscall_bench.h"
+#include "kernel/syscall.h"
+#include "kernel/thread.h"
+#include "kernel/sched.h"
+#include "kernel/vmm.h"
+#include "kernel/pmm.h"
+#include "kernel/utils.h"
+#include "libk/stdio.h"
+#include "libk/string.h"
+
+// User pages of the benchmark: a copy of syscall_bench_user.S, then the
+// results followed by the user stack
+#define USER_CODE 0x40000000
+#define USER_DATA (USER_CODE + PAGE_SIZE)
+
+// Shared with syscall_bench_user.S
+typedef struct {
+    uint32_t iterations;
+    uint32_t use_sysenter;
+    uint32_t min[2]; // in cycles, int 0x80 then sysenter
+    uint64_t total[2];
+} results_t;
+
+extern char syscall_bench_user_start[];
+extern char syscall_bench_user_end[];
+
+static void user_thread(void* data);
+static void print(const char* name, const results_t* results, size_t method);
+
+static void user_thread(void* data) {
+    (void) data;
+    // Call frame of the user code: return address, then its argument
+    uint32_t* stack = (uint32_t*) (USER_DATA + PAGE_SIZE) - 2;
+    stack[0] = 0;
+    stack[1] = USER_DATA;
+    syscall__enter_user(USER_CODE, (uint32_t) stack);
+}
+
+static void print(const char* name, const results_t* results, size_t method) {
+    printf("%s: min %u cycles, avg %u cycles\n", name, results->min[method],
+            (uint32_t) (results->total[method] / results->iterations));
+}
+
+void syscall_bench__run(uint32_t iterations) {
+    size_t code_size = (size_t) (syscall_bench_user_end - syscall_bench_user_start);
+    if (code_size > PAGE_SIZE || iterations == 0) {
+        return;
+    }
+
+    // The code page is only writable by the kernel while it is copied
+    uint32_t code_frame = pmm__alloc_frame();
+    vmm__map_page((void*) USER_CODE, code_frame, PAGE_WRITABLE);
+    memmove((void*) USER_CODE, syscall_bench_user_start, code_size);
+    vmm__map_page((void*) USER_CODE, code_frame, PAGE_USER);
+    vmm__map_page((void*) USER_DATA, pmm__alloc_frame(), PAGE_USER | PAGE_WRITABLE);
+
+    results_t* results = (results_t*) USER_DATA;
+    memset(results, 0, sizeof(results_t));
+    results->iterations = iterations;
+    results->use_sysenter = syscall__has_sysenter();
+
+    // Set once the user thread is back in the kernel for good, so that its
+    // pages can go
+    volatile bool exited = false;
+    thread_t* thread = thread__alloc("syscall_bench", user_thread, NULL);
+    if (thread == NULL) {
+        debug("syscall_bench: could not create the user thread");
+    }
+    else {
+        thread->exited = &exited;
+        sched__enqueue(thread);
+        while (!exited) {
+            thread__sleep(10);
+        }
+
+        print("null syscall (int 0x80)", results, 0);
+        if (results->use_sysenter) {
+            print("null syscall (sysenter)", results, 1);
+        }
+        else {
+            printf("null syscall (sysenter): not supported\n");
+        }
+    }
+
+    pmm__free_frame(vmm__unmap_page((void*) USER_DATA));
+    pmm__free_frame(vmm__unmap_page((void*) USER_CODE));
+}
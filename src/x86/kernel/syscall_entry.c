@@ -0,0 +1,65 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "kernel/syscall.h"
+#include "kernel/interrupt_handlers.h"
+#include "kernel/cpu.h"
+#include "kernel/tss.h"
+#include "kernel/percpu.h"
+#include "boot/gdt.h"
+#include "kernel/utils.h"
+
+extern void sysenter_entry(void);
+
+static int_result_t syscall_handler(registers_t* regs);
+static void init_sysenter(void);
+
+static bool has_sysenter;
+
+/**
+ * int 0x80: the registers saved by the stub give the arguments, and the
+ * result is popped in %eax by iret
+ */
+static int_result_t syscall_handler(registers_t* regs) {
+    // The interrupt gate disabled interrupts, system calls may be long
+    cpu__sti();
+    regs->eax = (uint32_t) syscall__dispatch(regs->eax, regs->ebx, regs->esi, regs->edi);
+    return INT_HANDLED;
+}
+
+/**
+ * sysenter loads %esp from an MSR, which can not follow the thread
+ * switches: it points to the esp0 field of the TSS of the CPU, and the
+ * entry code loads the kernel stack of the thread from there.
+ * sysexit returns to the user segments following KERN_CODE_SEG.
+ */
+static void init_sysenter() {
+    if (!has_sysenter) {
+        return;
+    }
+    cpu__wrmsr(MSR_SYSENTER_CS, KERN_CODE_SEG);
+    cpu__wrmsr(MSR_SYSENTER_ESP, (uint32_t) &tss__get(percpu__id())->esp0);
+    cpu__wrmsr(MSR_SYSENTER_EIP, (uint32_t) sysenter_entry);
+}
+
+void syscall__init() {
+    interrupt_handlers__register(SYSCALL_VECTOR, syscall_handler);
+
+    uint32_t eax, ebx, ecx, edx;
+    cpu__cpuid(1, &eax, &ebx, &ecx, &edx);
+    uint32_t family = (eax >> 8) & 0xf;
+    uint32_t model = (eax >> 4) & 0xf;
+    uint32_t stepping = eax & 0xf;
+    // The Pentium Pro reports the flag without supporting the instructions
+    has_sysenter = (edx & CPUID_FEAT_EDX_SEP) && (family != 6 || model >= 3 || stepping >= 3);
+    debug("System calls: int 0x%x%s", SYSCALL_VECTOR, has_sysenter ? ", sysenter" : "");
+    init_sysenter();
+}
+
+void syscall__init_ap() {
+    init_sysenter();
+}
+
+bool syscall__has_sysenter() {
+    return has_sysenter;
+}
@@ -0,0 +1,154 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/thread.h"
+#include "kernel/sched.h"
+#include "kernel/kmem.h"
+#include "kernel/cpu.h"
+#include "kernel/tss.h"
+
+// Saved context popped by thread__switch when a thread first runs
+typedef struct {
+    uint32_t edi, esi, ebx, ebp;
+    uint32_t eip;
+} switch_frame_t;
+
+static void thread_entry(void);
+static void sleep_timeout(void* data);
+
+static uint32_t next_id;
+
+// First code run by every new thread, "returned to" by thread__switch
+static void thread_entry() {
+    // The switch to this thread is not complete yet, and sched__schedule
+    // is always called with interrupts disabled
+    sched__finish_switch();
+    cpu__sti();
+    thread_t* thread = sched__current();
+    thread->func(thread->data);
+    thread__exit();
+}
+
+thread_t* thread__alloc(const char* name, thread_func_t func, void* data) {
+    thread_t* thread = kmem__alloc(sizeof(thread_t), 0);
+    if (thread == NULL) {
+        return NULL;
+    }
+    thread->stack = kmem__alloc(THREAD_STACK_SIZE, 0);
+    if (thread->stack == NULL) {
+        kmem__free(thread);
+        return NULL;
+    }
+
+    uint32_t top = ((uint32_t) thread->stack + THREAD_STACK_SIZE) & ~0xfu;
+    switch_frame_t* frame = (switch_frame_t*) (top - sizeof(switch_frame_t));
+    frame->edi = 0;
+    frame->esi = 0;
+    frame->ebx = 0;
+    frame->ebp = 0;
+    frame->eip = (uint32_t) thread_entry;
+
+    thread->esp = (uint32_t) frame;
+    thread->stack_bottom = (uint32_t) thread->stack;
+    thread->stack_top = (uint32_t) thread->stack + THREAD_STACK_SIZE;
+    thread->next = NULL;
+    thread->name = name;
+    thread->state = THREAD_READY;
+    thread->priority = SCHED_PRIORITY_DEFAULT;
+    thread->boost = 0;
+    thread->cpu = 0;
+    thread->on_cpu = false;
+    thread->func = func;
+    thread->data = data;
+    timer__init_timer(&thread->sleep_timer);
+    thread->sleep_expired = false;
+    thread->exited = NULL;
+
+    uint32_t flags = cpu__irq_save();
+    thread->id = next_id++;
+    cpu__irq_restore(flags);
+    return thread;
+}
+
+thread_t* thread__create(const char* name, thread_func_t func, void* data) {
+    thread_t* thread = thread__alloc(name, func, data);
+    if (thread != NULL) {
+        sched__enqueue(thread);
+    }
+    return thread;
+}
+
+void thread__free(thread_t* thread) {
+    if (thread->stack == NULL) {
+        // The boot thread runs on the bootstrap stack
+        return;
+    }
+    kmem__free(thread->stack);
+    kmem__free(thread);
+}
+
+void thread__init_boot(thread_t* thread, const char* name, uint32_t stack_bottom, uint32_t stack_top) {
+    thread->esp = 0;
+    thread->next = NULL;
+    thread->id = next_id++;
+    thread->name = name;
+    thread->state = THREAD_RUNNING;
+    thread->priority = SCHED_PRIORITY_DEFAULT;
+    thread->boost = 0;
+    thread->cpu = 0;
+    thread->on_cpu = true;
+    thread->stack = NULL;
+    thread->stack_bottom = stack_bottom;
+    thread->stack_top = stack_top;
+    thread->func = NULL;
+    thread->data = NULL;
+    timer__init_timer(&thread->sleep_timer);
+    thread->sleep_expired = false;
+    thread->exited = NULL;
+}
+
+void thread__load_kernel_stack(thread_t* thread) {
+    if (thread->stack == NULL) {
+        // Threads on a bootstrap stack never run in user mode
+        return;
+    }
+    tss__set_kernel_stack(((uint32_t) thread->stack + THREAD_STACK_SIZE) & ~0xfu);
+}
+
+void thread__exit() {
+    cpu__cli();
+    thread_t* thread = sched__current();
+    if (thread->exited != NULL) {
+        *thread->exited = true;
+    }
+    thread->state = THREAD_DEAD;
+    sched__schedule();
+    // A dead thread is never scheduled again
+    for(;;) {
+        cpu__hlt();
+    }
+}
+
+void thread__yield() {
+    uint32_t flags = cpu__irq_save();
+    sched__schedule();
+    cpu__irq_restore(flags);
+}
+
+static void sleep_timeout(void* data) {
+    thread_t* thread = data;
+    thread->sleep_expired = true;
+    sched__wake_up(thread);
+}
+
+void thread__sleep(uint32_t ms) {
+    thread_t* thread = sched__current();
+    thread->sleep_expired = false;
+    timer__add(&thread->sleep_timer, timer__now() + timer__ms_to_ticks(ms), sleep_timeout, thread);
+    // Checked under the lock sched__wake_up takes: the timer may expire on
+    // another CPU
+    while (sched__prepare_block(&thread->sleep_expired)) {
+        sched__block();
+    }
+    sched__cancel_block();
+}
@@ -0,0 +1,30 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "kernel/tss.h"
+#include "kernel/percpu.h"
+#include "boot/gdt.h"
+#include "libk/string.h"
+
+static tss_t tss[MAX_CPUS];
+
+void tss__init() {
+    memset(tss, 0, sizeof(tss));
+    for (uint32_t i = 0; i < MAX_CPUS; i++) {
+        tss[i].ss0 = KERN_DATA_SEG;
+        tss[i].iomap_base = sizeof(tss_t);
+    }
+}
+
+tss_t* tss__get(uint32_t cpu_index) {
+    return &tss[cpu_index];
+}
+
+void tss__load(uint32_t cpu_index) {
+    uint16_t selector = (uint16_t) TSS_SEG(cpu_index);
+    __asm__ __volatile__ ("ltr %0" : : "r" (selector) : "memory");
+}
+
+void tss__set_kernel_stack(uint32_t esp0) {
+    tss[percpu__id()].esp0 = esp0;
+}
@@ -8,32 +8,60 @@
 #include "libk/stdio.h"
 #include "kernel/vmm.h"
 #include "kernel/pmm.h"
+#include "kernel/cpu.h"
+#include "libk/string.h"
+#include "kernel/spinlock.h"
+#include "kernel/thread.h"
+#include "kernel/sched.h"
+#include "kernel/ksym.h"
+#include "kernel/trace.h"
 
 #define PAGE_FAULT_EXCEPTION 14
+#define KERNEL_OFFSET 0xC0000000
+// Mapped by the boot page table
+#define BOOT_MAPPED_END 0x400000
 #define KERNEL_HEAP_BASE 0xD0000000
-#define PAGE_SIZE 4096
+#define MMIO_BASE 0xF0000000
+#define MMIO_END ADDR_PT_BASE
 #define PT_ENTRIES_NUMBER 1024
 #define PD_ENTRIES_NUMBER 1024
 #define ADDR_PD_BASE 0xfffff000
 #define ADDR_PT_BASE 0xffc00000
 
-#define PAGE_PRESENT 1
-#define PAGE_WRITABLE 2
-
-static void page_fault_handler(registers_t* regs);
+static int_result_t page_fault_handler(registers_t* regs);
 static void dump_page_directory(void);
 static void flush_tlb(void);
+static void map_page(void* virt, uint32_t phys, uint32_t flags);
+static vmm_region_t* find_region(uint32_t addr);
 
 static void* kernel_heap_end;
+static uint32_t mmio_end;
+// Physical end of the direct map
+static uint32_t direct_end;
+// Protects the page tables of the kernel address space, shared by all CPUs
+static spinlock_t vmm_lock = SPINLOCK_INIT;
+// Demand paged regions, sorted by address
+static vmm_region_t* regions;
+static spinlock_t regions_lock = SPINLOCK_INIT;
 
 void vmm__init() {
     debug("Initialize VMM");
     kernel_heap_end = (void*) KERNEL_HEAP_BASE;
+    mmio_end = MMIO_BASE;
+    // Extend the mapping of the first 4 MiB to the memory below the heap
+    direct_end = pmm__memory_end();
+    if (direct_end > KERNEL_HEAP_BASE - KERNEL_OFFSET) {
+        direct_end = KERNEL_HEAP_BASE - KERNEL_OFFSET;
+    }
+    for (uint32_t phys = BOOT_MAPPED_END; phys < direct_end; phys += PAGE_SIZE) {
+        map_page((void*) (phys + KERNEL_OFFSET), phys, PAGE_WRITABLE);
+    }
+    debug("Direct map of the physical memory up to 0x%x", direct_end);
     // Register a handler for PAGE_FAULT exception
     interrupt_handlers__register(PAGE_FAULT_EXCEPTION, page_fault_handler);    
 }
 
-static void page_fault_handler(registers_t* regs) {
+static int_result_t page_fault_handler(registers_t* regs) {
     // The faulting address is stored in %cr2
     uint32_t addr;
     __asm__("mov %%cr2, %0":"=r"(addr));
@@ -43,6 +71,14 @@ static void page_fault_handler(registers_t* regs) {
    int user = regs->err_code & 0x4;           // Processor was in user-mode?
    int reserved = regs->err_code & 0x8;     // Overwritten CPU-reserved bits of page entry?
    int id = regs->err_code & 0x10;          // Caused by an instruction fetch?
+    TRACE(TRACE_PAGE_FAULT, addr, regs->eip, regs->err_code);
+
+    if (present) {
+        vmm_region_t* region = find_region(addr);
+        if (region != NULL && region->fault(region, addr, writable != 0)) {
+            return INT_HANDLED;
+        }
+    }
     
    vga__setcolor(VGA_COLOR_LIGHT_RED);
    printf("Page fault ( ");
@@ -55,7 +91,54 @@ static void page_fault_handler(registers_t* regs) {
    if (reserved) 
        printf("reserved ");
    printf(") at 0x%x\n", addr);
+   if (user) {
+       // Only the faulty user program is stopped
+       printf("Killing thread %u at eip 0x%x\n", sched__current()->id, regs->eip);
+       thread__exit();
+   }
+   ksym__backtrace(regs->eip, regs->ebp);
    PANIC("Page fault");
+   return INT_HANDLED;
+}
+
+static vmm_region_t* find_region(uint32_t addr) {
+    uint32_t flags = spinlock__lock_irqsave(&regions_lock);
+    vmm_region_t* region = regions;
+    while (region != NULL && region->end <= addr) {
+        region = region->next;
+    }
+    if (region != NULL && region->start > addr) {
+        region = NULL;
+    }
+    spinlock__unlock_irqrestore(&regions_lock, flags);
+    return region;
+}
+
+int vmm__add_region(vmm_region_t* region) {
+    uint32_t flags = spinlock__lock_irqsave(&regions_lock);
+    vmm_region_t** link = &regions;
+    while (*link != NULL && (*link)->end <= region->start) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL && (*link)->start < region->end) {
+        spinlock__unlock_irqrestore(&regions_lock, flags);
+        return -1;
+    }
+    region->next = *link;
+    *link = region;
+    spinlock__unlock_irqrestore(&regions_lock, flags);
+    return 0;
+}
+
+void vmm__remove_region(vmm_region_t* region) {
+    uint32_t flags = spinlock__lock_irqsave(&regions_lock);
+    for (vmm_region_t** link = &regions; *link != NULL; link = &(*link)->next) {
+        if (*link == region) {
+            *link = region->next;
+            break;
+        }
+    }
+    spinlock__unlock_irqrestore(&regions_lock, flags);
 }
 
 static void dump_page_directory() {
@@ -89,6 +172,8 @@ static void allocate_page_table(size_t pde_index, uint32_t flags) {
     uint32_t frame_addr = pmm__alloc_frame();
     *pde_entry = frame_addr | flags;
     flush_tlb();
+    // The frame may contain garbage, which would be seen as present pages
+    memset((char*) ADDR_PT_BASE + (pde_index << 12), 0, PAGE_SIZE);
 }
 
 static void allocate_page_table_entry(size_t pde_index, size_t pte_index, uint32_t flags) {
@@ -102,8 +187,106 @@ static void allocate_page_table_entry(size_t pde_index, size_t pte_index, uint32
     flush_tlb(); 
 }
 
+static void map_page(void* virt, uint32_t phys, uint32_t flags) {
+    uint32_t page = (uint32_t) virt / PAGE_SIZE;
+    size_t pde_index = page / PT_ENTRIES_NUMBER;
+    size_t pte_index = page % PT_ENTRIES_NUMBER;
+    uint32_t* pde_entry = (uint32_t*) (ADDR_PD_BASE + sizeof(uint32_t) * pde_index);
+    if ((*pde_entry & PAGE_PRESENT) == 0) {
+        allocate_page_table(pde_index, PAGE_PRESENT | PAGE_WRITABLE | (flags & PAGE_USER));
+    }
+    else if ((flags & PAGE_USER) && !(*pde_entry & PAGE_USER)) {
+        // User mode needs the bit in both levels, the PTEs still restrict
+        // the other pages of the table
+        *pde_entry |= PAGE_USER;
+        flush_tlb();
+    }
+    uint32_t* pte_entry = (uint32_t*) (ADDR_PT_BASE + (pde_index << 12) + sizeof(uint32_t) * pte_index);
+    *pte_entry = (phys & ~(uint32_t) (PAGE_SIZE - 1)) | flags | PAGE_PRESENT;
+    cpu__invlpg(virt);
+}
+
+void vmm__map_page(void* virt, uint32_t phys, uint32_t flags) {
+    uint32_t irq_flags = spinlock__lock_irqsave(&vmm_lock);
+    map_page(virt, phys, flags);
+    spinlock__unlock_irqrestore(&vmm_lock, irq_flags);
+}
+
+uint32_t vmm__unmap_page(void* virt) {
+    uint32_t irq_flags = spinlock__lock_irqsave(&vmm_lock);
+    uint32_t phys = vmm__get_physical(virt);
+    if (phys != 0) {
+        ((uint32_t*) ADDR_PT_BASE)[(uint32_t) virt / PAGE_SIZE] = 0;
+        cpu__invlpg(virt);
+    }
+    spinlock__unlock_irqrestore(&vmm_lock, irq_flags);
+    return phys & ~(uint32_t) (PAGE_SIZE - 1);
+}
+
+void* vmm__direct(uint32_t phys) {
+    if (phys < BOOT_MAPPED_END) {
+        return (void*) (phys + KERNEL_OFFSET);
+    }
+    return (phys < direct_end) ? (void*) (phys + KERNEL_OFFSET) : NULL;
+}
+
+uint32_t vmm__get_physical(const void* virt) {
+    uint32_t page = (uint32_t) virt / PAGE_SIZE;
+    uint32_t* pde_entry = (uint32_t*) (ADDR_PD_BASE + sizeof(uint32_t) * (page / PT_ENTRIES_NUMBER));
+    if ((*pde_entry & PAGE_PRESENT) == 0) {
+        return 0;
+    }
+    // The page tables are mapped at ADDR_PT_BASE by the last PD entry
+    uint32_t pte = ((uint32_t*) ADDR_PT_BASE)[page];
+    if ((pte & PAGE_PRESENT) == 0) {
+        return 0;
+    }
+    return (pte & ~(uint32_t) (PAGE_SIZE - 1)) | ((uint32_t) virt % PAGE_SIZE);
+}
+
+bool vmm__is_user_range(uint32_t start, uint32_t size) {
+    if (start >= KERNEL_OFFSET || size > KERNEL_OFFSET - start) {
+        return false;
+    }
+    if (size == 0) {
+        return true;
+    }
+    for (uint32_t page = start / PAGE_SIZE; page <= (start + size - 1) / PAGE_SIZE; page++) {
+        uint32_t* pde_entry = (uint32_t*) (ADDR_PD_BASE + sizeof(uint32_t) * (page / PT_ENTRIES_NUMBER));
+        uint32_t user_present = PAGE_PRESENT | PAGE_USER;
+        if ((*pde_entry & user_present) == user_present
+                && (((uint32_t*) ADDR_PT_BASE)[page] & user_present) == user_present) {
+            continue;
+        }
+        // Not mapped yet: the page fault handler maps it if it is in a
+        // demand paged region
+        if (find_region(page * PAGE_SIZE) == NULL) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void* vmm__map_physical(uint32_t phys, size_t size, uint32_t flags) {
+    uint32_t offset = phys % PAGE_SIZE;
+    uint32_t pages = (offset + size + PAGE_SIZE - 1) / PAGE_SIZE;
+    uint32_t irq_flags = spinlock__lock_irqsave(&vmm_lock);
+    if (mmio_end + pages * PAGE_SIZE > MMIO_END) {
+        PANIC("MMIO window exhausted");
+    }
+    uint32_t virt = mmio_end;
+    for (uint32_t i = 0; i < pages; i++) {
+        map_page((void*) (virt + i * PAGE_SIZE), phys - offset + i * PAGE_SIZE, flags);
+    }
+    mmio_end += pages * PAGE_SIZE;
+    spinlock__unlock_irqrestore(&vmm_lock, irq_flags);
+    debug("Map physical 0x%x (%u pages) at 0x%x", phys, pages, virt + offset);
+    return (void*) (virt + offset);
+}
+
 void* vmm__heap_extend(void* end) {
     debug("vmm_heap_extend called with 0x%x", end);
+    uint32_t irq_flags = spinlock__lock_irqsave(&vmm_lock);
     while(kernel_heap_end <= end) {
         // Allocate a new frame
         uint32_t page = (uint32_t) (kernel_heap_end) / PAGE_SIZE;
@@ -112,5 +295,18 @@ void* vmm__heap_extend(void* end) {
         allocate_page_table_entry(pde_index, pte_index, PAGE_PRESENT | PAGE_WRITABLE);
         kernel_heap_end = (char*) kernel_heap_end + PAGE_SIZE;
     }
-    return kernel_heap_end;
+    void* heap_end = kernel_heap_end;
+    spinlock__unlock_irqrestore(&vmm_lock, irq_flags);
+    TRACE(TRACE_HEAP_EXTEND, end, heap_end, 0);
+    return heap_end;
+}
+
+void vmm__identity_map_low(bool enable) {
+    uint32_t irq_flags = spinlock__lock_irqsave(&vmm_lock);
+    uint32_t* pd = (uint32_t*) ADDR_PD_BASE;
+    // The first 4 MiB are mapped at KERNEL_OFFSET by the page table of
+    // the PD entry 768
+    pd[0] = enable ? pd[768] : 0;
+    flush_tlb();
+    spinlock__unlock_irqrestore(&vmm_lock, irq_flags);
 }